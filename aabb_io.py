@@ -1,6 +1,6 @@
 #!/usr/bin/env python3
 """
-Utilities for reading AABB plain text files.
+Utilities for reading AABB plain text and binary box files.
 
 Provides a small, dependency-free reader that other scripts can import.
 """
@@ -13,6 +13,19 @@ from typing import List, Tuple
 
 Box = Tuple[float, float, float, float]  # (min_x, min_y, max_x, max_y)
 
+# Binary box file (see include/aabb_io.h): 64-byte header followed by the payload
+BOX_FILE_MAGIC = b"AABB"
+BOX_FILE_VERSION = 1
+BOX_HEADER = struct.Struct("<4sIQffffI28x")
+LAYOUT_AOS = 0
+LAYOUT_SOA = 1
+
+# Binary pair files (see PairFormat in include/aabb_io.h): 16-byte header, then the pairs
+PAIR_FILE_MAGIC_BINARY = b"AABP"
+PAIR_FILE_MAGIC_VARINT = b"AABV"
+PAIR_FILE_VERSION = 1
+PAIR_HEADER = struct.Struct("<4sIQ")
+
 
 def write_boxes(path: str, boxes: List[Box]) -> None:
     """Write boxes in plain text format.
@@ -34,8 +47,50 @@ def write_boxes(path: str, boxes: List[Box]) -> None:
             f.write(f"{float(b[0])} {float(b[1])} {float(b[2])} {float(b[3])}\n")
 
 
+def write_boxes_binary(path: str, boxes: List[Box], layout: int = LAYOUT_AOS) -> None:
+    """Write boxes in the binary box file format."""
+    os.makedirs(os.path.dirname(path), exist_ok=True) if os.path.dirname(path) else None
+
+    n = len(boxes)
+    if n:
+        bounds = (min(b[0] for b in boxes), min(b[1] for b in boxes),
+                  max(b[2] for b in boxes), max(b[3] for b in boxes))
+    else:
+        bounds = (0.0, 0.0, 0.0, 0.0)
+    with open(path, "wb") as f:
+        f.write(BOX_HEADER.pack(BOX_FILE_MAGIC, BOX_FILE_VERSION, n, *bounds, layout))
+        if layout == LAYOUT_AOS:
+            rec = struct.Struct("<iffff")
+            for i, b in enumerate(boxes):
+                f.write(rec.pack(i, *b))
+        else:
+            for k in range(4):
+                f.write(struct.pack(f"<{n}f", *(b[k] for b in boxes)))
+
+
+def read_boxes_binary(path: str) -> List[Box]:
+    """Read a binary box file (AoS or SoA layout)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, n, _, _, _, _, layout = BOX_HEADER.unpack_from(data, 0)
+    if magic != BOX_FILE_MAGIC or version != BOX_FILE_VERSION:
+        raise ValueError("Invalid binary box file header")
+    off = BOX_HEADER.size
+    if layout == LAYOUT_AOS:
+        return [tuple(r[1:]) for r in struct.iter_unpack("<iffff", data[off:off + 20 * n])]
+    cols = [struct.unpack_from(f"<{n}f", data, off + 4 * n * k) for k in range(4)]
+    return list(zip(*cols))
+
+
+def is_binary_box_file(path: str) -> bool:
+    with open(path, "rb") as f:
+        return f.read(len(BOX_FILE_MAGIC)) == BOX_FILE_MAGIC
+
+
 def read_boxes(path: str) -> List[Box]:
-    """Helper that returns list of boxes."""
+    """Helper that returns list of boxes (text or binary file)."""
+    if is_binary_box_file(path):
+        return read_boxes_binary(path)
     boxes: List[Box] = []
     with open(path, "r") as f:
         n = int(f.readline().strip())
@@ -55,8 +110,52 @@ def read_boxes(path: str) -> List[Box]:
     return boxes
 
 
+def _read_pairs_binary(data: bytes, n: int) -> List[Tuple[int, int]]:
+    flat = struct.unpack_from(f"<{2 * n}I", data, PAIR_HEADER.size)
+    return list(zip(flat[0::2], flat[1::2]))
+
+
+def _read_pairs_varint(data: bytes, n: int) -> List[Tuple[int, int]]:
+    """Decode zigzag/LEB128 deltas: da = a - prev_a, db = b - prev_b if da == 0 else b - a."""
+    pairs_list: List[Tuple[int, int]] = []
+    pos = PAIR_HEADER.size
+    prev_a = prev_b = 0
+
+    def varint() -> int:
+        nonlocal pos
+        shift = value = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                return (value >> 1) ^ -(value & 1)
+            shift += 7
+
+    for _ in range(n):
+        da = varint()
+        db = varint()
+        a = prev_a + da
+        b = (prev_b if da == 0 else a) + db
+        pairs_list.append((a, b))
+        prev_a, prev_b = a, b
+    return pairs_list
+
+
 def read_pairs(path: str) -> List[Tuple[int, int]]:
-    """Read ID pairs from txt file."""
+    """Read ID pairs from a text, binary or varint pair file (detected by magic)."""
+    with open(path, "rb") as f:
+        head = f.read(PAIR_HEADER.size)
+    if len(head) == PAIR_HEADER.size and head[:4] in (PAIR_FILE_MAGIC_BINARY, PAIR_FILE_MAGIC_VARINT):
+        with open(path, "rb") as f:
+            data = f.read()
+        magic, version, n = PAIR_HEADER.unpack_from(data, 0)
+        if version != PAIR_FILE_VERSION:
+            raise ValueError("Unsupported pair file version")
+        if magic == PAIR_FILE_MAGIC_BINARY:
+            return _read_pairs_binary(data, n)
+        return _read_pairs_varint(data, n)
+
     pairs_list: List[Tuple[int, int]] = []
     with open(path, "r") as f:
         for line in f:
@@ -69,4 +168,4 @@ def read_pairs(path: str) -> List[Tuple[int, int]]:
             a, b = map(int, parts)
             pairs_list.append((a, b))
             
-    return pairs_list
\ No newline at end of file
+    return pairs_list
@@ -211,13 +211,52 @@ def gen_packed(
 	return boxes
 
 
+def advance_frames(
+	boxes: List[Box],
+	frames: int,
+	motion: float,
+	width: float,
+	height: float,
+) -> List[List[Box]]:
+	"""Return frames 1..frames-1 of a scene whose boxes drift at constant velocity.
+
+	Every box gets a random velocity of up to `motion` times the mean box edge
+	per frame and bounces off the world bounds, so consecutive frames differ
+	only slightly (the frame coherence incremental broad phases rely on).
+	"""
+	if not boxes:
+		return [[] for _ in range(frames - 1)]
+	mean_edge = sum((b[2] - b[0]) + (b[3] - b[1]) for b in boxes) / (2 * len(boxes))
+	step = motion * mean_edge
+	velocity = []
+	for _ in boxes:
+		angle = random.uniform(0.0, 2.0 * math.pi)
+		speed = random.uniform(0.0, step)
+		velocity.append([speed * math.cos(angle), speed * math.sin(angle)])
+
+	out: List[List[Box]] = []
+	current = list(boxes)
+	for _ in range(1, frames):
+		moved: List[Box] = []
+		for i, (min_x, min_y, max_x, max_y) in enumerate(current):
+			v = velocity[i]
+			if min_x + v[0] < 0.0 or max_x + v[0] > width:
+				v[0] = -v[0]
+			if min_y + v[1] < 0.0 or max_y + v[1] > height:
+				v[1] = -v[1]
+			moved.append((min_x + v[0], min_y + v[1], max_x + v[0], max_y + v[1]))
+		current = moved
+		out.append(moved)
+	return out
+
+
 def positive(val: float, name: str) -> None:
 	if val <= 0:
 		raise ValueError(f"{name} must be positive; got {val}")
 
 
 def parse_args() -> argparse.Namespace:
-	p = argparse.ArgumentParser(description="Generate static 2D AABB dataset (single frame)")
+	p = argparse.ArgumentParser(description="Generate a 2D AABB dataset (a single frame, or a moving scene with --frames)")
 	p.add_argument("--n", type=int, required=True, help="Number of AABBs to generate")
 	p.add_argument("--width", type=float, default=100.0, help="World width")
 	p.add_argument("--height", type=float, default=100.0, help="World height")
@@ -240,6 +279,8 @@ def parse_args() -> argparse.Namespace:
 	p.add_argument("--occupancy", type=float, default=None, help="Approx target occupancy (sum box areas / world area); boxes uniformly rescaled to approach this")
 	p.add_argument("--packed-overlap-mult", type=float, default=1.5, help="Size multiplier applied in packed distribution to induce overlap")
 	p.add_argument("--seed", type=int, default=None, help="RNG seed for reproducibility")
+	p.add_argument("--frames", type=int, default=1, help="Number of frames; frames after the first are written to <out>.f<k>.in")
+	p.add_argument("--motion", type=float, default=0.05, help="Max per-frame displacement of a box, as a multiple of the mean box edge (with --frames)")
 	p.add_argument(
 		"--out",
 		type=str,
@@ -258,6 +299,8 @@ def main() -> None:
 	# validate args
 	if args.n <= 0:
 		raise ValueError("--n must be > 0")
+	if args.frames <= 0:
+		raise ValueError("--frames must be > 0")
 	positive(args.width, "--width")
 	positive(args.height, "--height")
 	positive(args.min_size, "--min-size")
@@ -335,11 +378,17 @@ def main() -> None:
 	# store boxes as .txt
 	base = args.out
 	write_boxes(base + ".in", boxes)
+	frame_paths = []
+	for k, frame in enumerate(advance_frames(boxes, args.frames, args.motion, args.width, args.height), start=1):
+		frame_paths.append(f"{base}.f{k}.in")
+		write_boxes(frame_paths[-1], frame)
 	print(
 		f"Generated {len(boxes)} AABBs in world {args.width}x{args.height} "
 		f"distribution={args.distribution} size_dist={args.size_dist} occupancy={final_occupancy:.4f}"
 	)
 	print(f"Outputs: {base}.in")
+	if frame_paths:
+		print(f"Frames: {args.frames} ({base}.f1.in .. {frame_paths[-1]})")
 
 
 if __name__ == "__main__":
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <fstream>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "pair_sink.h"
+
 namespace aabb {
 
 struct AABB {
@@ -14,15 +19,212 @@ struct AABB {
     float max_y;
 };
 
+// Binary box file (.bin), version 1. All fields are little-endian.
+//   [BoxFileHeader : 64 bytes][payload]
+// Payload in AoS layout: `count` records with the exact in-memory layout of AABB.
+// Payload in SoA layout: min_x[count], min_y[count], max_x[count], max_y[count];
+// ids are implicit (record index).
+constexpr char kBoxFileMagic[4] = {'A', 'A', 'B', 'B'};
+constexpr uint32_t kBoxFileVersion = 1;
+
+enum class BoxLayout : uint32_t {
+    AoS = 0,
+    SoA = 1,
+};
+
+struct BoxFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    float min_x;    // world bounds of all boxes
+    float min_y;
+    float max_x;
+    float max_y;
+    uint32_t layout;
+    uint32_t reserved[7];
+};
+static_assert(sizeof(BoxFileHeader) == 64, "BoxFileHeader must be 64 bytes");
+static_assert(sizeof(AABB) == 20, "AABB layout is part of the binary file format");
+
+// Read-only mapping of a binary box file. The payload is used in place, so
+// loading cost is page faults instead of parsing.
+class MappedBoxFile {
+public:
+    MappedBoxFile() = default;
+    ~MappedBoxFile();
+    MappedBoxFile(const MappedBoxFile &) = delete;
+    MappedBoxFile &operator=(const MappedBoxFile &) = delete;
+    MappedBoxFile(MappedBoxFile &&other) noexcept;
+    MappedBoxFile &operator=(MappedBoxFile &&other) noexcept;
+
+    bool open(const std::string &path, std::string &err);
+    void close();
+
+    const BoxFileHeader &header() const { return *reinterpret_cast<const BoxFileHeader *>(data_); }
+    size_t size() const { return static_cast<size_t>(header().count); }
+    BoxLayout layout() const { return static_cast<BoxLayout>(header().layout); }
+
+    // AoS payload, nullptr for SoA files
+    const AABB *boxes() const;
+    // SoA payload columns, nullptr for AoS files
+    const float *min_x() const { return column(0); }
+    const float *min_y() const { return column(1); }
+    const float *max_x() const { return column(2); }
+    const float *max_y() const { return column(3); }
+
+    // Materialize the file contents as AABBs (memcpy for AoS)
+    void copy_to(std::vector<AABB> &boxes) const;
+
+private:
+    const float *column(int k) const;
+
+    const char *data_ = nullptr;
+    size_t bytes_ = 0;
+    bool mapped_ = false;   // false when the fallback heap buffer is used
+};
+
+// Sequential reader of a binary box file, in chunks of the caller's size, for
+// inputs larger than memory. SoA ids are the record index, as in copy_to().
+class BoxFileReader {
+public:
+    bool open(const std::string &path, std::string &err);
+
+    const BoxFileHeader &header() const { return header_; }
+    uint64_t size() const { return header_.count; }
+    BoxLayout layout() const { return static_cast<BoxLayout>(header_.layout); }
+
+    // The next min(max, remaining) boxes; `chunk` is empty at the end
+    bool read(std::vector<AABB> &chunk, size_t max, std::string &err);
+
+private:
+    std::ifstream in_;
+    std::string path_;
+    BoxFileHeader header_{};
+    uint64_t next_ = 0;
+    std::vector<float> column_;
+};
+
+// True if the file starts with the binary box file magic
+bool is_binary_box_file(const std::string &path);
+
+// Resolve a testcase number to its input file, preferring testcase/<n>.bin over testcase/<n>.in
+std::string testcase_input_path(const std::string &testcase);
+
+// Input file of frame `frame` of a multi-frame testcase (gen.py --frames):
+// frame 0 is the testcase itself, later frames are testcase/<n>.f<frame>
+std::string testcase_frame_path(const std::string &testcase, unsigned frame);
+
+// Reads either format; the binary format is detected by its magic.
+// Text files are mapped and parsed in parallel, line-aligned chunks.
 bool read_boxes(
     const std::string &path,
     std::vector<AABB> &boxes,
     std::string &err
 );
 
+// Same as above with an explicit parser thread count (0 = all hardware threads)
+bool read_boxes(
+    const std::string &path,
+    std::vector<AABB> &boxes,
+    unsigned threads,
+    std::string &err
+);
+
+bool write_boxes_binary(
+    const std::string &path,
+    const std::vector<AABB> &boxes,
+    BoxLayout layout,
+    std::string &err
+);
+
+// Pair output formats
+//   Text   : "a b\n" per pair (the .out format)
+//   Binary : PairFileHeader, then count x {uint32 a, uint32 b}
+//   Varint : PairFileHeader, then per pair two LEB128 varints of zigzag deltas:
+//            da = a - prev_a, then db = b - prev_b if da == 0 else b - a.
+//            Sorted pair lists encode to ~2-3 bytes per pair.
+enum class PairFormat {
+    Text,
+    Binary,
+    Varint,
+};
+
+constexpr char kPairFileMagicBinary[4] = {'A', 'A', 'B', 'P'};
+constexpr char kPairFileMagicVarint[4] = {'A', 'A', 'B', 'V'};
+constexpr uint32_t kPairFileVersion = 1;
+
+struct PairFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+};
+static_assert(sizeof(PairFileHeader) == 16, "PairFileHeader must be 16 bytes");
+
+// Parse "text", "bin" or "varint"
+bool parse_pair_format(const std::string &name, PairFormat &format);
+
+// Buffered streaming pair writer. Pairs are encoded into a large buffer that is
+// flushed with a single write when full; binary headers are patched on close().
+// As a PairSink it lets engines stream pairs straight to disk. Writes to a
+// writer that is not open (never opened, or closed) are dropped and set the
+// stream's failbit.
+class PairWriter : public PairSink {
+public:
+    PairWriter() = default;
+    ~PairWriter();
+    PairWriter(const PairWriter &) = delete;
+    PairWriter &operator=(const PairWriter &) = delete;
+
+    bool open(const std::string &path, PairFormat format, std::string &err);
+    bool close(std::string &err);
+
+    void write(uint32_t a, uint32_t b) {
+        if (len_ + kMaxRecordBytes > buf_.size()) {
+            // Always taken when not open: the buffer only exists while open
+            if (!out_.is_open()) {
+                out_.setstate(std::ios::failbit);
+                return;
+            }
+            flush();
+        }
+        encode(a, b);
+        ++count_;
+    }
+    void write(const std::pair<uint32_t, uint32_t> *pairs, size_t n) {
+        for (size_t i = 0; i < n; ++i) write(pairs[i].first, pairs[i].second);
+    }
+    void on_pairs(const Pair *pairs, size_t count) override { write(pairs, count); }
+
+    uint64_t count() const { return count_; }
+    uint64_t bytes_written() const { return bytes_ + len_; }
+
+private:
+    static constexpr size_t kBufferBytes = size_t(1) << 20;
+    static constexpr size_t kMaxRecordBytes = 24;
+
+    void encode(uint32_t a, uint32_t b);
+    void flush();
+
+    std::ofstream out_;
+    std::vector<char> buf_;
+    size_t len_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t count_ = 0;
+    uint32_t prev_a_ = 0;
+    uint32_t prev_b_ = 0;
+    PairFormat format_ = PairFormat::Text;
+};
+
+bool write_pairs(
+    const std::string &path,
+    const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+    std::string &err
+);
+
 bool write_pairs(
     const std::string &path,
     const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+    PairFormat format,
     std::string &err
 );
 
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+
+namespace aabb {
+
+// Alignment of every BoxSoA column (one cache line, one AVX-512 register)
+constexpr size_t kBoxSoAAlign = 64;
+
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) noexcept {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(kBoxSoAAlign)));
+    }
+    void deallocate(T *p, size_t) noexcept {
+        ::operator delete(p, std::align_val_t(kBoxSoAAlign));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U> &) const noexcept { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure-of-Arrays box storage. Slot k holds the box with original id id[k],
+// so engines can reorder boxes (by sweep order, by cell) and still report ids.
+struct BoxSoA {
+    AlignedVector<float> min_x;
+    AlignedVector<float> min_y;
+    AlignedVector<float> max_x;
+    AlignedVector<float> max_y;
+    AlignedVector<uint32_t> id;
+
+    size_t size() const { return id.size(); }
+    void resize(size_t n);
+
+    void set(size_t slot, const AABB &box) {
+        min_x[slot] = box.min_x;
+        min_y[slot] = box.min_y;
+        max_x[slot] = box.max_x;
+        max_y[slot] = box.max_y;
+        id[slot] = static_cast<uint32_t>(box.id);
+    }
+
+    // Inclusive overlap test of two slots
+    bool overlaps(size_t a, size_t b) const {
+        return !(max_x[a] < min_x[b] || max_x[b] < min_x[a] ||
+                 max_y[a] < min_y[b] || max_y[b] < min_y[a]);
+    }
+
+    // Refills the columns with boxes[order[k]] at slot k, keeping their capacity
+    void assign(BoxSpan boxes, const std::vector<uint32_t> &order);
+
+    // Boxes in input order (slot == index)
+    static BoxSoA from_boxes(BoxSpan boxes);
+    // Boxes gathered in `order`: slot k holds boxes[order[k]]
+    static BoxSoA from_boxes(BoxSpan boxes, const std::vector<uint32_t> &order);
+};
+
+} // namespace aabb
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "aabb_io.h"
+
+namespace aabb {
+
+// Non-owning view of contiguous boxes, the input of every engine. Converts
+// implicitly from a std::vector, and wraps any other array (a simulator's
+// own storage, MappedBoxFile::boxes()) without copying it. Engines report
+// pairs by AABB::id, so the ids need not match the positions in the span.
+class BoxSpan {
+public:
+    BoxSpan() = default;
+    BoxSpan(const AABB *data, size_t size) : data_(data), size_(size) {}
+    BoxSpan(const std::vector<AABB> &boxes) : data_(boxes.data()), size_(boxes.size()) {}
+
+    const AABB *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const AABB &operator[](size_t i) const { return data_[i]; }
+    const AABB *begin() const { return data_; }
+    const AABB *end() const { return data_ + size_; }
+
+private:
+    const AABB *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace aabb
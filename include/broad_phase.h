@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
+
+namespace aabb {
+
+// Engines with an incremental (frame-coherent) mode
+enum class BroadPhaseMethod {
+    SortAndSweep,    // endpoint lists on both axes, repaired by insertion sort
+    SpatialHashing,  // hierarchical grid, only cells around changed boxes re-tested
+};
+
+// Parse "SS" or "SH"
+bool parse_broad_phase_method(const std::string &name, BroadPhaseMethod &method);
+
+// Work done by the last update()
+struct BroadPhaseStats {
+    bool rebuilt = false;  // the structure was built from scratch
+    uint64_t swaps = 0;    // SS: endpoint swaps of the insertion sort
+    uint64_t moved = 0;    // SH: boxes that changed cell or level
+};
+
+// Stateful broad phase for scenes that persist across frames. Box i of one
+// frame is box i of the next; pairs are reported by id (i < j). A change of
+// the box count, or motion too large to repair cheaply, rebuilds the
+// structure, which only costs time: the reported deltas stay exact.
+class BroadPhase {
+public:
+    virtual ~BroadPhase() = default;
+
+    // Moves the scene to the next frame
+    virtual void update(BoxSpan boxes) = 0;
+
+    // Pairs that started (added) and stopped (removed) overlapping since the
+    // previous query, each sorted; the first query reports every pair as added
+    virtual void query(PairSink &added, PairSink &removed) = 0;
+
+    // Overlapping pairs as of the last update()
+    virtual uint64_t num_pairs() const = 0;
+
+    const BroadPhaseStats &stats() const { return stats_; }
+
+    // Vector adapter over the sink overload
+    void query(std::vector<Pair> &added, std::vector<Pair> &removed);
+
+protected:
+    BroadPhaseStats stats_;
+};
+
+std::unique_ptr<BroadPhase> make_broad_phase(BroadPhaseMethod method);
+
+} // namespace aabb
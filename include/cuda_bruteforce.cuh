@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "cuda_context.cuh"
+#include "pair_sink.h"
+
+// CUDA all-pairs broad phase: every box against every later box, one block
+// per 256 x 256 tile of the upper triangle with the column boxes staged in
+// shared memory. No sort and no grid, so it wins on small or very dense
+// scenes where the candidate count is close to N^2 / 2 anyway (returns pairs
+// i<j in device output order).
+std::vector<std::pair<uint32_t, uint32_t>> cuda_brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes);
+
+// Streaming variant: emits each pair (i < j) once, in device output order
+void cuda_brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink);
+
+// Same on an explicit context, whose buffers are reused across calls
+void cuda_brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    aabb::CudaContext& context);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "cuda_context.cuh"
+#include "pair_sink.h"
+
+// CUDA LBVH broad-phase: Morton-sorted boxes, Karras radix-tree build and one
+// ordered traversal per leaf (returns pairs i<j in device output order)
+std::vector<std::pair<uint32_t, uint32_t>> cuda_bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes);
+
+// Streaming variant: emits each pair (i < j) once, in device output order
+void cuda_bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink);
+
+// Same on an explicit context, whose buffers are reused across calls
+void cuda_bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    aabb::CudaContext& context);
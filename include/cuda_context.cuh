@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "phase_timer.h"
+
+namespace aabb {
+
+struct EngineStats;
+
+// Reusable GPU state of the CUDA engines: one device, a compute and a copy
+// stream, numbered scratch buffers on the device, pinned host staging buffers
+// and a caching allocator for Thrust temporaries. Buffers grow geometrically and are only
+// freed with the context, so a warm call does no cudaMalloc and no device
+// initialization; those costs land on the first (cold) call.
+class CudaContext {
+public:
+    explicit CudaContext(int device = 0);
+    ~CudaContext();
+    CudaContext(const CudaContext&) = delete;
+    CudaContext& operator=(const CudaContext&) = delete;
+
+    // Context of the engine overloads that take none (device 0), created on first use
+    static CudaContext& shared();
+    // Shared context of `device`, created on first use; safe from any thread
+    static CudaContext& for_device(int device);
+
+    bool ok() const { return ok_; }
+    const std::string& error() const { return error_; }
+    int device() const { return device_index_; }
+    int device_count() const { return device_count_; }
+    // Makes the device current on the calling thread; engines call it on
+    // entry, so one host thread per device can drive several contexts
+    bool activate();
+    cudaStream_t stream() const { return stream_; }
+    // Second stream for downloads that overlap work on stream()
+    cudaStream_t copy_stream() const { return copy_stream_; }
+
+    // Boxes per host-to-device copy when an engine converts and uploads its
+    // input; the copy of one chunk overlaps converting the next
+    static constexpr uint32_t kUploadChunk = 1u << 16;
+
+    // Device scratch buffer `slot` with room for `count` elements (even 0),
+    // nullptr if the allocation failed. Contents do not survive a call; the
+    // pointer stays valid until the slot is requested with a larger size.
+    template <typename T>
+    T* device(size_t slot, size_t count) {
+        return static_cast<T*>(reserve(device_, slot, count * sizeof(T), false));
+    }
+
+    // Elements of T that device buffer `slot` holds without growing
+    template <typename T>
+    size_t device_capacity(size_t slot) const {
+        return slot < device_.size() ? device_[slot].bytes / sizeof(T) : 0;
+    }
+
+    // Pinned host buffer `slot`, same rules
+    template <typename T>
+    T* host(size_t slot, size_t count) {
+        return static_cast<T*>(reserve(host_, slot, count * sizeof(T), true));
+    }
+
+    // Timing event `index`, created on first use (nullptr if that failed)
+    cudaEvent_t timing_event(size_t index);
+
+    // Thrust temporary storage, reused by size across calls. Use as
+    // thrust::cuda::par(context.thrust_allocator()).on(context.stream()).
+    class ThrustAllocator {
+    public:
+        using value_type = char;
+        explicit ThrustAllocator(CudaContext& context) : context_(context) {}
+        char* allocate(std::ptrdiff_t bytes);
+        void deallocate(char* ptr, size_t bytes);
+
+    private:
+        CudaContext& context_;
+    };
+    ThrustAllocator& thrust_allocator() { return thrust_allocator_; }
+
+    // Seconds the constructor spent on device and stream setup (cold start)
+    double init_seconds() const { return init_seconds_; }
+    // cudaMalloc and cudaHostAlloc calls made so far
+    uint64_t num_allocations() const { return num_allocations_; }
+    // Device bytes held by scratch buffers and cached Thrust blocks
+    size_t device_bytes_reserved() const { return device_bytes_reserved_; }
+
+private:
+    struct Block {
+        void* ptr = nullptr;
+        size_t bytes = 0;
+    };
+
+    void* reserve(std::vector<Block>& blocks, size_t slot, size_t bytes, bool pinned);
+    void fail(cudaError_t err, const char* what);
+
+    bool ok_ = false;
+    std::string error_;
+    int device_index_ = 0;
+    int device_count_ = 0;
+    cudaStream_t stream_ = nullptr;
+    cudaStream_t copy_stream_ = nullptr;
+    std::vector<Block> device_;
+    std::vector<Block> host_;
+    std::vector<cudaEvent_t> timing_events_;
+    std::multimap<size_t, void*> thrust_free_;  // cached blocks by size
+    std::map<void*, size_t> thrust_used_;
+    ThrustAllocator thrust_allocator_;
+    double init_seconds_ = 0.0;
+    uint64_t num_allocations_ = 0;
+    size_t device_bytes_reserved_ = 0;
+};
+
+// Times the phases of one engine call into the thread's phase recorder with
+// events on the compute stream, so the GPU time of asynchronous work lands
+// in the phase that queued it. Does nothing without a recorder.
+class CudaPhaseTimer {
+public:
+    explicit CudaPhaseTimer(CudaContext& context);
+    ~CudaPhaseTimer() { finish(); }
+    CudaPhaseTimer(const CudaPhaseTimer&) = delete;
+    CudaPhaseTimer& operator=(const CudaPhaseTimer&) = delete;
+
+    // Ends the running phase and starts `phase` at this point of the stream
+    void mark(Phase phase);
+    // Ends the running phase, waits for its event and records the times
+    void finish();
+
+private:
+    CudaContext& context_;
+    PhaseTimes* times_;
+    std::vector<Phase> phases_;  // phases_[i] runs from event i to event i + 1
+};
+
+// Downloads the per-thread work a kernel wrote (one value per thread, in
+// launch order) through host buffer `slot` and adds it to stats.warp_work
+bool record_lane_work(CudaContext& context, size_t slot, const uint32_t* lane_work, size_t num_lanes,
+                      EngineStats& stats);
+
+} // namespace aabb
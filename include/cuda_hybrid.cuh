@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "engine_select.h"
+#include "pair_sink.h"
+#include "sweep_axis.h"
+
+// Throughput of each side of a hybrid call in boxes per second, smoothed over
+// the calls that share it. The split of the next call follows it, so repeated
+// calls on one object converge to the split that finishes both sides together.
+struct HybridThroughput {
+    double cpu_boxes_per_second = 0.0;  // 0: not measured yet
+    double gpu_boxes_per_second = 0.0;
+
+    // Fraction of the boxes the GPU should get (`prior` before any measurement)
+    double gpu_share(double prior) const {
+        if (cpu_boxes_per_second <= 0.0 || gpu_boxes_per_second <= 0.0) return prior;
+        return gpu_boxes_per_second / (cpu_boxes_per_second + gpu_boxes_per_second);
+    }
+
+    // Folds in one call's rates, half weight to the history
+    void update(double cpu, double gpu) {
+        cpu_boxes_per_second = cpu_boxes_per_second > 0.0 ? 0.5 * (cpu_boxes_per_second + cpu) : cpu;
+        gpu_boxes_per_second = gpu_boxes_per_second > 0.0 ? 0.5 * (gpu_boxes_per_second + gpu) : gpu;
+    }
+};
+
+// What one hybrid call did
+struct HybridReport {
+    bool gpu_used = false;  // false: the scene was small or no GPU was found
+    aabb::SweepAxis axis = aabb::SweepAxis::X;  // axis of the split (x or y)
+    float split = 0.0f;     // the CPU owns pair reference points below it, the GPU the rest
+    double gpu_share = 0.0; // planned fraction of the slabs given to the GPU
+    size_t cpu_boxes = 0;
+    size_t gpu_boxes = 0;   // halo included
+    size_t halo = 0;        // boxes sent to both sides
+    size_t cpu_pairs = 0;
+    size_t gpu_pairs = 0;   // owned pairs the GPU reported
+    double cpu_seconds = 0.0;
+    double gpu_seconds = 0.0;  // upload, detection and download, context creation excluded
+};
+
+struct HybridOptions {
+    // Engine of both sides: SS_MT and CUDA SS, or SH_MT and CUDA SH
+    aabb::EngineKind engine = aabb::EngineKind::SpatialHashing;
+    // Axis of the split: X, Y, or Auto as partition_slabs picks it (PCA is
+    // treated as Auto)
+    aabb::SweepAxis axis = aabb::SweepAxis::Auto;
+    // CPU worker threads (0 = hardware threads less the one driving the GPU)
+    unsigned threads = 0;
+    // Below this many boxes the whole scene stays on the CPU
+    size_t min_gpu_boxes = aabb::kGpuMinBoxes;
+    // Quantile slabs the split is chosen among; both sides get at least one
+    size_t slabs = 64;
+    // If set, rates measured by earlier calls pick the split and are updated
+    HybridThroughput* throughput = nullptr;
+    // Order of the vector-returning cuda_hybrid
+    aabb::PairOrder order = aabb::PairOrder::Sorted;
+    HybridReport* report = nullptr;
+};
+
+// CPU+GPU co-scheduled broad phase. The scene is cut once along an axis at a
+// quantile of the box minima (aabb::partition_slabs): the CPU thread pool runs
+// the low side while a host thread runs the high side, halo included, on the
+// GPU, in proportion to the measured throughput of each. Pairs are owned as
+// in include/slab_partition.h, so each is reported once. Scenes below
+// options.min_gpu_boxes, or without a GPU, run on the CPU only.
+void cuda_hybrid(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const HybridOptions& options);
+
+// Returns unique pairs (i < j), sorted unless options.order is Engine
+std::vector<std::pair<uint32_t, uint32_t>> cuda_hybrid(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const HybridOptions& options);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
+#include "sweep_axis.h"
+
+// Engine each slab of a multi-GPU call runs
+enum class MultiGpuEngine {
+    SortAndSweep,
+    SpatialHashing,
+};
+
+// What one slab of a multi-GPU call did
+struct MultiGpuSlab {
+    int device = 0;
+    aabb::SweepAxis axis = aabb::SweepAxis::X;  // axis the slabs cut (x or y)
+    float begin = 0.0f;     // owned range [begin, end) of the pair reference point
+    float end = 0.0f;
+    size_t boxes = 0;       // boxes sent to the device, halo included
+    size_t halo = 0;        // of those, boxes whose min lies in another slab
+    size_t candidates = 0;  // pairs the device found
+    size_t pairs = 0;       // pairs the slab owns and reported
+    double seconds = 0.0;   // wall time of the slab on its host thread
+};
+
+struct MultiGpuOptions {
+    MultiGpuEngine engine = MultiGpuEngine::SpatialHashing;
+    // Axis the slabs cut: X, Y, or Auto for the one with fewer sampled halo
+    // copies (PCA is treated as Auto)
+    aabb::SweepAxis axis = aabb::SweepAxis::Auto;
+    // GPUs to use (0 = all visible)
+    int devices = 0;
+    // Slabs (0 = one per device). More slabs than devices shrink the device
+    // memory of each call; slab s runs on device s % devices.
+    size_t slabs = 0;
+    // Order of the vector-returning cuda_multi_gpu
+    aabb::PairOrder order = aabb::PairOrder::Sorted;
+    // If set, receives one entry per slab
+    std::vector<MultiGpuSlab>* report = nullptr;
+};
+
+// Partitioned broad phase for scenes that exceed one device. The scene is cut
+// into slabs by aabb::partition_slabs (include/slab_partition.h); each slab,
+// halo included, runs on one device and keeps the pairs it owns, so every
+// pair is reported once. One host thread per device runs its slabs, and the
+// pairs are gathered on the host in slab order.
+void cuda_multi_gpu(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const MultiGpuOptions& options);
+
+// Returns unique pairs (i < j), sorted unless options.order is Engine
+std::vector<std::pair<uint32_t, uint32_t>> cuda_multi_gpu(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const MultiGpuOptions& options);
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <cuda_runtime.h>
+
+#include "cuda_context.cuh"
+#include "pair_sink.h"
+
+namespace aabb {
+
+// Device layout of a pair (i, j), the same as aabb::Pair, so a downloaded
+// chunk goes to the sink without repacking
+using DevicePair = uint2;
+
+constexpr uint32_t kWarpSize = 32;
+
+// Pair output of a single-pass kernel. count is the number of pairs found;
+// pairs past capacity are counted but not written, and the host reruns.
+struct PairOutput {
+    DevicePair* pairs;
+    unsigned long long* count;
+    uint64_t capacity;
+};
+
+__device__ inline void write_pair(const PairOutput& out, uint64_t pos, uint32_t i, uint32_t j) {
+    if (pos >= out.capacity) return;
+    out.pairs[pos] = make_uint2(min(i, j), max(i, j));
+}
+
+// Warp-collective: every lane of the warp calls it, the hits are compacted by
+// ballot and reserved with one atomic per warp
+__device__ inline void warp_emit(bool hit, uint32_t i, uint32_t j, const PairOutput& out) {
+    const unsigned mask = __ballot_sync(0xFFFFFFFFu, hit);
+    if (mask == 0) return;
+    const unsigned lane = threadIdx.x % kWarpSize;
+    unsigned long long base = 0;
+    if (lane == 0) base = atomicAdd(out.count, (unsigned long long)__popc(mask));
+    base = __shfl_sync(0xFFFFFFFFu, base, 0);
+    if (hit) write_pair(out, base + __popc(mask & ((1u << lane) - 1)), i, j);
+}
+
+// Runs a single-pass pair kernel: launch(out) queues it on the context's
+// stream, writing into device buffer pairs_slot as large as the last call
+// left it (at least min_capacity) and counting into count_slot. If the pairs
+// do not fit, they were still counted: the buffer grows to that count and
+// launch runs again, which a warm context rarely needs. On return out holds
+// the pairs and total their count; false on a CUDA error, reported under tag.
+template <typename Launch>
+bool run_single_pass(CudaContext& context, size_t pairs_slot, size_t count_slot, uint64_t min_capacity,
+                     const char* tag, Launch&& launch, PairOutput& out, uint64_t& total) {
+    cudaStream_t stream = context.stream();
+    unsigned long long* d_count = context.device<unsigned long long>(count_slot, 1);
+    unsigned long long* h_count = context.host<unsigned long long>(count_slot, 1);
+    if (!d_count || !h_count) return false;
+    uint64_t capacity = std::max<uint64_t>(context.device_capacity<DevicePair>(pairs_slot), min_capacity);
+    for (;;) {
+        out.pairs = context.device<DevicePair>(pairs_slot, capacity);
+        if (!out.pairs) return false;
+        out.count = d_count;
+        out.capacity = context.device_capacity<DevicePair>(pairs_slot);
+
+        cudaMemsetAsync(d_count, 0, sizeof(unsigned long long), stream);
+        launch(static_cast<const PairOutput&>(out));
+        cudaMemcpyAsync(h_count, d_count, sizeof(unsigned long long), cudaMemcpyDeviceToHost, stream);
+        const cudaError_t err = cudaStreamSynchronize(stream);
+        if (err != cudaSuccess) {
+            std::cerr << "[" << tag << "] CUDA error: pair kernel : " << cudaGetErrorString(err) << "\n";
+            return false;
+        }
+        total = *h_count;
+        if (total <= out.capacity) return true;
+        std::cerr << "[" << tag << "] " << total << " pairs overflow capacity " << out.capacity
+                  << ", rerunning\n";
+        capacity = total;
+    }
+}
+
+// Downloads device pairs to a sink while the compute stream keeps running.
+// push() queues a range on the context's copy stream behind all work queued
+// on the compute stream so far; chunks go through two pinned staging
+// buffers, so the sink consumes one chunk while the next is in flight.
+class CudaPairStream {
+public:
+    static constexpr size_t kDefaultChunk = size_t(1) << 20;
+
+    // Uses host buffers host_slot and host_slot + 1 of the context for staging
+    CudaPairStream(CudaContext& context, PairSink& sink, size_t host_slot,
+                   size_t chunk = kDefaultChunk);
+    ~CudaPairStream();
+    CudaPairStream(const CudaPairStream&) = delete;
+    CudaPairStream& operator=(const CudaPairStream&) = delete;
+
+    // Queues pairs [begin, end) of the device array; may block while earlier
+    // chunks are handed to the sink. False once a copy has failed.
+    bool push(const DevicePair* pairs, uint64_t begin, uint64_t end);
+
+    // Hands every queued chunk to the sink, in push order
+    bool finish();
+
+    // Pairs handed to the sink so far
+    uint64_t num_pairs() const { return num_pairs_; }
+
+private:
+    bool drain(int buffer);
+
+    CudaContext& context_;
+    PairSink& sink_;
+    size_t chunk_;
+    cudaEvent_t ready_ = nullptr;
+    cudaEvent_t copied_[2] = {nullptr, nullptr};
+    Pair* staging_[2] = {nullptr, nullptr};
+    size_t pending_[2] = {0, 0};  // pairs in flight to each staging buffer
+    int next_ = 0;                // buffer of the next chunk, holding the older one
+    bool ok_ = true;
+    uint64_t num_pairs_ = 0;
+};
+
+} // namespace aabb
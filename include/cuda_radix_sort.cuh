@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cuda_context.cuh"
+
+namespace aabb {
+
+// Stable device radix sort (CUB DeviceRadixSort::SortPairs) of values by the
+// low `key_bits` bits of their 64-bit keys, on the context's stream. keys and
+// values hold the input and are pointed at the sorted arrays on return, which
+// are either the inputs or keys_alt / values_alt. The temporary storage is the
+// context's device buffer `temp_slot`. Returns false on a CUDA error.
+bool cuda_radix_sort_pairs(
+    CudaContext& context,
+    size_t temp_slot,
+    uint64_t*& keys,
+    uint64_t* keys_alt,
+    uint32_t*& values,
+    uint32_t* values_alt,
+    uint32_t count,
+    int key_bits);
+
+} // namespace aabb
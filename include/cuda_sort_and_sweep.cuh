@@ -5,8 +5,46 @@
 #include <vector>
 
 #include "aabb_io.h"
+#include "box_span.h"
+#include "cuda_context.cuh"
+#include "pair_sink.h"
+#include "sweep_axis.h"
 
-// CUDA accelerated sort-and-sweep (returns sorted pairs i<j)
+struct CudaSortAndSweepOptions {
+    aabb::SweepAxis axis = aabb::SweepAxis::Auto;
+    // If set, receives the resolved axis and its candidate estimates
+    aabb::AxisEstimate* report = nullptr;
+    // Order of the vector-returning cuda_sort_and_sweep
+    aabb::PairOrder order = aabb::PairOrder::Sorted;
+};
+
+// CUDA accelerated sort-and-sweep (returns unique pairs i<j, sorted unless
+// options.order is Engine)
 std::vector<std::pair<uint32_t, uint32_t>> cuda_sort_and_sweep(
     const uint32_t N,
-    const std::vector<aabb::AABB>& boxes);
+    aabb::BoxSpan boxes);
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const CudaSortAndSweepOptions& options);
+
+// Streaming variant: emits each pair (i < j) once, in device output order
+void cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink);
+
+void cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSortAndSweepOptions& options);
+
+// Same on an explicit context, whose buffers are reused across calls
+void cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSortAndSweepOptions& options,
+    aabb::CudaContext& context);
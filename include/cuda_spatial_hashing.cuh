@@ -5,8 +5,52 @@
 #include <vector>
 
 #include "aabb_io.h"
+#include "box_span.h"
+#include "cuda_context.cuh"
+#include "pair_sink.h"
+#include "quantized_boxes.h"
+
+struct CudaSpatialHashingOptions {
+    // Stage the same-level tiles of the pair kernel as int16 coordinates
+    // relative to the cell (quantized_boxes.h), 8 bytes per box instead of the
+    // 20 of a float box and its id, and re-check the hits on the floats
+    bool quantized = false;
+    // If set, receives the footprint and false positives of the quantized tests
+    aabb::QuantizationStats* quant_report = nullptr;
+};
+
+// CUDA accelerated spatial hashing (returns pairs i<j in device output order)
+std::vector<std::pair<uint32_t, uint32_t>> cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes);
+
+// Streaming variant: emits each pair (i < j) once, in device output order
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink);
+
+// Same on an explicit context, whose buffers are reused across calls
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    aabb::CudaContext& context);
 
-// CUDA accelerated spatial hashing (returns sorted pairs i<j)
 std::vector<std::pair<uint32_t, uint32_t>> cuda_spatial_hashing(
     const uint32_t N,
-    const std::vector<aabb::AABB>& boxes);
+    aabb::BoxSpan boxes,
+    const CudaSpatialHashingOptions& options);
+
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSpatialHashingOptions& options);
+
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSpatialHashingOptions& options,
+    aabb::CudaContext& context);
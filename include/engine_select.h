@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "sweep_axis.h"
+
+namespace aabb {
+
+// Sampled statistics of a scene, the inputs of the AUTO engine choice. One
+// pass over all boxes finds the largest extent; the rest is estimated on a
+// strided sample, so measuring costs far less than any engine run.
+struct SceneStats {
+    size_t boxes = 0;
+    size_t sample_size = 0;
+    AxisEstimate axis;           // sweep axis (x or y) and its candidate estimates
+    int cell_size = 1;           // finest grid cell, as choose_grid_levels sizes it
+    double sweep_per_box = 0.0;  // projection overlaps on the sweep axis per box
+    double grid_per_box = 0.0;   // pairs sharing a 3x3 cell neighborhood per box
+    double occupancy = 1.0;      // boxes per occupied finest cell
+    double size_skew = 1.0;      // largest box extent over the finest cell size
+};
+
+SceneStats measure_scene(BoxSpan boxes, size_t sample = 4096);
+
+enum class EngineKind { SortAndSweep, SpatialHashing };
+
+struct EngineChoice {
+    EngineKind kind = EngineKind::SortAndSweep;
+    bool gpu = false;
+    double ss_ns_per_box = 0.0;  // predicted CPU cost of each candidate
+    double sh_ns_per_box = 0.0;
+};
+
+// Boxes from which a GPU engine beats the CPU ones: below it the context,
+// the uploads and the launches cost more than the CPU detection itself
+constexpr size_t kGpuMinBoxes = size_t(1) << 16;
+
+// Picks SS or SH, and the GPU if one is available and the scene is large
+// enough, from the cost model calibrated with bin/bench
+EngineChoice choose_engine(const SceneStats &stats, bool gpu_available);
+
+// Engine name of a choice as bin/bench lists it (SS_MT, SH_MT, CUDA_SS, CUDA_SH)
+const char *engine_name(const EngineChoice &choice);
+
+// One-line summary of the stats and the choice, for the AUTO log line
+std::string describe_choice(const SceneStats &stats, const EngineChoice &choice);
+
+} // namespace aabb
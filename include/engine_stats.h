@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace aabb {
+
+// Opt-in statistics of the detection engines, compiled in with -DAABB_STATS
+// (make STATS=1). Without it stats_recorder() is a constant nullptr, so every
+// `if (stats)` in the engines folds away; with it an engine records into the
+// calling thread's EngineStats while one is installed (bin/bench --stats).
+#ifdef AABB_STATS
+constexpr bool kStatsEnabled = true;
+#else
+constexpr bool kStatsEnabled = false;
+#endif
+
+// Histogram over power-of-two buckets: bucket 0 counts zeros, bucket k the
+// values in [2^(k-1), 2^k)
+struct Log2Histogram {
+    static constexpr size_t kBuckets = 65;
+
+    uint64_t buckets[kBuckets] = {};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void add(uint64_t v) {
+        ++buckets[v ? 64 - __builtin_clzll(v) : 0];
+        ++count;
+        sum += v;
+        if (v > max) max = v;
+    }
+    void merge(const Log2Histogram &other);
+    double mean() const { return count ? double(sum) / double(count) : 0.0; }
+};
+
+// Work of the lanes of GPU warps. Imbalance is the slowest lane's work over
+// the mean lane work, averaged by work: 1 when all lanes of a warp do the
+// same, 32 when one lane does everything.
+struct WarpWork {
+    uint64_t warps = 0;
+    uint64_t work = 0;      // sum over all lanes
+    uint64_t max_work = 0;  // sum over warps of their slowest lane
+
+    // Lane work in launch order, 32 lanes per warp
+    void add_lanes(const uint32_t *lane_work, size_t num_lanes);
+    void merge(const WarpWork &other);
+    double imbalance() const { return work ? 32.0 * double(max_work) / double(work) : 0.0; }
+};
+
+struct EngineStats {
+    uint64_t pairs_tested = 0;     // candidate pairs given an overlap test
+    uint64_t pairs_hit = 0;        // candidates that overlapped
+    Log2Histogram active_set;      // SS: open boxes each start point is tested against
+    Log2Histogram cell_occupancy;  // SH: boxes per occupied cell (max = largest bucket)
+    WarpWork warp_work;            // CUDA: lane work of the pair kernels
+
+    // Adds the stats of a worker thread
+    void merge(const EngineStats &other);
+};
+
+#ifdef AABB_STATS
+EngineStats *stats_recorder();
+void set_stats_recorder(EngineStats *stats);
+#else
+inline EngineStats *stats_recorder() { return nullptr; }
+inline void set_stats_recorder(EngineStats *) {}
+#endif
+
+} // namespace aabb
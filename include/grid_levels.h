@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+
+namespace aabb {
+
+// Most levels a hierarchical grid uses (cell sizes double per level)
+constexpr int kMaxGridLevels = 32;
+
+// Share of boxes the finest level is sized for; the rest go to coarser levels
+constexpr double kGridLevelPercentile = 0.9;
+
+// Cell sizes of the occupied levels of a hierarchical grid, ascending. The
+// finest is the kGridLevelPercentile quantile of the box size (>= 1), the
+// others double it and the last fits the largest box; levels no box lands on
+// are dropped. If the largest box is within twice the finest size, the result
+// is the single level of the old max-extent grid.
+std::vector<int> choose_grid_levels(BoxSpan boxes);
+
+// Largest side of a box
+inline float box_extent(const AABB &b) {
+    return std::max(b.max_x - b.min_x, b.max_y - b.min_y);
+}
+
+// Index of the finest level whose cell size holds a box of this extent. A box
+// of a finer level that overlaps a box B has its center inside B grown by half
+// the finer cell size, so querying that window per finer level finds every pair.
+inline int grid_level_of(float extent, const std::vector<int> &cell_sizes) {
+    const int n = static_cast<int>(cell_sizes.size());
+    for (int l = 0; l + 1 < n; ++l) {
+        if (extent <= static_cast<float>(cell_sizes[l])) return l;
+    }
+    return n - 1;
+}
+
+} // namespace aabb
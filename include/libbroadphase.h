@@ -0,0 +1,20 @@
+#pragma once
+
+// Public header of libbroadphase (make lib): the CPU engines on non-owning
+// box spans, the pair sinks they emit into, the incremental broad phases, the
+// AUTO engine choice and the slab partition of the distributed drivers. Link
+// bin/libbroadphase.a or bin/libbroadphase.so with -pthread.
+
+#include "box_span.h"
+#include "pair_sink.h"
+
+#include "seq_bruteforce.h"
+#include "seq_bvh.h"
+#include "seq_external_sweep.h"
+#include "seq_sort_and_sweep.h"
+#include "seq_sort_and_sweep_mt.h"
+#include "seq_spatial_hashing.h"
+
+#include "broad_phase.h"
+#include "engine_select.h"
+#include "slab_partition.h"
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace aabb {
+
+// A detected pair holds the two boxes' AABB::id values, never their positions
+// in the input, so every engine reports the same pairs for the same boxes
+using Pair = std::pair<uint32_t, uint32_t>;
+
+// Order of the pairs a vector-returning engine call gives back. Every engine
+// emits each pair exactly once, so Engine order skips the post-pass entirely.
+enum class PairOrder {
+    Sorted,  // ascending (i, j), ordered by aabb::sort_pairs (radix_sort.h)
+    Engine,  // emission order of the engine
+};
+
+// Streaming consumer of detected pairs. Engines hand over pairs in chunks
+// (i < j within each pair, no duplicates across chunks); a chunk is only
+// valid for the duration of the call.
+class PairSink {
+public:
+    virtual ~PairSink() = default;
+    virtual void on_pairs(const Pair *pairs, size_t count) = 0;
+};
+
+// Materializes every pair (backs the vector-returning engine API)
+class VectorPairSink : public PairSink {
+public:
+    explicit VectorPairSink(std::vector<Pair> &out) : out_(out) {}
+    void on_pairs(const Pair *pairs, size_t count) override {
+        out_.insert(out_.end(), pairs, pairs + count);
+    }
+
+private:
+    std::vector<Pair> &out_;
+};
+
+// Fills a caller-owned array of `capacity` pairs. Pairs beyond it are
+// counted but dropped, so after an overflow the caller can size the array
+// to count() and run again.
+class BufferPairSink : public PairSink {
+public:
+    BufferPairSink(Pair *buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+    void on_pairs(const Pair *pairs, size_t count) override {
+        if (count_ < capacity_) {
+            const size_t n = std::min(count, capacity_ - count_);
+            std::copy(pairs, pairs + n, buffer_ + count_);
+        }
+        count_ += count;
+    }
+    // Pairs the engine produced; min(count(), capacity) of them were stored
+    size_t count() const { return count_; }
+    size_t stored() const { return std::min(count_, capacity_); }
+    bool overflowed() const { return count_ > capacity_; }
+
+private:
+    Pair *buffer_;
+    size_t capacity_;
+    size_t count_ = 0;
+};
+
+// Forwards chunks to a callable
+class CallbackPairSink : public PairSink {
+public:
+    using Callback = std::function<void(const Pair *, size_t)>;
+    explicit CallbackPairSink(Callback fn) : fn_(std::move(fn)) {}
+    void on_pairs(const Pair *pairs, size_t count) override { fn_(pairs, count); }
+
+private:
+    Callback fn_;
+};
+
+// Counts pairs without storing them
+class CountingPairSink : public PairSink {
+public:
+    void on_pairs(const Pair *, size_t count) override { count_ += count; }
+    uint64_t count() const { return count_; }
+
+private:
+    uint64_t count_ = 0;
+};
+
+// Engine-side batching: collects single pairs and passes them to the sink
+// in fixed-size chunks, so peak memory is one chunk rather than all pairs.
+class PairEmitter {
+public:
+    static constexpr size_t kDefaultChunk = 4096;
+
+    explicit PairEmitter(PairSink &sink, size_t chunk = kDefaultChunk)
+        : sink_(sink), buf_(chunk) {}
+    ~PairEmitter() { flush(); }
+    PairEmitter(const PairEmitter &) = delete;
+    PairEmitter &operator=(const PairEmitter &) = delete;
+
+    void emit(uint32_t a, uint32_t b) {
+        buf_[len_++] = Pair(a, b);
+        if (len_ == buf_.size()) flush();
+    }
+
+    void flush() {
+        if (len_ == 0) return;
+        sink_.on_pairs(buf_.data(), len_);
+        len_ = 0;
+    }
+
+private:
+    PairSink &sink_;
+    std::vector<Pair> buf_;
+    size_t len_ = 0;
+};
+
+} // namespace aabb
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace aabb {
+
+// Hardware counters of the calling thread and the threads it starts while
+// counting (Linux perf_event). Counters the kernel refuses, for example under
+// a restrictive perf_event_paranoid or in a VM, are reported as unavailable.
+class PerfCounters {
+public:
+    enum Counter { kInstructions, kCacheMisses, kBranchMisses, kNumCounters };
+
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Opens the counters; false (with err) if none of them is available
+    bool open(std::string &err);
+
+    void start();
+    void stop();
+
+    bool available(Counter c) const { return fds_[c] >= 0; }
+    // Events counted between the last start() and stop()
+    uint64_t value(Counter c) const { return values_[c]; }
+
+    static const char *name(Counter c);
+
+private:
+    int fds_[kNumCounters] = {-1, -1, -1};
+    uint64_t values_[kNumCounters] = {};
+};
+
+} // namespace aabb
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace aabb {
+
+// Phases of a detection run, as reported by bin/bench
+enum class Phase {
+    Load,     // reading the input (bench only)
+    Build,    // projection, grid or tree construction
+    Sort,     // endpoint, cell key or Morton code sorts
+    Sweep,    // candidate tests (the counting pass on the GPU)
+    Scatter,  // GPU pair scatter and download
+    Dedupe,   // ordering the pair list of the vector API
+    Write,    // writing the output file (bench only)
+};
+constexpr size_t kNumPhases = 7;
+
+const char *phase_name(Phase phase);
+
+// Seconds spent per phase, accumulated over the scopes that ran
+struct PhaseTimes {
+    double seconds[kNumPhases] = {};
+    bool seen[kNumPhases] = {};
+
+    void add(Phase phase, double s) {
+        seconds[static_cast<size_t>(phase)] += s;
+        seen[static_cast<size_t>(phase)] = true;
+    }
+};
+
+// Recorder of the calling thread (nullptr when none); engines only time
+// their phases while one is installed
+PhaseTimes *phase_recorder();
+void set_phase_recorder(PhaseTimes *times);
+
+// Times its scope as `phase` into the thread's recorder. Scopes nest: an
+// inner phase pauses the outer one, so every phase gets exclusive time.
+// Without a recorder this is one thread-local read.
+class ScopedPhase {
+public:
+    explicit ScopedPhase(Phase phase);
+    ~ScopedPhase();
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    PhaseTimes *times_;
+    Phase phase_;
+    ScopedPhase *parent_ = nullptr;
+    Clock::time_point start_;
+};
+
+} // namespace aabb
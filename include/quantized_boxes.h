@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "box_soa.h"
+
+namespace aabb {
+
+// Quantized box columns: int16 coordinates in steps of a frame (a grid cell,
+// or the world range of one axis), rounded outward so that two boxes whose
+// floats overlap always overlap quantized. Engines test the int16 columns and
+// re-check the hits on the floats, so the output is unchanged.
+
+// Steps per cell of a cell frame. A box sits in the cell of its center and is
+// no larger than the cell, so it spans [-S/2, 3S/2] steps from the cell
+// origin, [-8192, 24576], and the frame of a neighbor cell is an exact shift
+// of S steps.
+constexpr int32_t kQuantStepsPerCell = 16384;
+
+// Steps a world frame spreads one axis over, centered on 0
+constexpr double kQuantWorldSteps = 65000.0;
+
+// (v - origin) * scale rounded down (lo) or up (hi), widened by one step
+// that absorbs the rounding difference between shifted frames. Callers pick
+// frames that keep their boxes inside int16; the clamp is only a guard.
+inline int16_t quantize_lo(float v, double origin, double scale) {
+    const double q = std::floor((static_cast<double>(v) - origin) * scale) - 1.0;
+    return static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, q)));
+}
+
+inline int16_t quantize_hi(float v, double origin, double scale) {
+    const double q = std::ceil((static_cast<double>(v) - origin) * scale) + 1.0;
+    return static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, q)));
+}
+
+// Origin and scale of a world frame over [lo, hi]
+inline void world_quant_frame(float lo, float hi, double &origin, double &scale) {
+    origin = 0.5 * (static_cast<double>(lo) + static_cast<double>(hi));
+    const double range = static_cast<double>(hi) - static_cast<double>(lo);
+    scale = range > 0.0 ? kQuantWorldSteps / range : 1.0;
+}
+
+// Quantized twin of BoxSoA's coordinate columns (8 bytes per box instead of
+// 16); slot k quantizes slot k of the float columns
+struct QuantizedSoA {
+    AlignedVector<int16_t> min_x;
+    AlignedVector<int16_t> min_y;
+    AlignedVector<int16_t> max_x;
+    AlignedVector<int16_t> max_y;
+
+    size_t size() const { return min_x.size(); }
+
+    void resize(size_t n) {
+        min_x.resize(n);
+        min_y.resize(n);
+        max_x.resize(n);
+        max_y.resize(n);
+    }
+
+    // Slot k of `boxes` in the frame with origin (ox, oy), `scale` steps per unit
+    void set(size_t slot, const BoxSoA &boxes, size_t k, double ox, double oy, double scale) {
+        min_x[slot] = quantize_lo(boxes.min_x[k], ox, scale);
+        min_y[slot] = quantize_lo(boxes.min_y[k], oy, scale);
+        max_x[slot] = quantize_hi(boxes.max_x[k], ox, scale);
+        max_y[slot] = quantize_hi(boxes.max_y[k], oy, scale);
+    }
+
+    size_t bytes() const { return 4 * size() * sizeof(int16_t); }
+};
+
+// What a quantized run did: the footprint of the columns it tested and how
+// many of its quantized hits the float re-check rejected
+struct QuantizationStats {
+    uint64_t boxes = 0;            // boxes given quantized columns
+    uint64_t float_bytes = 0;      // float coordinate bytes those columns replace
+    uint64_t quantized_bytes = 0;  // bytes of the quantized columns
+    uint64_t candidates = 0;       // quantized hits, re-checked on the floats
+    uint64_t false_positives = 0;  // candidates the re-check rejected
+
+    double false_positive_rate() const {
+        return candidates ? static_cast<double>(false_positives) / static_cast<double>(candidates) : 0.0;
+    }
+
+    void merge(const QuantizationStats &other) {
+        boxes += other.boxes;
+        float_bytes += other.float_bytes;
+        quantized_bytes += other.quantized_bytes;
+        candidates += other.candidates;
+        false_positives += other.false_positives;
+    }
+};
+
+} // namespace aabb
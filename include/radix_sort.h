@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "pair_sink.h"
+
+namespace aabb {
+
+class ThreadPool;
+
+// Order-preserving map of a float to uint32_t (negative values flipped entirely,
+// positive values get the sign bit set), so integer order equals float order
+inline uint32_t float_radix_key(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// Double buffers of a radix sort, kept by callers that sort repeatedly
+template <typename Key>
+struct RadixScratch {
+    std::vector<Key> keys;
+    std::vector<uint32_t> values;
+};
+
+// Stable LSD radix sort of values by keys (both resized to the same length).
+// Runs the histogram and scatter of every pass on `pool` when given. Passes
+// swap `keys` and `values` with the scratch buffers (local ones if null).
+void radix_sort_pairs(
+    std::vector<uint32_t> &keys,
+    std::vector<uint32_t> &values,
+    ThreadPool *pool = nullptr,
+    RadixScratch<uint32_t> *scratch = nullptr);
+
+// Same for 64-bit keys; passes over digits that are equal in all keys are skipped
+void radix_sort_pairs(
+    std::vector<uint64_t> &keys,
+    std::vector<uint32_t> &values,
+    ThreadPool *pool = nullptr,
+    RadixScratch<uint64_t> *scratch = nullptr);
+
+// Sorts pairs ascending by (first, second) with two stable counting passes,
+// by second and then by first, over one bucket per id: O(P + max id) instead
+// of O(P log P). Uses std::sort when the ids are sparse compared to the pairs.
+void sort_pairs(std::vector<Pair> &pairs);
+
+} // namespace aabb
@@ -5,8 +5,16 @@
 #include <vector>
 
 #include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
 
 // Brute force intersection of all AABB pairs (returns sorted pairs i<j)
 std::vector<std::pair<uint32_t, uint32_t>> brute_force(
     const uint32_t N,
-    const std::vector<aabb::AABB> boxes);
+    aabb::BoxSpan boxes);
+
+// Streaming variant: emits pairs i<j into `sink` in ascending order
+void brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
+
+// Bounding-volume hierarchy broad-phase: LBVH over 30-bit Morton codes of the
+// box centers, pairs found by one ordered query per box (returns unique pairs
+// i<j, sorted unless `order` is Engine)
+std::vector<std::pair<uint32_t, uint32_t>> bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairOrder order = aabb::PairOrder::Sorted);
+
+// Streaming variant: emits each pair (i < j) once, in Morton order of the first box
+void bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink);
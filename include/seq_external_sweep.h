@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "pair_sink.h"
+#include "sweep_axis.h"
+
+// What an external sort-and-sweep run did
+struct ExternalSweepReport {
+    aabb::SweepAxis axis = aabb::SweepAxis::X;
+    uint64_t boxes = 0;
+    size_t runs = 0;             // sorted runs spilled to disk (0: the input fit one chunk)
+    uint64_t spilled_bytes = 0;
+    size_t peak_active = 0;      // most boxes open at once during the sweep
+    size_t peak_memory_bytes = 0;  // largest footprint of the chunk, merge and active-set buffers
+};
+
+struct ExternalSweepOptions {
+    // Boxes sorted in memory per run; with the sort scratch a chunk costs
+    // about 56 bytes per box
+    size_t chunk_boxes = size_t(1) << 22;
+    // Directory of the run files (empty: $TMPDIR, else /tmp). The files are
+    // unlinked as soon as they are created, so nothing is left behind.
+    std::string temp_dir;
+    // X, Y, or Auto estimated on the first chunk (PCA is not supported)
+    aabb::SweepAxis axis = aabb::SweepAxis::Auto;
+    ExternalSweepReport *report = nullptr;
+};
+
+// Out-of-core sort-and-sweep over a binary box file (.bin, either layout) of
+// any size. The file is read in chunks that are sorted by their sweep-axis
+// minimum and spilled as runs; a k-way merge of the runs then feeds a sweep
+// that only holds the open boxes. Memory is bounded by the chunk, the merge
+// buffers and the active set, not by the box count. Emits each pair (i < j)
+// once, in sweep order. Returns false with `err` set on an I/O error.
+bool external_sort_and_sweep(
+    const std::string &path,
+    aabb::PairSink &sink,
+    const ExternalSweepOptions &options,
+    std::string &err);
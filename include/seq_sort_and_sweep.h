@@ -1,13 +1,86 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
+#include "quantized_boxes.h"
+#include "sweep_axis.h"
+
+// Active-set structure used by the sweep
+enum class ActiveSetKind {
+    Ordered,     // insertion order, O(k) erase per end point (original behaviour)
+    SwapRemove,  // dense arrays + per-box position map, O(1) swap-remove
+};
+
+// Scratch of the sort-and-sweep engines kept across calls. Its buffers only
+// grow and SS_MT keeps its thread pool, so a warm call on no more boxes than
+// before allocates only pair chunks. One workspace serves one call at a time.
+class SortAndSweepWorkspace {
+public:
+    SortAndSweepWorkspace() = default;
+    SortAndSweepWorkspace(const SortAndSweepWorkspace &) = delete;
+    SortAndSweepWorkspace &operator=(const SortAndSweepWorkspace &) = delete;
+
+    struct Sweep;  // sort_and_sweep buffers (seq_sort_and_sweep.cpp)
+    struct Slabs;  // sort_and_sweep_mt buffers and pool (seq_sort_and_sweep_mt.cpp)
+    Sweep &sweep();
+    Slabs &slabs();
+
+private:
+    // Each part is created and deleted by the engine that defines it
+    template <typename T>
+    using Part = std::unique_ptr<T, void (*)(T *)>;
+    Part<Sweep> sweep_{nullptr, nullptr};
+    Part<Slabs> slabs_{nullptr, nullptr};
+};
+
+struct SortAndSweepOptions {
+    ActiveSetKind active_set = ActiveSetKind::SwapRemove;
+    aabb::SweepAxis axis = aabb::SweepAxis::Auto;
+    // If set, receives the resolved axis and its candidate estimates
+    aabb::AxisEstimate *report = nullptr;
+    // Worker threads of sort_and_sweep_mt (0 = hardware threads)
+    unsigned threads = 0;
+    // If set, scratch reused across calls instead of allocated per call
+    SortAndSweepWorkspace *workspace = nullptr;
+    // Order of the vector-returning sort_and_sweep (sort_and_sweep_mt always
+    // returns slab order)
+    aabb::PairOrder order = aabb::PairOrder::Sorted;
+    // sort_and_sweep_mt: scan the filter axis on int16 columns quantized over
+    // the world range (quantized_boxes.h) and re-check the hits on the floats
+    bool quantized = false;
+    // If set, receives the footprint and false positives of the quantized scan
+    aabb::QuantizationStats *quant_report = nullptr;
+};
+
+// Parse "ordered" or "swap"
+bool parse_active_set_kind(const std::string &name, ActiveSetKind &kind);
 
 // Public API: find all intersecting AABB pairs using sort-and-sweep on both axes
-// Returns a sorted unique list of pairs (i < j)
+// Returns a unique list of pairs (i < j), sorted unless options.order is Engine
 std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep(
     const uint32_t N,
-    const std::vector<aabb::AABB> boxes);
+    aabb::BoxSpan boxes);
+
+std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const SortAndSweepOptions &options);
+
+// Streaming variant: emits each pair (i < j) once, in sweep order
+void sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink);
+
+void sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    const SortAndSweepOptions &options);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
+#include "seq_sort_and_sweep.h"
+
+// Multithreaded sort-and-sweep: parallel radix sort of the start points, then
+// the sorted boxes are cut into slabs along the sweep axis and each thread
+// scans forward from the starts of the slabs it takes. Uses options.axis,
+// options.report, options.threads and options.quantized (the active set is
+// not used).
+// Returns pairs (i < j), unique, in slab order (not sorted).
+std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep_mt(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const SortAndSweepOptions &options);
+
+// Streaming variant: emits each pair (i < j) once, slab by slab
+void sort_and_sweep_mt(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    const SortAndSweepOptions &options);
@@ -1,11 +1,73 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "aabb_io.h"
+#include "box_span.h"
+#include "pair_sink.h"
+#include "quantized_boxes.h"
 
-// Spatial hashing broad-phase (returns sorted pairs i<j)
+// Spatial hashing broad-phase (returns unique pairs i<j, sorted unless
+// `order` is Engine)
 std::vector<std::pair<uint32_t, uint32_t>> spatial_hashing(
-    const std::vector<aabb::AABB> boxes);
+    aabb::BoxSpan boxes,
+    aabb::PairOrder order = aabb::PairOrder::Sorted);
+
+// Streaming variant: emits each pair (i < j) once, grouped by grid cell
+void spatial_hashing(
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink);
+
+// Scratch of spatial_hashing_mt kept across calls: its thread pool and the
+// per-worker and per-task buffers, so a frame loop does not start threads on
+// every call. One workspace serves one call at a time.
+class SpatialHashingWorkspace {
+public:
+    SpatialHashingWorkspace() = default;
+    SpatialHashingWorkspace(const SpatialHashingWorkspace &) = delete;
+    SpatialHashingWorkspace &operator=(const SpatialHashingWorkspace &) = delete;
+
+    struct Tasks;  // spatial_hashing_mt pool and buffers (seq_spatial_hashing.cpp)
+    Tasks &tasks();
+
+private:
+    std::unique_ptr<Tasks, void (*)(Tasks *)> tasks_{nullptr, nullptr};
+};
+
+struct SpatialHashingOptions {
+    // Worker threads of spatial_hashing_mt (0 = hardware threads)
+    unsigned threads = 0;
+    // If set, the pool and buffers are reused across calls instead of created per call
+    SpatialHashingWorkspace *workspace = nullptr;
+    // Test same-level pairs on int16 coordinates relative to each box's cell
+    // (quantized_boxes.h) and re-check the hits on the floats; pairs across
+    // levels stay on the floats
+    bool quantized = false;
+    // If set, receives the footprint and false positives of the quantized tests
+    aabb::QuantizationStats *quant_report = nullptr;
+};
+
+// Multithreaded variant: grid cells are split across a thread pool and each
+// cell owns the pairs with itself and its dx > 0 || (dx == 0 && dy > 0)
+// neighbors, so no dedupe is needed (threads: 0 = hardware threads).
+// Returns pairs (i < j), unique, in cell-task order (not sorted).
+std::vector<std::pair<uint32_t, uint32_t>> spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    unsigned threads);
+
+void spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    unsigned threads);
+
+std::vector<std::pair<uint32_t, uint32_t>> spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    const SpatialHashingOptions &options);
+
+void spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    const SpatialHashingOptions &options);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace aabb {
+namespace simd {
+
+// Instruction sets with a dedicated overlap kernel, narrowest first
+enum class Isa {
+    Scalar,
+    NEON,
+    AVX2,
+    AVX512,
+};
+
+// Widest ISA supported by this CPU (and compiled in)
+Isa detect_isa();
+// ISA used by the kernels below; defaults to detect_isa()
+Isa active_isa();
+// Force a narrower ISA (for benchmarking). Returns false if the CPU lacks it.
+bool set_isa(Isa isa);
+
+const char *isa_name(Isa isa);
+bool parse_isa(const std::string &name, Isa &isa);
+
+// Extra slots the kernels may write past the last hit: `out` needs room for
+// (end - begin) + kOutPadding entries.
+constexpr size_t kOutPadding = 16;
+
+// Writes every k in [begin, end) with lo[k] <= q_hi && hi[k] >= q_lo to `out`
+// (ascending) and returns how many were written.
+size_t overlap_1d(
+    const float *lo, const float *hi,
+    size_t begin, size_t end,
+    float q_lo, float q_hi,
+    uint32_t *out);
+
+// Same for boxes: every k in [begin, end) whose box overlaps the query box
+// (inclusive on all four sides).
+size_t overlap_2d(
+    const float *min_x, const float *min_y, const float *max_x, const float *max_y,
+    size_t begin, size_t end,
+    float q_min_x, float q_min_y, float q_max_x, float q_max_y,
+    uint32_t *out);
+
+// Same tests on int16 columns (the quantized boxes of quantized_boxes.h). The
+// query is int32 so a box shifted into a neighbor's frame may leave the int16
+// range; it is clamped to that range, which does not change the result.
+size_t overlap_1d_i16(
+    const int16_t *lo, const int16_t *hi,
+    size_t begin, size_t end,
+    int32_t q_lo, int32_t q_hi,
+    uint32_t *out);
+
+size_t overlap_2d_i16(
+    const int16_t *min_x, const int16_t *min_y, const int16_t *max_x, const int16_t *max_y,
+    size_t begin, size_t end,
+    int32_t q_min_x, int32_t q_min_y, int32_t q_max_x, int32_t q_max_y,
+    uint32_t *out);
+
+} // namespace simd
+} // namespace aabb
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+#include "sweep_axis.h"
+
+namespace aabb {
+
+// Boxes sampled to place slab boundaries and to pick the slab axis
+constexpr size_t kSlabSample = size_t(1) << 16;
+
+// Cut of the scene into slabs along x or y, the partition of the multi-GPU
+// and the MPI drivers. Slab s owns [bounds[s], bounds[s + 1]) with open ends.
+// A box goes to the slabs from first() through last(); all but the first hold
+// it as halo. A pair is owned by the slab holding max(min_a, min_b), the low
+// edge of its overlap on the axis: that point lies inside both boxes, so both
+// are in that slab, and every pair is reported by exactly one slab.
+struct SlabPartition {
+    SweepAxis axis = SweepAxis::X;  // X or Y
+    std::vector<float> bounds;      // size() + 1 entries, -inf and +inf at the ends
+
+    size_t size() const { return bounds.empty() ? 0 : bounds.size() - 1; }
+
+    float lo(const AABB &b) const { return axis == SweepAxis::Y ? b.min_y : b.min_x; }
+    float hi(const AABB &b) const { return axis == SweepAxis::Y ? b.max_y : b.max_x; }
+
+    // Slab whose range holds v
+    size_t slab_of(float v) const {
+        return std::upper_bound(bounds.begin() + 1, bounds.end() - 1, v) - (bounds.begin() + 1);
+    }
+    size_t first(const AABB &b) const { return slab_of(lo(b)); }
+    size_t last(const AABB &b) const { return slab_of(hi(b)); }
+
+    bool owns(size_t slab, const AABB &a, const AABB &b) const {
+        const float ref = std::max(lo(a), lo(b));
+        return ref >= bounds[slab] && ref < bounds[slab + 1];
+    }
+};
+
+// Slab boundaries at quantiles of the minima of a strided sample of at most
+// `sample` boxes, so every slab gets about as many boxes. Auto (and PCA) cut
+// the axis whose boundaries the sampled boxes straddle less often, i.e. the
+// one with fewer halo copies. Repeated minima can leave slabs empty.
+SlabPartition partition_slabs(
+    BoxSpan boxes,
+    size_t slabs,
+    SweepAxis axis,
+    size_t sample = kSlabSample);
+
+} // namespace aabb
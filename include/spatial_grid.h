@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "box_soa.h"
+#include "box_span.h"
+#include "engine_stats.h"
+#include "pair_sink.h"
+#include "quantized_boxes.h"
+
+namespace aabb {
+
+class ThreadPool;
+
+// Flat uniform grid of the spatial hashing engines: boxes keyed by the cell of
+// their center, radix-sorted by cell key and cut into buckets. The static
+// engines build one per level (seq_spatial_hashing.cpp); the incremental broad
+// phase rebuilds them every frame and re-tests only the cells that changed.
+
+struct CellCoord {
+    int x;
+    int y;
+    bool operator==(const CellCoord& other) const noexcept {
+        return x == other.x && y == other.y;
+    }
+};
+
+// Boxes of a cell occupy the contiguous slots [begin, begin + count) of the cell-ordered SoA
+struct Bucket {
+    uint32_t begin;
+    uint32_t count;
+};
+
+// Cell -> bucket lookup. Small worlds use a dense row-major array over the
+// occupied cell bounds; large or sparse ones an open-addressing table
+class CellIndex {
+public:
+    static constexpr uint32_t kEmpty = std::numeric_limits<uint32_t>::max();
+
+    // Dense when the bounding rectangle has at most this many cells per box
+    static constexpr uint64_t kDenseCellsPerBox = 4;
+    static constexpr uint64_t kDenseMinCells = uint64_t(1) << 16;
+
+    void init(int min_x, int min_y, int max_x, int max_y, size_t num_boxes) {
+        min_x_ = min_x;
+        min_y_ = min_y;
+        width_ = uint64_t(int64_t(max_x) - min_x + 1);
+        height_ = uint64_t(int64_t(max_y) - min_y + 1);
+        const uint64_t area = width_ * height_;
+        dense_ = width_ <= (uint64_t(1) << 32) && height_ <= (uint64_t(1) << 32) &&
+                 area <= std::max<uint64_t>(kDenseMinCells, kDenseCellsPerBox * num_boxes);
+        if (dense_) dense_slots_.assign(area, kEmpty);
+    }
+
+    bool dense() const { return dense_; }
+
+    // Sort key of a cell: the dense array slot, or the packed biased coordinates
+    uint64_t key(const CellCoord& c) const {
+        if (dense_) return uint64_t(int64_t(c.y) - min_y_) * width_ + uint64_t(int64_t(c.x) - min_x_);
+        return (uint64_t(uint32_t(c.x) ^ 0x80000000u) << 32) | uint64_t(uint32_t(c.y) ^ 0x80000000u);
+    }
+
+    // Called once per occupied cell, in key order
+    void insert(uint64_t key, uint32_t k) {
+        if (dense_) {
+            dense_slots_[key] = k;
+            return;
+        }
+        if (2 * (size_ + 1) > hash_keys_.size()) grow();
+        place(key, k);
+    }
+
+    // Bucket index of a cell, or kEmpty
+    uint32_t find(const CellCoord& c) const {
+        if (dense_) {
+            const int64_t x = int64_t(c.x) - min_x_;
+            const int64_t y = int64_t(c.y) - min_y_;
+            if (x < 0 || y < 0 || uint64_t(x) >= width_ || uint64_t(y) >= height_) return kEmpty;
+            return dense_slots_[uint64_t(y) * width_ + uint64_t(x)];
+        }
+        if (size_ == 0) return kEmpty;
+        const uint64_t k = key(c);
+        for (size_t slot = hash(k) & mask_;; slot = (slot + 1) & mask_) {
+            if (hash_values_[slot] == kEmpty) return kEmpty;
+            if (hash_keys_[slot] == k) return hash_values_[slot];
+        }
+    }
+
+private:
+    static size_t hash(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        return static_cast<size_t>(k);
+    }
+
+    void place(uint64_t key, uint32_t k) {
+        size_t slot = hash(key) & mask_;
+        while (hash_values_[slot] != kEmpty) slot = (slot + 1) & mask_;
+        hash_keys_[slot] = key;
+        hash_values_[slot] = k;
+        ++size_;
+    }
+
+    void grow() {
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> values;
+        keys.swap(hash_keys_);
+        values.swap(hash_values_);
+        const size_t capacity = std::max<size_t>(64, 2 * keys.size());
+        hash_keys_.assign(capacity, 0);
+        hash_values_.assign(capacity, kEmpty);
+        mask_ = capacity - 1;
+        size_ = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (values[i] != kEmpty) place(keys[i], values[i]);
+        }
+    }
+
+    bool dense_ = true;
+    int min_x_ = 0;
+    int min_y_ = 0;
+    uint64_t width_ = 0;
+    uint64_t height_ = 0;
+    std::vector<uint32_t> dense_slots_;
+    std::vector<uint64_t> hash_keys_;
+    std::vector<uint32_t> hash_values_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
+
+struct Grid {
+    BoxSoA boxes;                  // boxes in cell order
+    std::vector<uint32_t> order;   // span position of the box in each slot
+    std::vector<CellCoord> cells;  // occupied cells, in key order
+    std::vector<Bucket> buckets;   // bucket of cells[k]
+    CellIndex index;               // cell -> k
+    QuantizedSoA quantized;        // boxes in the frame of their cell, if requested
+};
+
+// One level of the hierarchical grid: the boxes that fit its cell size
+struct GridLevel {
+    int cell_size;
+    Grid grid;
+};
+
+// Cell holding a point
+inline CellCoord cell_of_point(float x, float y, int L) {
+    return CellCoord{
+        static_cast<int>(std::floor(x / L)),
+        static_cast<int>(std::floor(y / L))
+    };
+}
+
+// Cell of a box (by its center)
+inline CellCoord cell_of_box(const AABB& b, int L) {
+    return cell_of_point((b.min_x + b.max_x) * 0.5f, (b.min_y + b.max_y) * 0.5f, L);
+}
+
+// Neighbors a cell owns the pairs with: dx > 0 || (dx == 0 && dy > 0), so
+// every pair of adjacent cells is visited from exactly one side
+constexpr int kForwardCells[4][2] = {{0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+// Build the grid of cell size L: key every box by the cell of its center,
+// radix-sort the (cell_key, box_index) pairs and cut the sorted run into
+// buckets, so every bucket is a contiguous SoA range
+Grid build_grid(BoxSpan boxes, int L, ThreadPool* pool = nullptr);
+
+// Buckets of the occupied forward neighbors of cell k and their offsets;
+// returns how many were found
+size_t forward_buckets(const Grid& grid, size_t k, Bucket (&buckets)[4], CellCoord (&offsets)[4]);
+
+// Test slot a of `soa` against the slots [begin, end) of `other` with the SIMD
+// kernel, appending the hits to `out` as id pairs (i < j). `hits` is scratch.
+void test_range(
+    const BoxSoA& soa,
+    uint32_t a,
+    const BoxSoA& other,
+    uint32_t begin,
+    uint32_t end,
+    std::vector<uint32_t>& hits,
+    std::vector<Pair>& out,
+    EngineStats* stats);
+
+// Visit the buckets of a finer level that may hold a box overlapping slot a of
+// soa. A box of that level extends at most L / 2 from its center, so its center
+// lies in a's box grown by L / 2. If that window has more cells than the level
+// has occupied cells, the whole level is visited as one bucket instead.
+template <typename Visit>
+inline void visit_fine_buckets(
+    const Grid& fine,
+    int L,
+    const BoxSoA& soa,
+    size_t a,
+    const Visit& visit)
+{
+    const float reach = 0.5f * L;
+    const CellCoord lo = cell_of_point(soa.min_x[a] - reach, soa.min_y[a] - reach, L);
+    const CellCoord hi = cell_of_point(soa.max_x[a] + reach, soa.max_y[a] + reach, L);
+    const uint64_t window = uint64_t(int64_t(hi.x) - lo.x + 1) * uint64_t(int64_t(hi.y) - lo.y + 1);
+    if (window > fine.cells.size()) {
+        visit(Bucket{0, static_cast<uint32_t>(fine.boxes.size())});
+        return;
+    }
+    for (int y = lo.y; y <= hi.y; ++y) {
+        for (int x = lo.x; x <= hi.x; ++x) {
+            const uint32_t k = fine.index.find(CellCoord{x, y});
+            if (k != CellIndex::kEmpty) visit(fine.buckets[k]);
+        }
+    }
+}
+
+} // namespace aabb
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "aabb_io.h"
+#include "box_span.h"
+
+namespace aabb {
+
+// Axis a sort-and-sweep engine projects onto
+enum class SweepAxis {
+    X,     // sweep on x, filter on y
+    Y,     // sweep on y, filter on x
+    Auto,  // X or Y, whichever has fewer estimated projection overlaps
+    PCA,   // sweep along the principal axis of the box centers, exact 2D check
+};
+
+bool parse_sweep_axis(const std::string &name, SweepAxis &axis);
+const char *sweep_axis_name(SweepAxis axis);
+
+// Resolved sweep direction and the sampled estimates behind the choice.
+// candidates_* estimate the number of box pairs whose projections overlap on
+// that axis, i.e. the pairs the sweep has to test (< 0: not estimated).
+struct AxisEstimate {
+    SweepAxis axis = SweepAxis::X;  // never Auto
+    float dir_x = 1.0f;             // unit sweep direction (PCA only)
+    float dir_y = 0.0f;
+    double candidates_x = -1.0;
+    double candidates_y = -1.0;
+    double candidates_pca = -1.0;
+    size_t sample_size = 0;
+};
+
+// Estimate projection overlaps on a sample of at most `sample` boxes and resolve
+// `requested` (X and Y are kept as given, Auto picks X or Y, PCA fits a direction)
+AxisEstimate choose_sweep_axis(
+    BoxSpan boxes,
+    SweepAxis requested,
+    size_t sample = 4096);
+
+// Sweep interval [s_lo, s_hi] and filter interval [f_lo, f_hi] of a box.
+// For PCA both are projections onto the rotated frame, widened by a few ulps so
+// touching boxes still overlap; such candidates need an exact AABB check.
+inline void project_box(
+    const AABB &b,
+    const AxisEstimate &est,
+    float &s_lo, float &s_hi,
+    float &f_lo, float &f_hi)
+{
+    if (est.axis == SweepAxis::X) {
+        s_lo = b.min_x; s_hi = b.max_x;
+        f_lo = b.min_y; f_hi = b.max_y;
+    } else if (est.axis == SweepAxis::Y) {
+        s_lo = b.min_y; s_hi = b.max_y;
+        f_lo = b.min_x; f_hi = b.max_x;
+    } else {
+        const float cx = (b.min_x + b.max_x) * 0.5f;
+        const float cy = (b.min_y + b.max_y) * 0.5f;
+        const float hw = (b.max_x - b.min_x) * 0.5f;
+        const float hh = (b.max_y - b.min_y) * 0.5f;
+        const float ux = est.dir_x, uy = est.dir_y;
+        const float su = cx * ux + cy * uy;
+        const float sv = cy * ux - cx * uy;
+        const float ru = hw * std::fabs(ux) + hh * std::fabs(uy);
+        const float rv = hw * std::fabs(uy) + hh * std::fabs(ux);
+        const float eps = 1e-5f * (std::fabs(cx) + std::fabs(cy) + hw + hh);
+        s_lo = su - ru - eps; s_hi = su + ru + eps;
+        f_lo = sv - rv - eps; f_hi = sv + rv + eps;
+    }
+}
+
+} // namespace aabb
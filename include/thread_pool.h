@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aabb {
+
+// Thread count for a request of `threads` (0 = hardware threads)
+unsigned resolve_threads(unsigned threads);
+
+// Fixed set of worker threads that run index ranges. The calling thread takes
+// part in every run, so a pool of size 1 spawns no threads at all.
+class ThreadPool {
+public:
+    // Runs task(task_index, worker_index) for task_index in [0, num_tasks);
+    // worker_index is in [0, size()) and stable for the duration of a task
+    using Task = std::function<void(size_t, unsigned)>;
+
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Hands out tasks dynamically and returns once all of them have finished
+    void run(size_t num_tasks, const Task &task);
+
+private:
+    void worker_loop(unsigned worker);
+    void drain(unsigned worker);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const Task *task_ = nullptr;
+    size_t num_tasks_ = 0;
+    size_t next_task_ = 0;
+    size_t pending_ = 0;   // tasks not yet finished in the current run
+    size_t generation_ = 0;
+    bool stop_ = false;
+};
+
+} // namespace aabb
@@ -1,5 +1,7 @@
 #!/usr/bin/env python3
-"""Compare two text files of id pairs and check whether the pairs are the same (order-insensitive).
+"""Compare two files of id pairs and check whether the pairs are the same (order-insensitive).
+
+Pair files may be text, binary or varint encoded (see aabb_io.read_pairs).
 
 Usage: judge.py expected.out actual.out
 Exit code 0 if they match, 2 if they differ.
@@ -0,0 +1,14 @@
+#!/bin/bash
+#SBATCH -A ACD114118
+#SBATCH -N 1
+#SBATCH -n 1
+#SBATCH --gpus-per-node=8
+#SBATCH -t 10
+#SBATCH --output=log/cuda_scaling_%j.out
+
+# Multi-GPU scaling of one testcase: the same run on 1, 2, 4 and 8 GPUs
+# Usage: sbatch scripts/run_cuda_scaling.sh <algorithm> <testcase>
+for g in 1 2 4 8; do
+    echo "== $g GPUs"
+    srun ./bin/cuda "$1" "$2" --gpus "$g" --repeat 3
+done
@@ -0,0 +1,12 @@
+#!/bin/bash
+#SBATCH -A ACD114118
+#SBATCH -N 2
+#SBATCH --ntasks-per-node=1
+#SBATCH -c 8
+#SBATCH -t 10
+#SBATCH --output=log/mpi_%j.out
+
+# One rank per node, each running the _MT engine on its slab. For weak
+# scaling, submit with -N 1, 2, 4, ... and a testcase grown with the node count.
+# Usage: sbatch [-N nodes] scripts/run_mpi.sh <algorithm> <testcase>
+srun ./bin/mpi "$1" "$2" --threads "${SLURM_CPUS_PER_TASK:-0}"
@@ -1,66 +1,672 @@
 #include "aabb_io.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <limits>
+#include <thread>
 #ifdef _WIN32
     #include <direct.h>
 #else
+    #include <fcntl.h>
+    #include <sys/mman.h>
     #include <sys/stat.h>
+    #include <unistd.h>
 #endif
 
 namespace aabb {
 
-bool read_boxes(
+// If the parent directory of `path` does not exist, create it
+static void ensure_parent_dir(const std::string &path) {
+    size_t last_slash = path.find_last_of("/\\");
+    if (last_slash != std::string::npos) {
+        std::string dir = path.substr(0, last_slash);
+        #ifdef _WIN32
+            _mkdir(dir.c_str());
+        #else
+            mkdir(dir.c_str(), 0755);
+        #endif
+    }
+}
+
+static bool file_exists(const std::string &path) {
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    return static_cast<bool>(f);
+}
+
+// Map a whole file read-only. Falls back to a heap copy where mmap is unavailable.
+static bool map_file(
     const std::string &path,
-    std::vector<AABB> &boxes,
+    const char *&data,
+    size_t &bytes,
+    bool &mapped,
     std::string &err
 ) {
-    err.clear();
-    std::ifstream in(path, std::ios::in);
+    data = nullptr;
+    bytes = 0;
+    mapped = false;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = "failed to open input file: " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        err = "failed to stat input file: " + path;
+        return false;
+    }
+    bytes = static_cast<size_t>(st.st_size);
+    if (bytes == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *p = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        bytes = 0;
+        err = "failed to mmap input file: " + path;
+        return false;
+    }
+    madvise(p, bytes, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(p);
+    mapped = true;
+#else
+    std::ifstream in(path, std::ios::in | std::ios::binary | std::ios::ate);
     if (!in) {
         err = "failed to open input file: " + path;
         return false;
     }
+    bytes = static_cast<size_t>(in.tellg());
+    if (bytes == 0) return true;
+    char *buf = new char[bytes];
+    in.seekg(0);
+    in.read(buf, static_cast<std::streamsize>(bytes));
+    data = buf;
+#endif
+    return true;
+}
+
+static void unmap_file(const char *&data, size_t &bytes, bool &mapped) {
+    if (data) {
+#ifndef _WIN32
+        if (mapped) {
+            munmap(const_cast<char *>(data), bytes);
+        } else
+#endif
+        {
+            delete[] data;
+        }
+    }
+    data = nullptr;
+    bytes = 0;
+    mapped = false;
+}
+
 
-    int n;
-    in >> n;
-    boxes.resize(n);
+// ---------------------------------------------------------------------------
+// MappedBoxFile
+// ---------------------------------------------------------------------------
 
-    for (int i = 0; i < n; ++i) {
-        boxes[i].id = i;
-        in >> boxes[i].min_x >> boxes[i].min_y >> boxes[i].max_x >> boxes[i].max_y;
+MappedBoxFile::~MappedBoxFile() {
+    close();
+}
+
+MappedBoxFile::MappedBoxFile(MappedBoxFile &&other) noexcept
+    : data_(other.data_), bytes_(other.bytes_), mapped_(other.mapped_) {
+    other.data_ = nullptr;
+    other.bytes_ = 0;
+    other.mapped_ = false;
+}
+
+MappedBoxFile &MappedBoxFile::operator=(MappedBoxFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        data_ = other.data_;
+        bytes_ = other.bytes_;
+        mapped_ = other.mapped_;
+        other.data_ = nullptr;
+        other.bytes_ = 0;
+        other.mapped_ = false;
     }
+    return *this;
+}
 
-    in.close();
+// Checks magic, version and layout of a box file header, and that `payload`
+// bytes hold its records
+static bool check_box_file_header(const BoxFileHeader &h, uint64_t payload, const std::string &path,
+                                  std::string &err) {
+    if (std::memcmp(h.magic, kBoxFileMagic, sizeof(kBoxFileMagic)) != 0) {
+        err = "not a binary box file: " + path;
+        return false;
+    }
+    if (h.version != kBoxFileVersion) {
+        err = "unsupported binary box file version " + std::to_string(h.version) + ": " + path;
+        return false;
+    }
+    uint64_t record_bytes;
+    if (h.layout == static_cast<uint32_t>(BoxLayout::AoS)) {
+        record_bytes = sizeof(AABB);
+    } else if (h.layout == static_cast<uint32_t>(BoxLayout::SoA)) {
+        record_bytes = 4 * sizeof(float);
+    } else {
+        err = "unknown box layout " + std::to_string(h.layout) + ": " + path;
+        return false;
+    }
+    if (h.count > static_cast<uint64_t>(std::numeric_limits<int>::max()) || payload < h.count * record_bytes) {
+        err = "truncated binary box file: " + path;
+        return false;
+    }
     return true;
 }
 
+void MappedBoxFile::close() {
+    unmap_file(data_, bytes_, mapped_);
+}
 
-bool write_pairs(const std::string &path, const std::vector<std::pair<uint32_t, uint32_t>> &pairs, std::string &err) {
+bool MappedBoxFile::open(const std::string &path, std::string &err) {
     err.clear();
-    
-    // If directory does not exist, create it
-    size_t last_slash = path.find_last_of("/\\");
-    if (last_slash != std::string::npos) {
-        std::string dir = path.substr(0, last_slash);
-        #ifdef _WIN32
-            _mkdir(dir.c_str());
-        #else
-            mkdir(dir.c_str(), 0755);
-        #endif
+    close();
+
+    if (!map_file(path, data_, bytes_, mapped_, err)) return false;
+    if (bytes_ < sizeof(BoxFileHeader)) {
+        close();
+        err = "truncated binary box file: " + path;
+        return false;
+    }
+
+    if (!check_box_file_header(header(), bytes_ - sizeof(BoxFileHeader), path, err)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+const AABB *MappedBoxFile::boxes() const {
+    if (!data_ || layout() != BoxLayout::AoS) return nullptr;
+    return reinterpret_cast<const AABB *>(data_ + sizeof(BoxFileHeader));
+}
+
+const float *MappedBoxFile::column(int k) const {
+    if (!data_ || layout() != BoxLayout::SoA) return nullptr;
+    return reinterpret_cast<const float *>(data_ + sizeof(BoxFileHeader)) + k * size();
+}
+
+void MappedBoxFile::copy_to(std::vector<AABB> &out) const {
+    const size_t n = data_ ? size() : 0;
+    out.resize(n);
+    if (n == 0) return;
+    if (layout() == BoxLayout::AoS) {
+        std::memcpy(out.data(), boxes(), n * sizeof(AABB));
+        return;
+    }
+    const float *x0 = min_x();
+    const float *y0 = min_y();
+    const float *x1 = max_x();
+    const float *y1 = max_y();
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = {static_cast<int>(i), x0[i], y0[i], x1[i], y1[i]};
+    }
+}
+
+
+bool BoxFileReader::open(const std::string &path, std::string &err) {
+    err.clear();
+    in_.close();
+    in_.clear();
+    next_ = 0;
+    in_.open(path, std::ios::in | std::ios::binary);
+    if (!in_ || !in_.read(reinterpret_cast<char *>(&header_), sizeof(header_))) {
+        in_.close();
+        err = "cannot read binary box file: " + path;
+        return false;
+    }
+    in_.seekg(0, std::ios::end);
+    const uint64_t bytes = static_cast<uint64_t>(in_.tellg());
+    if (!check_box_file_header(header_, bytes - sizeof(BoxFileHeader), path, err)) {
+        in_.close();
+        return false;
+    }
+    in_.seekg(sizeof(BoxFileHeader));
+    path_ = path;
+    return true;
+}
+
+bool BoxFileReader::read(std::vector<AABB> &chunk, size_t max, std::string &err) {
+    const uint64_t n = std::min<uint64_t>(max, size() - next_);
+    chunk.resize(static_cast<size_t>(n));
+    if (n == 0) return true;
+    if (layout() == BoxLayout::AoS) {
+        in_.read(reinterpret_cast<char *>(chunk.data()), static_cast<std::streamsize>(n * sizeof(AABB)));
+    } else {
+        // One column segment at a time, in payload column order
+        static float AABB::*const kColumns[4] = {&AABB::min_x, &AABB::min_y, &AABB::max_x, &AABB::max_y};
+        column_.resize(static_cast<size_t>(n));
+        for (int k = 0; k < 4 && in_; ++k) {
+            const uint64_t offset = sizeof(BoxFileHeader) + (k * size() + next_) * sizeof(float);
+            in_.seekg(static_cast<std::streamoff>(offset));
+            in_.read(reinterpret_cast<char *>(column_.data()), static_cast<std::streamsize>(n * sizeof(float)));
+            for (size_t i = 0; i < n; ++i) chunk[i].*kColumns[k] = column_[i];
+        }
+        for (size_t i = 0; i < n; ++i) chunk[i].id = static_cast<int>(next_ + i);
+    }
+    if (!in_) {
+        err = "truncated binary box file: " + path_;
+        chunk.clear();
+        return false;
+    }
+    next_ += n;
+    return true;
+}
+
+
+// ---------------------------------------------------------------------------
+// Box files
+// ---------------------------------------------------------------------------
+
+bool is_binary_box_file(const std::string &path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    char magic[sizeof(kBoxFileMagic)];
+    if (!in.read(magic, sizeof(magic))) return false;
+    return std::memcmp(magic, kBoxFileMagic, sizeof(kBoxFileMagic)) == 0;
+}
+
+std::string testcase_input_path(const std::string &testcase) {
+    const std::string bin_path = "testcase/" + testcase + ".bin";
+    if (file_exists(bin_path)) return bin_path;
+    return "testcase/" + testcase + ".in";
+}
+
+std::string testcase_frame_path(const std::string &testcase, unsigned frame) {
+    if (frame == 0) return testcase_input_path(testcase);
+    return testcase_input_path(testcase + ".f" + std::to_string(frame));
+}
+
+// ---------------------------------------------------------------------------
+// Text parser
+// ---------------------------------------------------------------------------
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// Parse one float token; on a malformed token the value is 0 (as with iostreams)
+// and the cursor skips to the next whitespace.
+static inline const char *parse_float(const char *p, const char *end, float &value) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    if (p < end && *p == '+') ++p;
+    auto res = std::from_chars(p, end, value);
+    if (res.ec != std::errc()) {
+        value = 0.0f;
+        while (p < end && !is_space(*p)) ++p;
+        return p;
+    }
+    return res.ptr;
+}
+
+static inline bool is_blank_line(const char *p, const char *eol) {
+    for (; p < eol; ++p) {
+        if (!is_space(*p)) return false;
+    }
+    return true;
+}
+
+// Count the non-blank lines in [p, end)
+static size_t count_records(const char *p, const char *end) {
+    size_t count = 0;
+    while (p < end) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!eol) eol = end;
+        if (!is_blank_line(p, eol)) ++count;
+        p = eol + 1;
+    }
+    return count;
+}
+
+// Parse the non-blank lines in [p, end) into boxes[first, limit)
+static void parse_records(const char *p, const char *end, AABB *boxes, size_t first, size_t limit) {
+    size_t i = first;
+    while (p < end && i < limit) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!eol) eol = end;
+        if (!is_blank_line(p, eol)) {
+            AABB &b = boxes[i];
+            b.id = static_cast<int>(i);
+            const char *q = parse_float(p, eol, b.min_x);
+            q = parse_float(q, eol, b.min_y);
+            q = parse_float(q, eol, b.max_x);
+            parse_float(q, eol, b.max_y);
+            ++i;
+        }
+        p = eol + 1;
+    }
+}
+
+// Chunks smaller than this are not worth a thread
+static constexpr size_t kMinChunkBytes = size_t(1) << 20;
+
+static bool read_boxes_text(
+    const std::string &path,
+    std::vector<AABB> &boxes,
+    unsigned threads,
+    std::string &err
+) {
+    const char *data = nullptr;
+    size_t bytes = 0;
+    bool mapped = false;
+    if (!map_file(path, data, bytes, mapped, err)) return false;
+    const char *end = data + bytes;
+
+    // Header line: box count. An empty file or a header that is not a number
+    // reads as zero boxes, as the iostream reader did; only a count that
+    // parses but cannot be an int is an error.
+    const char *p = data;
+    while (p < end && is_space(*p)) ++p;
+    long long n = 0;
+    auto res = std::from_chars(p, end, n);
+    if (res.ec == std::errc::invalid_argument) {
+        unmap_file(data, bytes, mapped);
+        boxes.clear();
+        return true;
+    }
+    if (res.ec != std::errc() || n < 0 || n > std::numeric_limits<int>::max()) {
+        unmap_file(data, bytes, mapped);
+        err = "invalid box count in input file: " + path;
+        return false;
+    }
+    p = res.ptr;
+    while (p < end && *p != '\n') ++p;
+    if (p < end) ++p;
+
+    // Boxes beyond the end of a short file keep their id and zero coordinates
+    const size_t count = static_cast<size_t>(n);
+    boxes.assign(count, AABB{0, 0.0f, 0.0f, 0.0f, 0.0f});
+    for (size_t i = 0; i < count; ++i) boxes[i].id = static_cast<int>(i);
+
+    // Split the body into line-aligned chunks
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t body = static_cast<size_t>(end - p);
+    const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(threads, body / kMinChunkBytes));
+    std::vector<const char *> bounds(num_chunks + 1);
+    bounds[0] = p;
+    bounds[num_chunks] = end;
+    for (size_t c = 1; c < num_chunks; ++c) {
+        const char *q = std::max(bounds[c - 1], p + body / num_chunks * c);
+        const char *eol = static_cast<const char *>(std::memchr(q, '\n', static_cast<size_t>(end - q)));
+        bounds[c] = eol ? eol + 1 : end;
+    }
+
+    if (num_chunks == 1) {
+        parse_records(p, end, boxes.data(), 0, count);
+    } else {
+        // Pass 1: records per chunk, turned into each chunk's first box index
+        std::vector<size_t> first(num_chunks + 1, 0);
+        std::vector<std::thread> workers;
+        workers.reserve(num_chunks);
+        for (size_t c = 0; c < num_chunks; ++c) {
+            workers.emplace_back([&, c] { first[c + 1] = count_records(bounds[c], bounds[c + 1]); });
+        }
+        for (auto &t : workers) t.join();
+        for (size_t c = 0; c < num_chunks; ++c) first[c + 1] += first[c];
+
+        // Pass 2: parse every chunk into its slice of the output
+        workers.clear();
+        for (size_t c = 0; c < num_chunks; ++c) {
+            if (first[c] >= count) break;
+            workers.emplace_back([&, c] {
+                parse_records(bounds[c], bounds[c + 1], boxes.data(), first[c], count);
+            });
+        }
+        for (auto &t : workers) t.join();
+    }
+
+    unmap_file(data, bytes, mapped);
+    return true;
+}
+
+bool read_boxes(
+    const std::string &path,
+    std::vector<AABB> &boxes,
+    std::string &err
+) {
+    return read_boxes(path, boxes, 0, err);
+}
+
+bool read_boxes(
+    const std::string &path,
+    std::vector<AABB> &boxes,
+    unsigned threads,
+    std::string &err
+) {
+    err.clear();
+    if (is_binary_box_file(path)) {
+        MappedBoxFile file;
+        if (!file.open(path, err)) return false;
+        file.copy_to(boxes);
+        return true;
     }
+    return read_boxes_text(path, boxes, threads, err);
+}
+
+bool write_boxes_binary(
+    const std::string &path,
+    const std::vector<AABB> &boxes,
+    BoxLayout layout,
+    std::string &err
+) {
+    err.clear();
+    ensure_parent_dir(path);
 
-    std::ofstream out(path, std::ios::out);
+    std::ofstream out(path, std::ios::out | std::ios::binary);
     if (!out) {
         err = "failed to open output file: " + path;
         return false;
     }
-    for (const auto &p : pairs) {
-        out << p.first << ' ' << p.second << '\n';
+
+    BoxFileHeader h{};
+    std::memcpy(h.magic, kBoxFileMagic, sizeof(kBoxFileMagic));
+    h.version = kBoxFileVersion;
+    h.count = boxes.size();
+    h.layout = static_cast<uint32_t>(layout);
+    h.min_x = h.min_y = std::numeric_limits<float>::max();
+    h.max_x = h.max_y = std::numeric_limits<float>::lowest();
+    if (boxes.empty()) {
+        h.min_x = h.min_y = h.max_x = h.max_y = 0.0f;
+    }
+    for (const auto &b : boxes) {
+        h.min_x = std::min(h.min_x, b.min_x);
+        h.min_y = std::min(h.min_y, b.min_y);
+        h.max_x = std::max(h.max_x, b.max_x);
+        h.max_y = std::max(h.max_y, b.max_y);
+    }
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+    if (layout == BoxLayout::AoS) {
+        // Records are renumbered so the implicit and stored ids always agree
+        std::vector<AABB> records(boxes);
+        for (size_t i = 0; i < records.size(); ++i) records[i].id = static_cast<int>(i);
+        out.write(reinterpret_cast<const char *>(records.data()),
+                  static_cast<std::streamsize>(records.size() * sizeof(AABB)));
+    } else {
+        std::vector<float> column(boxes.size());
+        float AABB::*fields[4] = {&AABB::min_x, &AABB::min_y, &AABB::max_x, &AABB::max_y};
+        for (auto field : fields) {
+            for (size_t i = 0; i < boxes.size(); ++i) column[i] = boxes[i].*field;
+            out.write(reinterpret_cast<const char *>(column.data()),
+                      static_cast<std::streamsize>(column.size() * sizeof(float)));
+        }
+    }
+
+    if (!out) {
+        err = "failed to write output file: " + path;
+        return false;
     }
     out.close();
     return true;
 }
 
+
+// ---------------------------------------------------------------------------
+// Pair output
+// ---------------------------------------------------------------------------
+
+bool parse_pair_format(const std::string &name, PairFormat &format) {
+    if (name == "text") {
+        format = PairFormat::Text;
+    } else if (name == "bin") {
+        format = PairFormat::Binary;
+    } else if (name == "varint") {
+        format = PairFormat::Varint;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static const char kDigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Decimal formatting of v at p, returns one past the last digit
+static inline char *format_u32(char *p, uint32_t v) {
+    char tmp[10];
+    char *t = tmp + sizeof(tmp);
+    while (v >= 100) {
+        const uint32_t r = (v % 100) * 2;
+        v /= 100;
+        *--t = kDigitPairs[r + 1];
+        *--t = kDigitPairs[r];
+    }
+    if (v >= 10) {
+        *--t = kDigitPairs[v * 2 + 1];
+        *--t = kDigitPairs[v * 2];
+    } else {
+        *--t = static_cast<char>('0' + v);
+    }
+    const size_t n = static_cast<size_t>(tmp + sizeof(tmp) - t);
+    std::memcpy(p, t, n);
+    return p + n;
+}
+
+static inline char *encode_varint(char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+PairWriter::~PairWriter() {
+    std::string err;
+    close(err);
+}
+
+bool PairWriter::open(const std::string &path, PairFormat format, std::string &err) {
+    err.clear();
+    if (out_.is_open()) close(err);
+    ensure_parent_dir(path);
+
+    out_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        err = "failed to open output file: " + path;
+        return false;
+    }
+    buf_.resize(kBufferBytes);
+    len_ = 0;
+    bytes_ = 0;
+    count_ = 0;
+    prev_a_ = prev_b_ = 0;
+    format_ = format;
+
+    if (format_ != PairFormat::Text) {
+        // Placeholder header, the count is patched in close()
+        PairFileHeader h{};
+        std::memcpy(h.magic, format_ == PairFormat::Binary ? kPairFileMagicBinary : kPairFileMagicVarint,
+                    sizeof(h.magic));
+        h.version = kPairFileVersion;
+        std::memcpy(buf_.data(), &h, sizeof(h));
+        len_ = sizeof(h);
+    }
+    return true;
+}
+
+void PairWriter::encode(uint32_t a, uint32_t b) {
+    char *p = buf_.data() + len_;
+    switch (format_) {
+    case PairFormat::Text:
+        p = format_u32(p, a);
+        *p++ = ' ';
+        p = format_u32(p, b);
+        *p++ = '\n';
+        break;
+    case PairFormat::Binary:
+        std::memcpy(p, &a, sizeof(a));
+        std::memcpy(p + sizeof(a), &b, sizeof(b));
+        p += sizeof(a) + sizeof(b);
+        break;
+    case PairFormat::Varint: {
+        const int64_t da = int64_t(a) - int64_t(prev_a_);
+        const int64_t db = (da == 0) ? int64_t(b) - int64_t(prev_b_) : int64_t(b) - int64_t(a);
+        p = encode_varint(p, zigzag(da));
+        p = encode_varint(p, zigzag(db));
+        prev_a_ = a;
+        prev_b_ = b;
+        break;
+    }
+    }
+    len_ = static_cast<size_t>(p - buf_.data());
+}
+
+void PairWriter::flush() {
+    if (len_ == 0) return;
+    out_.write(buf_.data(), static_cast<std::streamsize>(len_));
+    bytes_ += len_;
+    len_ = 0;
+}
+
+bool PairWriter::close(std::string &err) {
+    err.clear();
+    if (!out_.is_open()) return true;
+    flush();
+    if (format_ != PairFormat::Text) {
+        out_.seekp(static_cast<std::streamoff>(offsetof(PairFileHeader, count)));
+        out_.write(reinterpret_cast<const char *>(&count_), sizeof(count_));
+    }
+    const bool ok = static_cast<bool>(out_);
+    out_.close();
+    buf_.clear();
+    buf_.shrink_to_fit();
+    if (!ok) {
+        err = "failed to write pairs";
+        return false;
+    }
+    return true;
+}
+
+bool write_pairs(const std::string &path, const std::vector<std::pair<uint32_t, uint32_t>> &pairs, std::string &err) {
+    return write_pairs(path, pairs, PairFormat::Text, err);
+}
+
+bool write_pairs(
+    const std::string &path,
+    const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+    PairFormat format,
+    std::string &err
+) {
+    PairWriter writer;
+    if (!writer.open(path, format, err)) return false;
+    writer.write(pairs.data(), pairs.size());
+    return writer.close(err);
+}
+
 } // namespace aabb
@@ -0,0 +1,396 @@
+// Benchmark harness: every engine on every testcase, with per-phase timings
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "seq_sort_and_sweep.h"
+#include "seq_sort_and_sweep_mt.h"
+#include "seq_bruteforce.h"
+#include "seq_bvh.h"
+#include "seq_spatial_hashing.h"
+
+#ifdef AABB_WITH_CUDA
+#include "cuda_sort_and_sweep.cuh"
+#include "cuda_spatial_hashing.cuh"
+#include "cuda_bvh.cuh"
+#include "cuda_bruteforce.cuh"
+#include "cuda_hybrid.cuh"
+#include "cuda_context.cuh"
+#endif
+
+#include "aabb_io.h"
+#include "engine_select.h"
+#include "engine_stats.h"
+#include "perf_counters.h"
+#include "phase_timer.h"
+
+using PairList = std::vector<std::pair<uint32_t, uint32_t>>;
+
+// The engine AUTO picks, measuring the scene inside the timed run
+static PairList run_auto(const std::vector<aabb::AABB> &b, unsigned threads) {
+#ifdef AABB_WITH_CUDA
+    const bool gpu = aabb::CudaContext::shared().ok();
+#else
+    const bool gpu = false;
+#endif
+    const aabb::EngineChoice choice = aabb::choose_engine(aabb::measure_scene(b), gpu);
+    const uint32_t n = static_cast<uint32_t>(b.size());
+#ifdef AABB_WITH_CUDA
+    if (choice.gpu) {
+        return choice.kind == aabb::EngineKind::SpatialHashing ? cuda_spatial_hashing(n, b)
+                                                               : cuda_sort_and_sweep(n, b);
+    }
+#endif
+    if (choice.kind == aabb::EngineKind::SpatialHashing) return spatial_hashing_mt(b, threads);
+    SortAndSweepOptions options;
+    options.threads = threads;
+    return sort_and_sweep_mt(n, b, options);
+}
+
+struct Engine {
+    const char *name;
+    bool by_default;  // run when --engines is not given
+    std::function<PairList(const std::vector<aabb::AABB> &, unsigned threads)> run;
+};
+
+static const std::vector<Engine> &engines() {
+    static const std::vector<Engine> table = {
+        {"BF", false, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return brute_force(static_cast<uint32_t>(b.size()), b);
+         }},
+        {"SS", true, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return sort_and_sweep(static_cast<uint32_t>(b.size()), b, SortAndSweepOptions());
+         }},
+        {"SS_MT", true, [](const std::vector<aabb::AABB> &b, unsigned threads) {
+             SortAndSweepOptions options;
+             options.threads = threads;
+             return sort_and_sweep_mt(static_cast<uint32_t>(b.size()), b, options);
+         }},
+        {"SH", true, [](const std::vector<aabb::AABB> &b, unsigned) { return spatial_hashing(b); }},
+        {"SH_MT", true, [](const std::vector<aabb::AABB> &b, unsigned threads) {
+             return spatial_hashing_mt(b, threads);
+         }},
+        {"BVH", true, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return bvh(static_cast<uint32_t>(b.size()), b);
+         }},
+#ifdef AABB_WITH_CUDA
+        {"CUDA_SS", true, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return cuda_sort_and_sweep(static_cast<uint32_t>(b.size()), b);
+         }},
+        {"CUDA_SH", true, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return cuda_spatial_hashing(static_cast<uint32_t>(b.size()), b);
+         }},
+        {"CUDA_BVH", true, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return cuda_bvh(static_cast<uint32_t>(b.size()), b);
+         }},
+        {"CUDA_BF", false, [](const std::vector<aabb::AABB> &b, unsigned) {
+             return cuda_brute_force(static_cast<uint32_t>(b.size()), b);
+         }},
+        // The rates persist across calls, so the split converges over the repetitions
+        {"HYBRID", true, [](const std::vector<aabb::AABB> &b, unsigned threads) {
+             static HybridThroughput throughput;
+             HybridOptions options;
+             options.threads = threads;
+             options.throughput = &throughput;
+             return cuda_hybrid(static_cast<uint32_t>(b.size()), b, options);
+         }},
+#endif
+        {"AUTO", true, run_auto},
+    };
+    return table;
+}
+
+// Testcases with a numeric name in testcase/, in numeric order
+static std::vector<std::string> default_testcases() {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator("testcase", ec)) {
+        const std::string ext = entry.path().extension().string();
+        const std::string stem = entry.path().stem().string();
+        if (ext != ".in" && ext != ".bin") continue;
+        if (stem.empty() || !std::all_of(stem.begin(), stem.end(), ::isdigit)) continue;
+        if (std::find(names.begin(), names.end(), stem) == names.end()) names.push_back(stem);
+    }
+    std::sort(names.begin(), names.end(), [](const std::string &a, const std::string &b) {
+        return std::stoul(a) < std::stoul(b);
+    });
+    return names;
+}
+
+static std::vector<std::string> split(const std::string &list) {
+    std::vector<std::string> items;
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Samples of one phase over the measured repetitions, in milliseconds
+struct Summary {
+    size_t reps = 0;
+    double min_ms = 0.0;
+    double median_ms = 0.0;
+    double p99_ms = 0.0;
+};
+
+static Summary summarize(std::vector<double> samples) {
+    Summary s;
+    s.reps = samples.size();
+    if (samples.empty()) return s;
+    std::sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+    s.min_ms = samples.front();
+    s.median_ms = n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    // Nearest rank: the smallest sample with at least 99% of them at or below it
+    const size_t rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(n)));
+    s.p99_ms = samples[std::max<size_t>(rank, 1) - 1];
+    return s;
+}
+
+// Timings of one engine on one testcase
+struct Result {
+    std::string testcase;
+    std::string engine;
+    size_t boxes = 0;
+    size_t pairs = 0;
+    std::vector<std::pair<std::string, Summary>> phases;  // in Phase order, then "total"
+    // --stats: engine stats of the first measured run, counters per run
+    bool has_stats = false;
+    aabb::EngineStats stats;
+    bool has_counter[aabb::PerfCounters::kNumCounters] = {};
+    double counters[aabb::PerfCounters::kNumCounters] = {};
+};
+
+static void print_csv(std::ostream &out, const std::vector<Result> &results) {
+    out << "testcase,engine,boxes,pairs,phase,reps,min_ms,median_ms,p99_ms\n";
+    for (const Result &r : results) {
+        for (const auto &phase : r.phases) {
+            const Summary &s = phase.second;
+            out << r.testcase << ',' << r.engine << ',' << r.boxes << ',' << r.pairs << ','
+                << phase.first << ',' << s.reps << ',' << s.min_ms << ',' << s.median_ms << ','
+                << s.p99_ms << '\n';
+        }
+    }
+}
+
+static void print_histogram(std::ostream &out, const char *name, const aabb::Log2Histogram &h) {
+    size_t used = aabb::Log2Histogram::kBuckets;
+    while (used > 0 && h.buckets[used - 1] == 0) --used;
+    out << ", \"" << name << "\": {\"count\": " << h.count << ", \"mean\": " << h.mean()
+        << ", \"max\": " << h.max << ", \"log2_buckets\": [";
+    for (size_t k = 0; k < used; ++k) out << (k ? ", " : "") << h.buckets[k];
+    out << "]}";
+}
+
+static void print_stats(std::ostream &out, const Result &r) {
+    out << ",\n   \"stats\": {\"engine_stats\": " << (aabb::kStatsEnabled ? "true" : "false");
+    if (aabb::kStatsEnabled) {
+        const aabb::EngineStats &s = r.stats;
+        out << ", \"pairs_tested\": " << s.pairs_tested << ", \"pairs_hit\": " << s.pairs_hit;
+        if (s.active_set.count) print_histogram(out, "active_set", s.active_set);
+        if (s.cell_occupancy.count) print_histogram(out, "cell_occupancy", s.cell_occupancy);
+        if (s.warp_work.warps) {
+            out << ", \"warp_work\": {\"warps\": " << s.warp_work.warps << ", \"lane_work\": " << s.warp_work.work
+                << ", \"imbalance\": " << s.warp_work.imbalance() << '}';
+        }
+    }
+    out << ", \"counters\": {";
+    bool first = true;
+    for (int c = 0; c < aabb::PerfCounters::kNumCounters; ++c) {
+        if (!r.has_counter[c]) continue;
+        out << (first ? "" : ", ") << '"' << aabb::PerfCounters::name(static_cast<aabb::PerfCounters::Counter>(c))
+            << "\": " << static_cast<uint64_t>(r.counters[c]);
+        first = false;
+    }
+    out << "}}";
+}
+
+static void print_json(std::ostream &out, const std::vector<Result> &results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        out << "  {\"testcase\": \"" << r.testcase << "\", \"engine\": \"" << r.engine
+            << "\", \"boxes\": " << r.boxes << ", \"pairs\": " << r.pairs << ",\n"
+            << "   \"phases\": {";
+        for (size_t k = 0; k < r.phases.size(); ++k) {
+            const Summary &s = r.phases[k].second;
+            out << (k ? ",\n              " : "") << '"' << r.phases[k].first << "\": {\"reps\": " << s.reps
+                << ", \"min_ms\": " << s.min_ms << ", \"median_ms\": " << s.median_ms
+                << ", \"p99_ms\": " << s.p99_ms << '}';
+        }
+        out << '}';
+        if (r.has_stats) print_stats(out, r);
+        out << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "]\n";
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> engine_names;
+    std::vector<std::string> testcases;
+    unsigned reps = 5, warmup = 1, threads = 0;
+    bool json = false, write = false, stats = false;
+    std::string out_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string opt = argv[i];
+        if (opt == "--engines" && i + 1 < argc) {
+            engine_names = split(argv[++i]);
+        } else if (opt == "--reps" && i + 1 < argc) {
+            reps = std::max(1u, static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (opt == "--warmup" && i + 1 < argc) {
+            warmup = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (opt == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (opt == "--format" && i + 1 < argc && (std::string(argv[i + 1]) == "csv" ||
+                                                         std::string(argv[i + 1]) == "json")) {
+            json = std::string(argv[++i]) == "json";
+        } else if (opt == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (opt == "--write") {
+            write = true;
+        } else if (opt == "--stats") {
+            stats = true;
+        } else if (!opt.empty() && opt[0] != '-') {
+            testcases.push_back(opt);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--engines A,B,...] [--reps N] [--warmup N] [--threads N] "
+                      << "[--format csv|json] [--out FILE] [--write] [--stats] [testcase...]\n";
+            std::cerr << "  --engines: engines to run (default: all but BF)\n";
+            std::cerr << "  --reps:    measured runs per engine and testcase (default: 5)\n";
+            std::cerr << "  --warmup:  unmeasured runs before them (default: 1)\n";
+            std::cerr << "  --write:   also time writing out/<testcase>.<engine>.out\n";
+            std::cerr << "  --stats:   add engine stats (make STATS=1) and hardware counters to the JSON\n";
+            std::cerr << "  testcase:  testcase numbers (default: every numbered testcase)\n";
+            return 1;
+        }
+    }
+
+    std::vector<const Engine *> selected;
+    for (const Engine &e : engines()) {
+        if (engine_names.empty() ? e.by_default
+                                 : std::find(engine_names.begin(), engine_names.end(), e.name) != engine_names.end()) {
+            selected.push_back(&e);
+        }
+    }
+    for (const std::string &name : engine_names) {
+        if (std::none_of(selected.begin(), selected.end(), [&](const Engine *e) { return name == e->name; })) {
+            std::cerr << "Unknown engine: " << name << '\n';
+            return 4;
+        }
+    }
+    if (testcases.empty()) testcases = default_testcases();
+
+    aabb::PerfCounters counters;
+    if (stats) {
+        std::string err;
+        if (!counters.open(err)) std::cerr << "[bench] no hardware counters: " << err << '\n';
+        if (!aabb::kStatsEnabled) std::cerr << "[bench] engine stats are not compiled in; rebuild with STATS=1\n";
+    }
+
+    std::ofstream report_file;
+    if (!out_path.empty()) {
+        report_file.open(out_path);
+        if (!report_file) {
+            std::cerr << "Failed to open " << out_path << '\n';
+            return 3;
+        }
+    }
+
+    std::vector<Result> results;
+    for (const std::string &testcase : testcases) {
+        std::vector<aabb::AABB> boxes;
+        std::string err;
+        const auto load_start = std::chrono::steady_clock::now();
+        if (!aabb::read_boxes(aabb::testcase_input_path(testcase), boxes, err)) {
+            std::cerr << "Failed to read file: " << err << '\n';
+            return 2;
+        }
+        const double load_ms = ms_since(load_start);
+
+        for (const Engine *engine : selected) {
+            std::cerr << "[bench] testcase " << testcase << ", " << engine->name << '\n';
+            std::vector<std::vector<double>> samples(aabb::kNumPhases);
+            std::vector<double> totals;
+            bool seen[aabb::kNumPhases] = {};
+            size_t num_pairs = 0;
+            Result result;
+
+            for (unsigned rep = 0; rep < warmup + reps; ++rep) {
+                aabb::PhaseTimes times;
+                const bool measured = rep >= warmup;
+                const auto start = std::chrono::steady_clock::now();
+                aabb::set_phase_recorder(&times);
+                aabb::set_stats_recorder(stats && rep == warmup ? &result.stats : nullptr);
+                if (stats && measured) counters.start();
+                PairList pairs = engine->run(boxes, threads);
+                if (stats && measured) {
+                    counters.stop();
+                    for (int c = 0; c < aabb::PerfCounters::kNumCounters; ++c) {
+                        const auto counter = static_cast<aabb::PerfCounters::Counter>(c);
+                        result.has_counter[c] = counters.available(counter);
+                        result.counters[c] += double(counters.value(counter)) / reps;
+                    }
+                }
+                aabb::set_stats_recorder(nullptr);
+                if (write) {
+                    aabb::ScopedPhase write_phase(aabb::Phase::Write);
+                    const std::string path = "out/" + testcase + "." + engine->name + ".out";
+                    if (!aabb::write_pairs(path, pairs, err)) {
+                        aabb::set_phase_recorder(nullptr);
+                        std::cerr << "Failed to write pairs: " << err << '\n';
+                        return 3;
+                    }
+                }
+                aabb::set_phase_recorder(nullptr);
+                const double total_ms = ms_since(start);
+                num_pairs = pairs.size();
+                if (!measured) continue;
+
+                totals.push_back(total_ms);
+                for (size_t p = 0; p < aabb::kNumPhases; ++p) {
+                    if (!times.seen[p]) continue;
+                    seen[p] = true;
+                    samples[p].push_back(times.seconds[p] * 1e3);
+                }
+            }
+
+            result.has_stats = stats;
+            result.testcase = testcase;
+            result.engine = engine->name;
+            result.boxes = boxes.size();
+            result.pairs = num_pairs;
+            result.phases.emplace_back(aabb::phase_name(aabb::Phase::Load),
+                                       summarize(std::vector<double>{load_ms}));
+            for (size_t p = 0; p < aabb::kNumPhases; ++p) {
+                if (!seen[p]) continue;
+                result.phases.emplace_back(aabb::phase_name(static_cast<aabb::Phase>(p)), summarize(samples[p]));
+            }
+            result.phases.emplace_back("total", summarize(totals));
+            results.push_back(std::move(result));
+        }
+    }
+
+    std::ostream &report = out_path.empty() ? std::cout : report_file;
+    if (json) {
+        print_json(report, results);
+    } else {
+        print_csv(report, results);
+    }
+    return 0;
+}
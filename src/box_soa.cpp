@@ -0,0 +1,35 @@
+#include "box_soa.h"
+
+namespace aabb {
+
+void BoxSoA::resize(size_t n) {
+    min_x.resize(n);
+    min_y.resize(n);
+    max_x.resize(n);
+    max_y.resize(n);
+    id.resize(n);
+}
+
+BoxSoA BoxSoA::from_boxes(BoxSpan boxes) {
+    BoxSoA soa;
+    soa.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        soa.set(i, boxes[i]);
+    }
+    return soa;
+}
+
+void BoxSoA::assign(BoxSpan boxes, const std::vector<uint32_t> &order) {
+    resize(order.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        set(k, boxes[order[k]]);
+    }
+}
+
+BoxSoA BoxSoA::from_boxes(BoxSpan boxes, const std::vector<uint32_t> &order) {
+    BoxSoA soa;
+    soa.assign(boxes, order);
+    return soa;
+}
+
+} // namespace aabb
@@ -0,0 +1,565 @@
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include "broad_phase.h"
+
+#include "grid_levels.h"
+#include "radix_sort.h"
+#include "seq_sort_and_sweep.h"
+#include "spatial_grid.h"
+
+namespace aabb {
+
+bool parse_broad_phase_method(const std::string &name, BroadPhaseMethod &method) {
+    if (name == "SS") {
+        method = BroadPhaseMethod::SortAndSweep;
+    } else if (name == "SH") {
+        method = BroadPhaseMethod::SpatialHashing;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void BroadPhase::query(std::vector<Pair> &added, std::vector<Pair> &removed) {
+    added.clear();
+    removed.clear();
+    VectorPairSink added_sink(added);
+    VectorPairSink removed_sink(removed);
+    query(added_sink, removed_sink);
+}
+
+namespace {
+
+// Pair of ids packed as min << 32 | max, so key order is pair order
+inline uint64_t pair_key(uint32_t a, uint32_t b) {
+    if (a > b) std::swap(a, b);
+    return (uint64_t(a) << 32) | b;
+}
+
+inline bool overlaps(const AABB &a, const AABB &b) {
+    return !(a.max_x < b.min_x || b.max_x < a.min_x ||
+             a.max_y < b.min_y || b.max_y < a.min_y);
+}
+
+void emit_keys(const std::vector<uint64_t> &keys, PairSink &sink) {
+    PairEmitter emitter(sink);
+    for (const uint64_t k : keys) emitter.emit(static_cast<uint32_t>(k >> 32), static_cast<uint32_t>(k));
+}
+
+// Open-addressing set of pair keys; erase shifts the probe run back instead
+// of leaving tombstones, so lookups stay short under constant churn
+class PairSet {
+public:
+    // a < b in every key, so this is never one
+    static constexpr uint64_t kEmpty = std::numeric_limits<uint64_t>::max();
+
+    size_t size() const { return size_; }
+
+    bool contains(uint64_t key) const {
+        if (size_ == 0) return false;
+        for (size_t slot = hash(key) & mask_;; slot = (slot + 1) & mask_) {
+            if (keys_[slot] == kEmpty) return false;
+            if (keys_[slot] == key) return true;
+        }
+    }
+
+    // False if the key was already present
+    bool insert(uint64_t key) {
+        if (2 * (size_ + 1) > keys_.size()) grow();
+        size_t slot = hash(key) & mask_;
+        for (; keys_[slot] != kEmpty; slot = (slot + 1) & mask_) {
+            if (keys_[slot] == key) return false;
+        }
+        keys_[slot] = key;
+        ++size_;
+        return true;
+    }
+
+    // False if the key was not present
+    bool erase(uint64_t key) {
+        if (size_ == 0) return false;
+        size_t hole = hash(key) & mask_;
+        for (; keys_[hole] != key; hole = (hole + 1) & mask_) {
+            if (keys_[hole] == kEmpty) return false;
+        }
+        // Pull back every later key of the run whose home slot is at or before the hole
+        for (size_t next = (hole + 1) & mask_; keys_[next] != kEmpty; next = (next + 1) & mask_) {
+            const size_t home = hash(keys_[next]) & mask_;
+            if (((next - home) & mask_) >= ((next - hole) & mask_)) {
+                keys_[hole] = keys_[next];
+                hole = next;
+            }
+        }
+        keys_[hole] = kEmpty;
+        --size_;
+        return true;
+    }
+
+    template <typename Fn>
+    void for_each(const Fn &fn) const {
+        for (const uint64_t k : keys_) {
+            if (k != kEmpty) fn(k);
+        }
+    }
+
+    void swap(PairSet &other) {
+        keys_.swap(other.keys_);
+        std::swap(mask_, other.mask_);
+        std::swap(size_, other.size_);
+    }
+
+private:
+    static size_t hash(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        return static_cast<size_t>(k);
+    }
+
+    void grow() {
+        std::vector<uint64_t> keys;
+        keys.swap(keys_);
+        const size_t capacity = std::max<size_t>(64, 2 * keys.size());
+        keys_.assign(capacity, kEmpty);
+        mask_ = capacity - 1;
+        size_ = 0;
+        for (const uint64_t k : keys) {
+            if (k != kEmpty) insert(k);
+        }
+    }
+
+    std::vector<uint64_t> keys_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
+
+// Reports the pairs toggled in or out of `pairs` since the last query and
+// clears the list; a pair toggled an even number of times is back where it
+// started, the others were added if they are in `pairs` now
+void emit_toggled(std::vector<uint64_t> &toggled, const PairSet &pairs, PairSink &added, PairSink &removed) {
+    std::sort(toggled.begin(), toggled.end());
+    std::vector<uint64_t> added_keys, removed_keys;
+    for (size_t i = 0; i < toggled.size();) {
+        size_t j = i + 1;
+        while (j < toggled.size() && toggled[j] == toggled[i]) ++j;
+        if ((j - i) % 2 == 1) (pairs.contains(toggled[i]) ? added_keys : removed_keys).push_back(toggled[i]);
+        i = j;
+    }
+    toggled.clear();
+    emit_keys(added_keys, added);
+    emit_keys(removed_keys, removed);
+}
+
+// ---------------------------------------------------------------------------
+// Sort-and-sweep
+// ---------------------------------------------------------------------------
+
+// Insertion-sort swaps allowed per box and axis before a frame is rebuilt
+constexpr uint64_t kMaxSwapsPerBox = 32;
+// Most frames rebuilt without trying a repair after repeated failed repairs
+constexpr unsigned kMaxRepairBackoff = 16;
+
+// Interval end point of box (tag >> 1); ends (tag & 1) order after starts of
+// the same value, so touching boxes count as overlapping
+struct Endpoint {
+    float value;
+    uint32_t tag;
+};
+
+inline bool before(const Endpoint &a, const Endpoint &b) {
+    return a.value < b.value || (a.value == b.value && (a.tag & 1) < (b.tag & 1));
+}
+
+// Keeps the sorted end points of both axes between frames (Baraff's
+// incremental sweep). Boxes move little per frame, so insertion sort repairs
+// the order in close to linear time, and a pair can only start or stop
+// overlapping where a start and an end point of its boxes swap.
+class IncrementalSortAndSweep final : public BroadPhase {
+public:
+    void update(BoxSpan boxes) override {
+        stats_ = BroadPhaseStats();
+        const bool resized = !built_ || boxes.size() != boxes_.size();
+        prev_boxes_.swap(boxes_);
+        boxes_.assign(boxes.begin(), boxes.end());
+        if (resized) {
+            rebuild();
+            return;
+        }
+
+        for (auto &axis : axes_) {
+            for (Endpoint &e : axis) e.value = value_of(e.tag, &axis == &axes_[0]);
+        }
+        // After a repair ran out of budget, rebuild directly for a while
+        // (1, 2, 4, ... frames) instead of paying for another failed repair
+        if (skip_repairs_ > 0) {
+            --skip_repairs_;
+            rebuild();
+            return;
+        }
+        const uint64_t budget = kMaxSwapsPerBox * boxes_.size();
+        if (repair(axes_[0], budget) && repair(axes_[1], 2 * budget)) {
+            backoff_ = 0;
+            return;
+        }
+        backoff_ = std::min(kMaxRepairBackoff, std::max(1u, 2 * backoff_));
+        skip_repairs_ = backoff_;
+        rebuild();
+    }
+
+    void query(PairSink &added, PairSink &removed) override { emit_toggled(toggled_, pairs_, added, removed); }
+
+    uint64_t num_pairs() const override { return pairs_.size(); }
+
+private:
+    float value_of(uint32_t tag, bool x_axis) const {
+        const AABB &b = boxes_[tag >> 1];
+        if (x_axis) return (tag & 1) ? b.max_x : b.min_x;
+        return (tag & 1) ? b.max_y : b.min_y;
+    }
+
+    uint32_t id_of(uint32_t tag) const { return static_cast<uint32_t>(boxes_[tag >> 1].id); }
+
+    // `moving` was just moved in front of `other`
+    void on_swap(const Endpoint &moving, const Endpoint &other) {
+        const uint32_t a = moving.tag >> 1;
+        const uint32_t b = other.tag >> 1;
+        if (a == b) return;
+        const bool moving_end = moving.tag & 1;
+        const bool other_end = other.tag & 1;
+        if (moving_end == other_end) return;
+
+        // Until the pair is toggled, its membership in pairs_ is whether the
+        // boxes overlapped in the previous frame, so the set is only touched
+        // for real changes
+        const bool was = overlaps(prev_boxes_[a], prev_boxes_[b]);
+        if (!moving_end) {
+            // A start passed an end: the intervals overlap now, check the boxes
+            if (was || !overlaps(boxes_[a], boxes_[b])) return;
+            const uint64_t key = pair_key(id_of(moving.tag), id_of(other.tag));
+            if (pairs_.insert(key)) toggled_.push_back(key);
+        } else {
+            // An end passed a start: the intervals are disjoint now
+            if (!was) return;
+            const uint64_t key = pair_key(id_of(moving.tag), id_of(other.tag));
+            if (pairs_.erase(key)) toggled_.push_back(key);
+        }
+    }
+
+    // Insertion sort of one axis; false once the swap count passes the budget
+    bool repair(std::vector<Endpoint> &axis, uint64_t budget) {
+        for (size_t i = 1; i < axis.size(); ++i) {
+            const Endpoint moving = axis[i];
+            size_t j = i;
+            while (j > 0 && before(moving, axis[j - 1])) {
+                on_swap(moving, axis[j - 1]);
+                axis[j] = axis[j - 1];
+                --j;
+                if (++stats_.swaps > budget) {
+                    axis[j] = moving;
+                    return false;
+                }
+            }
+            axis[j] = moving;
+        }
+        return true;
+    }
+
+    // Sorts both axes from scratch and recomputes the pairs with the static
+    // engine; pairs that differ from the current set are toggled
+    void rebuild() {
+        stats_.rebuilt = true;
+        built_ = true;
+        const uint32_t n = static_cast<uint32_t>(boxes_.size());
+
+        for (int a = 0; a < 2; ++a) {
+            std::vector<uint64_t> keys(2 * size_t(n));
+            std::vector<uint32_t> tags(2 * size_t(n));
+            for (uint32_t t = 0; t < 2 * n; ++t) {
+                keys[t] = (uint64_t(float_radix_key(value_of(t, a == 0))) << 1) | (t & 1);
+                tags[t] = t;
+            }
+            radix_sort_pairs(keys, tags);
+            axes_[a].resize(tags.size());
+            for (size_t k = 0; k < tags.size(); ++k) {
+                axes_[a][k] = Endpoint{value_of(tags[k], a == 0), tags[k]};
+            }
+        }
+
+        PairSet next;
+        CallbackPairSink sink([&](const Pair *pairs, size_t count) {
+            for (size_t i = 0; i < count; ++i) next.insert(pair_key(pairs[i].first, pairs[i].second));
+        });
+        sort_and_sweep(n, boxes_, sink);
+        pairs_.for_each([&](uint64_t k) {
+            if (!next.contains(k)) toggled_.push_back(k);
+        });
+        next.for_each([&](uint64_t k) {
+            if (!pairs_.contains(k)) toggled_.push_back(k);
+        });
+        pairs_.swap(next);
+    }
+
+    bool built_ = false;
+    unsigned backoff_ = 0;       // length of the last rebuild-only stretch
+    unsigned skip_repairs_ = 0;  // frames left to rebuild without a repair
+    std::vector<AABB> boxes_;
+    std::vector<AABB> prev_boxes_;   // boxes of the previous update()
+    std::vector<Endpoint> axes_[2];
+    PairSet pairs_;                  // pairs overlapping now
+    std::vector<uint64_t> toggled_;  // pairs that entered or left pairs_ since the last query
+};
+
+// ---------------------------------------------------------------------------
+// Spatial hashing
+// ---------------------------------------------------------------------------
+
+// fresh_at_ of a box whose owned pairs were not recollected this frame
+constexpr uint32_t kNotRetested = std::numeric_limits<uint32_t>::max();
+
+// Once more than 1 / kMarkAllFraction of the boxes changed, nearly every cell
+// is marked anyway, so all are re-tested without the marking
+constexpr size_t kMarkAllFraction = 2;
+
+// The flat hierarchical grid of the static engine (spatial_grid.h), rebuilt
+// every frame by one radix sort per level. A pair can only change where one of
+// its boxes moved, so only the cells a moved box left or entered, and the
+// cells whose pairs reach them, are re-tested. Each box keeps the sorted pairs
+// it owns under the traversal of spatial_hashing_mt, and a re-tested box diffs
+// its new list against the old one.
+class IncrementalSpatialHashing final : public BroadPhase {
+public:
+    void update(BoxSpan boxes) override {
+        stats_ = BroadPhaseStats();
+        bool rebuild = !built_ || boxes.size() != boxes_.size();
+        prev_boxes_.swap(boxes_);
+        boxes_.assign(boxes.begin(), boxes.end());
+        if (!rebuild) {
+            // The top level's neighborhood only covers boxes up to its cell size
+            const float top = static_cast<float>(cell_sizes_.back());
+            for (const AABB &b : boxes_) {
+                if (box_extent(b) > top) {
+                    rebuild = true;
+                    break;
+                }
+            }
+        }
+        if (rebuild) {
+            stats_.rebuilt = true;
+            built_ = true;
+            cell_sizes_ = choose_grid_levels(boxes_);
+        }
+        build();
+        mark_dirty(rebuild);
+        retest(rebuild);
+    }
+
+    void query(PairSink &added, PairSink &removed) override { emit_toggled(toggled_, pairs_, added, removed); }
+
+    uint64_t num_pairs() const override { return pairs_.size(); }
+
+private:
+    uint32_t level_of(const AABB &b) const {
+        return static_cast<uint32_t>(grid_level_of(box_extent(b), cell_sizes_));
+    }
+
+    // One grid per level over the boxes that fall in it
+    void build() {
+        const size_t num_levels = cell_sizes_.size();
+        members_.resize(num_levels);
+        member_boxes_.resize(num_levels);
+        for (size_t l = 0; l < num_levels; ++l) {
+            members_[l].clear();
+            member_boxes_[l].clear();
+        }
+        for (uint32_t i = 0; i < boxes_.size(); ++i) {
+            const uint32_t l = level_of(boxes_[i]);
+            members_[l].push_back(i);
+            member_boxes_[l].push_back(boxes_[i]);
+        }
+        levels_.resize(num_levels);
+        for (size_t l = 0; l < num_levels; ++l) {
+            levels_[l].cell_size = cell_sizes_[l];
+            levels_[l].grid = build_grid(member_boxes_[l], cell_sizes_[l]);
+        }
+    }
+
+    void mark(size_t l, const CellCoord &c) {
+        const uint32_t k = levels_[l].grid.index.find(c);
+        if (k != CellIndex::kEmpty) dirty_[l][k] = 1;
+    }
+
+    // Cells that own pairs with box b: its own, the backward neighbors at its
+    // level, and the coarser cells a box overlapping b can have its center in
+    // (b grown by half their cell size)
+    void mark_box(const AABB &b) {
+        const uint32_t m = level_of(b);
+        const CellCoord c = cell_of_box(b, cell_sizes_[m]);
+        mark(m, c);
+        for (const auto &d : kForwardCells) mark(m, CellCoord{c.x - d[0], c.y - d[1]});
+        for (size_t l = m + 1; l < levels_.size(); ++l) {
+            const int L = cell_sizes_[l];
+            const float reach = 0.5f * L;
+            const CellCoord lo = cell_of_point(b.min_x - reach, b.min_y - reach, L);
+            const CellCoord hi = cell_of_point(b.max_x + reach, b.max_y + reach, L);
+            for (int y = lo.y; y <= hi.y; ++y) {
+                for (int x = lo.x; x <= hi.x; ++x) mark(l, CellCoord{x, y});
+            }
+        }
+    }
+
+    // Marks the cells owning pairs with a box that changed, at its old place
+    // and its new one; after a rebuild, or once most boxes changed, every cell
+    void mark_dirty(bool all) {
+        changed_.clear();
+        if (!all) {
+            for (uint32_t i = 0; i < boxes_.size(); ++i) {
+                const AABB &was = prev_boxes_[i];
+                const AABB &now = boxes_[i];
+                if (was.id == now.id && was.min_x == now.min_x && was.min_y == now.min_y &&
+                    was.max_x == now.max_x && was.max_y == now.max_y) {
+                    continue;
+                }
+                changed_.push_back(i);
+                const uint32_t l = level_of(now);
+                if (level_of(was) != l || !(cell_of_box(was, cell_sizes_[l]) == cell_of_box(now, cell_sizes_[l]))) {
+                    ++stats_.moved;
+                }
+            }
+        }
+        const bool every = all || changed_.size() * kMarkAllFraction > boxes_.size();
+        dirty_.resize(levels_.size());
+        for (size_t l = 0; l < levels_.size(); ++l) dirty_[l].assign(levels_[l].grid.cells.size(), every ? 1 : 0);
+        if (every) return;
+        for (const uint32_t i : changed_) {
+            mark_box(prev_boxes_[i]);
+            mark_box(boxes_[i]);
+        }
+    }
+
+    // Pairs owned by slot a of cell k of level l, as keys sorted into fresh_:
+    // the later boxes of the cell, its forward neighbors and the boxes of
+    // finer levels within reach
+    void collect(size_t l, size_t k, uint32_t a, const Bucket (&neighbors)[4], size_t num_neighbors) {
+        const Grid &grid = levels_[l].grid;
+        const BoxSoA &soa = grid.boxes;
+        const Bucket &bucket = grid.buckets[k];
+        found_.clear();
+        test_range(soa, a, soa, a + 1, bucket.begin + bucket.count, hits_, found_, nullptr);
+        for (size_t n = 0; n < num_neighbors; ++n) {
+            test_range(soa, a, soa, neighbors[n].begin, neighbors[n].begin + neighbors[n].count, hits_, found_,
+                       nullptr);
+        }
+        for (size_t m = 0; m < l; ++m) {
+            const Grid &fine = levels_[m].grid;
+            visit_fine_buckets(fine, levels_[m].cell_size, soa, a, [&](const Bucket &nb) {
+                test_range(soa, a, fine.boxes, nb.begin, nb.begin + nb.count, hits_, found_, nullptr);
+            });
+        }
+        const size_t first = fresh_.size();
+        for (const Pair &p : found_) fresh_.push_back(pair_key(p.first, p.second));
+        std::sort(fresh_.begin() + first, fresh_.end());
+    }
+
+    // Recollects the owned pairs of every box in a marked cell and toggles the
+    // keys that left or entered its list; the other boxes keep their lists
+    void retest(bool all) {
+        const uint32_t n = static_cast<uint32_t>(boxes_.size());
+        fresh_.clear();
+        fresh_at_.assign(n, kNotRetested);
+        fresh_end_.resize(n);
+        Bucket neighbors[4];
+        CellCoord offsets[4];
+        for (size_t l = 0; l < levels_.size(); ++l) {
+            const Grid &grid = levels_[l].grid;
+            for (size_t k = 0; k < grid.cells.size(); ++k) {
+                if (!dirty_[l][k]) continue;
+                const size_t num_neighbors = forward_buckets(grid, k, neighbors, offsets);
+                const Bucket &bucket = grid.buckets[k];
+                for (uint32_t a = bucket.begin; a < bucket.begin + bucket.count; ++a) {
+                    const uint32_t i = members_[l][grid.order[a]];
+                    fresh_at_[i] = static_cast<uint32_t>(fresh_.size());
+                    collect(l, k, a, neighbors, num_neighbors);
+                    fresh_end_[i] = static_cast<uint32_t>(fresh_.size());
+                }
+            }
+        }
+
+        // Owned lists of the frame; after a rebuild the old ones belong to
+        // other boxes, so all their keys go and all the new ones come
+        next_offsets_.resize(size_t(n) + 1);
+        next_offsets_[0] = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            const size_t len = fresh_at_[i] != kNotRetested ? fresh_end_[i] - fresh_at_[i]
+                                                            : offsets_[i + 1] - offsets_[i];
+            next_offsets_[i + 1] = next_offsets_[i] + len;
+        }
+        next_owned_.resize(next_offsets_[n]);
+        removed_.clear();
+        added_.clear();
+        if (all) {
+            removed_.swap(owned_);
+            for (uint32_t i = 0; i < n; ++i) {
+                std::copy(fresh_.begin() + fresh_at_[i], fresh_.begin() + fresh_end_[i],
+                          next_owned_.begin() + next_offsets_[i]);
+            }
+            added_ = next_owned_;
+        } else {
+            for (uint32_t i = 0; i < n; ++i) {
+                const auto old_begin = owned_.begin() + offsets_[i];
+                const auto old_end = owned_.begin() + offsets_[i + 1];
+                if (fresh_at_[i] == kNotRetested) {
+                    std::copy(old_begin, old_end, next_owned_.begin() + next_offsets_[i]);
+                    continue;
+                }
+                const auto new_begin = fresh_.begin() + fresh_at_[i];
+                const auto new_end = fresh_.begin() + fresh_end_[i];
+                std::copy(new_begin, new_end, next_owned_.begin() + next_offsets_[i]);
+                std::set_difference(old_begin, old_end, new_begin, new_end, std::back_inserter(removed_));
+                std::set_difference(new_begin, new_end, old_begin, old_end, std::back_inserter(added_));
+            }
+        }
+        owned_.swap(next_owned_);
+        offsets_.swap(next_offsets_);
+
+        // A pair that changed owner leaves one list and enters another, so
+        // every removal goes before the insertions
+        for (const uint64_t k : removed_) {
+            if (pairs_.erase(k)) toggled_.push_back(k);
+        }
+        for (const uint64_t k : added_) {
+            if (pairs_.insert(k)) toggled_.push_back(k);
+        }
+    }
+
+    bool built_ = false;
+    std::vector<AABB> boxes_;
+    std::vector<AABB> prev_boxes_;                  // boxes of the previous update()
+    std::vector<int> cell_sizes_;
+    std::vector<GridLevel> levels_;
+    std::vector<std::vector<uint32_t>> members_;    // box index of each span position of a level
+    std::vector<std::vector<AABB>> member_boxes_;   // boxes of each level, the span of its grid
+    std::vector<uint32_t> changed_;                 // boxes that differ from the previous frame
+    std::vector<std::vector<uint8_t>> dirty_;       // cells of each level to re-test
+    std::vector<uint64_t> owned_;                   // sorted pair keys owned by each box, box by box
+    std::vector<size_t> offsets_;                   // box i owns owned_[offsets_[i], offsets_[i + 1])
+    std::vector<uint64_t> fresh_;                   // lists recollected this frame
+    std::vector<uint32_t> fresh_at_, fresh_end_;    // box i's range of fresh_, or kNotRetested
+    std::vector<uint64_t> next_owned_;
+    std::vector<size_t> next_offsets_;
+    std::vector<uint64_t> removed_, added_;         // keys leaving and entering the lists this frame
+    std::vector<Pair> found_;
+    std::vector<uint32_t> hits_;
+    PairSet pairs_;                                 // pairs overlapping now
+    std::vector<uint64_t> toggled_;                 // pairs that entered or left pairs_ since the last query
+};
+
+} // namespace
+
+std::unique_ptr<BroadPhase> make_broad_phase(BroadPhaseMethod method) {
+    if (method == BroadPhaseMethod::SortAndSweep) return std::make_unique<IncrementalSortAndSweep>();
+    return std::make_unique<IncrementalSpatialHashing>();
+}
+
+} // namespace aabb
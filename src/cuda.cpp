@@ -1,25 +1,92 @@
 // CUDA implementation to find all intersecting AABB pairs
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <chrono>
+#include <cstdlib>
 
 #include "cuda_sort_and_sweep.cuh"
 #include "cuda_spatial_hashing.cuh"
+#include "cuda_bvh.cuh"
+#include "cuda_bruteforce.cuh"
+#include "cuda_hybrid.cuh"
+#include "cuda_multi_gpu.cuh"
 #include "aabb_io.h"
+#include "cuda_context.cuh"
+#include "engine_select.h"
+#include "phase_timer.h"
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <algorithm> <testcase number>\n";
-        std::cerr << "  algorithm: SS (Sort-and-Sweep) or SH (Spatial Hashing)\n";
+        std::cerr << "Usage: " << argv[0] << " <algorithm> <testcase number> [--format text|bin|varint] [--stream] [--axis x|y|auto|pca] [--repeat N] [--unsorted] [--gpus N] [--slabs N] [--quantize] [--hybrid]\n";
+        std::cerr << "  algorithm: SS (Sort-and-Sweep), SH (Spatial Hashing), BVH (LBVH), BF (tiled brute force) or AUTO (SS or SH from sampled scene statistics)\n";
+        std::cerr << "  --stream: write pairs as they are downloaded instead of collecting them first\n";
+        std::cerr << "  --axis:   SS sweep axis; auto samples the boxes and picks x or y (default: auto)\n";
+        std::cerr << "  --repeat: run the detection N times on one CUDA context and report cold and warm calls\n";
+        std::cerr << "  --unsorted: keep the SS device output order instead of sorting the pairs\n";
+        std::cerr << "  --gpus:   split SS or SH into slabs over N GPUs (0 = all visible)\n";
+        std::cerr << "  --slabs:  number of slabs for --gpus (default: one per GPU)\n";
+        std::cerr << "  --hybrid: split SS or SH between the CPU threads and the GPU by measured throughput\n";
+        std::cerr << "  --quantize: SH stages int16 coordinates in the pair kernel and re-checks hits on the floats\n";
         return 1;
     }
 
+    // Optional flags after the positional arguments
+    aabb::PairFormat out_format = aabb::PairFormat::Text;
+    bool stream = false;
+    CudaSortAndSweepOptions ss_options;
+    aabb::AxisEstimate ss_axis;
+    ss_options.report = &ss_axis;
+    unsigned repeat = 1;
+    bool multi_gpu = false;
+    MultiGpuOptions mg_options;
+    std::vector<MultiGpuSlab> mg_report;
+    mg_options.report = &mg_report;
+    CudaSpatialHashingOptions sh_options;
+    aabb::QuantizationStats quant;
+    bool hybrid = false;
+    HybridOptions hy_options;
+    HybridThroughput hy_throughput;
+    HybridReport hy_report;
+    hy_options.throughput = &hy_throughput;
+    hy_options.report = &hy_report;
+    for (int i = 3; i < argc; ++i) {
+        const std::string opt = argv[i];
+        if (opt == "--format" && i + 1 < argc && aabb::parse_pair_format(argv[i + 1], out_format)) {
+            ++i;
+        } else if (opt == "--stream") {
+            stream = true;
+        } else if (opt == "--unsorted") {
+            ss_options.order = aabb::PairOrder::Engine;
+            mg_options.order = aabb::PairOrder::Engine;
+            hy_options.order = aabb::PairOrder::Engine;
+        } else if (opt == "--gpus" && i + 1 < argc) {
+            multi_gpu = true;
+            mg_options.devices = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+        } else if (opt == "--slabs" && i + 1 < argc) {
+            multi_gpu = true;
+            mg_options.slabs = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (opt == "--hybrid") {
+            hybrid = true;
+        } else if (opt == "--quantize") {
+            sh_options.quantized = true;
+            sh_options.quant_report = &quant;
+        } else if (opt == "--axis" && i + 1 < argc && aabb::parse_sweep_axis(argv[i + 1], ss_options.axis)) {
+            ++i;
+        } else if (opt == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1u, static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10)));
+        } else {
+            std::cerr << "Unknown option: " << opt << '\n';
+            return 1;
+        }
+    }
+
     // Prepare file paths
     std::string algorithm = argv[1];
     std::string testcase = argv[2];
-    std::string in_path = "testcase/" + testcase + ".in";
+    std::string in_path = aabb::testcase_input_path(testcase);
     std::string out_path = "out/" + testcase + "_cuda.out";
 
     // Read boxes from input file
@@ -32,32 +99,191 @@ int main(int argc, char **argv) {
     std::cout << "Loaded " << boxes.size() << " boxes from " << in_path << "\n";
     const uint32_t N = static_cast<uint32_t>(boxes.size());
 
+    if (algorithm != "SS" && algorithm != "SH" && algorithm != "BVH" && algorithm != "BF" && algorithm != "AUTO") {
+        std::cerr << "Unknown algorithm: " << algorithm << '\n';
+        std::cerr << "Valid options are: SS, SH, BVH, BF, AUTO\n";
+        return 4;
+    }
+
+    // This binary only runs the GPU engines; a scene the CPU would handle
+    // faster is still run here, with a note
+    if (algorithm == "AUTO") {
+        const aabb::SceneStats scene = aabb::measure_scene(boxes);
+        const aabb::EngineChoice choice = aabb::choose_engine(scene, aabb::CudaContext::shared().ok());
+        algorithm = choice.kind == aabb::EngineKind::SpatialHashing ? "SH" : "SS";
+        std::cout << "AUTO picked " << aabb::describe_choice(scene, choice) << "\n";
+        if (!choice.gpu) {
+            std::cout << "AUTO: below " << aabb::kGpuMinBoxes
+                      << " boxes bin/seq " << aabb::engine_name(choice) << " is expected to be faster\n";
+        }
+    }
+
+    // The slabs cut the axis an SS run would sweep along when it is fixed
+    if (multi_gpu) {
+        if (algorithm == "BVH" || algorithm == "BF") {
+            std::cerr << "--gpus and --slabs support SS and SH only\n";
+            return 4;
+        }
+        mg_options.engine = algorithm == "SS" ? MultiGpuEngine::SortAndSweep : MultiGpuEngine::SpatialHashing;
+        mg_options.axis = ss_options.axis;
+    }
+    // Small scenes stay on the CPU inside the hybrid call, which bin/cuda
+    // reports rather than overrides
+    if (hybrid) {
+        if (multi_gpu || (algorithm != "SS" && algorithm != "SH")) {
+            std::cerr << "--hybrid supports single-GPU SS and SH only\n";
+            return 4;
+        }
+        hy_options.engine = algorithm == "SS" ? aabb::EngineKind::SortAndSweep : aabb::EngineKind::SpatialHashing;
+        hy_options.axis = ss_options.axis;
+    }
+    if (sh_options.quantized && (multi_gpu || hybrid || algorithm != "SH")) {
+        std::cerr << "--quantize supports single-GPU SH only\n";
+        return 4;
+    }
+
+    // Streaming mode: downloaded pairs go straight into the writer
+    aabb::PairWriter writer;
+    if (stream && !writer.open(out_path, out_format, err)) {
+        std::cerr << "Failed to write pairs: " << err << '\n';
+        return 3;
+    }
+
+    // With --repeat, the calls before the measured one only count pairs. The
+    // first of them pays for the CUDA context and the first allocations.
+    std::vector<double> call_seconds;
+    for (unsigned r = 1; r < repeat; ++r) {
+        aabb::CountingPairSink counter;
+        auto call_start = std::chrono::high_resolution_clock::now();
+        if (multi_gpu) {
+            cuda_multi_gpu(N, boxes, counter, mg_options);
+        } else if (hybrid) {
+            cuda_hybrid(N, boxes, counter, hy_options);
+        } else if (algorithm == "SS") {
+            cuda_sort_and_sweep(N, boxes, counter, ss_options);
+        } else if (algorithm == "BVH") {
+            cuda_bvh(N, boxes, counter);
+        } else if (algorithm == "BF") {
+            cuda_brute_force(N, boxes, counter);
+        } else {
+            cuda_spatial_hashing(N, boxes, counter, sh_options);
+        }
+        auto call_end = std::chrono::high_resolution_clock::now();
+        call_seconds.push_back(std::chrono::duration<double>(call_end - call_start).count());
+    }
+
     // ----------- Detection start ------------
+    // The engines time their phases into this recorder; their sum is the
+    // computation time (the upload counts as Build, the vector API's final
+    // sort is left out)
+    aabb::PhaseTimes phase_times;
+    aabb::set_phase_recorder(&phase_times);
     auto start = std::chrono::high_resolution_clock::now();
 
     std::vector<std::pair<uint32_t, uint32_t>> pairs;
-    if (algorithm == "SS") {
-        pairs = cuda_sort_and_sweep(N, boxes);
-    } else if (algorithm == "SH") {
-        pairs = cuda_spatial_hashing(N, boxes);
+    if (stream) {
+        if (multi_gpu) {
+            cuda_multi_gpu(N, boxes, writer, mg_options);
+        } else if (hybrid) {
+            cuda_hybrid(N, boxes, writer, hy_options);
+        } else if (algorithm == "SS") {
+            cuda_sort_and_sweep(N, boxes, writer, ss_options);
+        } else if (algorithm == "BVH") {
+            cuda_bvh(N, boxes, writer);
+        } else if (algorithm == "BF") {
+            cuda_brute_force(N, boxes, writer);
+        } else {
+            cuda_spatial_hashing(N, boxes, writer, sh_options);
+        }
+        if (!writer.close(err)) {
+            std::cerr << "Failed to write pairs: " << err << '\n';
+            return 3;
+        }
+    } else if (multi_gpu) {
+        pairs = cuda_multi_gpu(N, boxes, mg_options);
+    } else if (hybrid) {
+        pairs = cuda_hybrid(N, boxes, hy_options);
+    } else if (algorithm == "SS") {
+        pairs = cuda_sort_and_sweep(N, boxes, ss_options);
+    } else if (algorithm == "BVH") {
+        pairs = cuda_bvh(N, boxes);
+    } else if (algorithm == "BF") {
+        pairs = cuda_brute_force(N, boxes);
     } else {
-        std::cerr << "Unknown algorithm: " << algorithm << '\n';
-        std::cerr << "Valid options are: SS, SH\n";
-        return 4;
+        pairs = cuda_spatial_hashing(N, boxes, sh_options);
     }
 
     auto end = std::chrono::high_resolution_clock::now();
+    aabb::set_phase_recorder(nullptr);
     std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Algorithm: CUDA " << (algorithm == "SS" ? "Sort-and-Sweep" : "Spatial Hashing")
-              << ", Time elapsed: " << elapsed.count() << " seconds\n";
+    const char *algorithm_name = algorithm == "SS" ? "Sort-and-Sweep" : algorithm == "BVH" ? "LBVH"
+                                 : algorithm == "BF" ? "Brute Force" : "Spatial Hashing";
+    std::cout << "Algorithm: CUDA " << (multi_gpu ? "multi-GPU " : hybrid ? "hybrid " : "") << algorithm_name
+              << ", Time elapsed: " << elapsed.count() << " seconds"
+              << (stream ? " (including streamed output)" : "") << "\n";
+    double computation_seconds = 0.0;
+    for (aabb::Phase phase : {aabb::Phase::Build, aabb::Phase::Sort, aabb::Phase::Sweep, aabb::Phase::Scatter}) {
+        computation_seconds += phase_times.seconds[static_cast<size_t>(phase)];
+    }
+    std::cout << "Computation Time: " << computation_seconds << " seconds\n";
+    if (repeat > 1) {
+        call_seconds.push_back(elapsed.count());
+        double warm = 0.0;
+        for (size_t r = 1; r < call_seconds.size(); ++r) warm += call_seconds[r];
+        warm /= static_cast<double>(call_seconds.size() - 1);
+        const aabb::CudaContext &context = aabb::CudaContext::shared();
+        std::cout << "Cold call: " << call_seconds[0] << " seconds (context init "
+                  << context.init_seconds() << " seconds), warm calls: " << warm
+                  << " seconds on average over " << call_seconds.size() - 1 << "\n";
+        std::cout << "Device allocations: " << context.num_allocations() << ", reserved "
+                  << context.device_bytes_reserved() << " bytes\n";
+    }
+    if (multi_gpu) {
+        size_t halo = 0;
+        for (const MultiGpuSlab &slab : mg_report) halo += slab.halo;
+        std::cout << "Slabs: " << mg_report.size() << " along "
+                  << (mg_report.empty() ? "-" : aabb::sweep_axis_name(mg_report[0].axis))
+                  << ", halo copies " << halo << "\n";
+        for (size_t s = 0; s < mg_report.size(); ++s) {
+            const MultiGpuSlab &slab = mg_report[s];
+            std::cout << "  slab " << s << " [" << slab.begin << ", " << slab.end << ") device "
+                      << slab.device << ": " << slab.boxes << " boxes (" << slab.halo << " halo), "
+                      << slab.candidates << " candidates, " << slab.pairs << " owned pairs, "
+                      << slab.seconds << " seconds\n";
+        }
+    } else if (hybrid && !hy_report.gpu_used) {
+        std::cout << "Hybrid: CPU only (" << N << " boxes, GPU from " << hy_options.min_gpu_boxes << "), "
+                  << hy_report.cpu_seconds << " seconds\n";
+    } else if (hybrid) {
+        std::cout << "Hybrid: split at " << hy_report.split << " along " << aabb::sweep_axis_name(hy_report.axis)
+                  << ", GPU share " << hy_report.gpu_share << ", halo copies " << hy_report.halo << "\n"
+                  << "  CPU: " << hy_report.cpu_boxes << " boxes, " << hy_report.cpu_pairs << " pairs, "
+                  << hy_report.cpu_seconds << " seconds\n"
+                  << "  GPU: " << hy_report.gpu_boxes << " boxes, " << hy_report.gpu_pairs << " owned pairs, "
+                  << hy_report.gpu_seconds << " seconds\n";
+    } else if (algorithm == "SS") {
+        std::cout << "Sweep axis: " << aabb::sweep_axis_name(ss_axis.axis)
+                  << ", estimated candidates x=" << static_cast<uint64_t>(ss_axis.candidates_x)
+                  << " y=" << static_cast<uint64_t>(ss_axis.candidates_y);
+        if (ss_axis.candidates_pca >= 0.0) {
+            std::cout << " pca=" << static_cast<uint64_t>(ss_axis.candidates_pca);
+        }
+        std::cout << " (sample " << ss_axis.sample_size << ")\n";
+    } else if (sh_options.quantized) {
+        std::cout << "Quantized: " << quant.boxes << " boxes, tile columns " << quant.float_bytes
+                  << " -> " << quant.quantized_bytes << " bytes, candidates " << quant.candidates
+                  << ", false positives " << quant.false_positives << " ("
+                  << 100.0 * quant.false_positive_rate() << "%)\n";
+    }
     // ----------- Detection end ------------
 
     // Write output pairs to file
-    if (!aabb::write_pairs(out_path, pairs, err)) {
+    if (!stream && !aabb::write_pairs(out_path, pairs, out_format, err)) {
         std::cerr << "Failed to write pairs: " << err << '\n';
         return 3;
     }
 
-    std::cout << "Read " << N << " boxes, found " << pairs.size() << " pairs. Wrote: " << out_path << "\n";
+    const uint64_t num_pairs = stream ? writer.count() : pairs.size();
+    std::cout << "Read " << N << " boxes, found " << num_pairs << " pairs. Wrote: " << out_path << "\n";
     return 0;
 }
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <vector>
+#include <cuda_runtime.h>
+#include <iostream>
+
+#include "cuda_bruteforce.cuh"
+#include "cuda_pair_stream.cuh"
+#include "engine_stats.h"
+
+namespace {
+
+struct DeviceAABB {
+    int id;
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+};
+
+// Boxes per tile side; one thread per row box, one block per tile
+constexpr uint32_t kTile = 256;
+
+// Most blocks per launch (the grid's x limit)
+constexpr uint64_t kMaxBlocksPerLaunch = (uint64_t(1) << 31) - 1;
+
+// Row and column tile of upper-triangle tile k, numbered column by column:
+// column bj holds rows 0..bj, starting at tile bj * (bj + 1) / 2. The square
+// root is only a first guess, corrected for its rounding.
+__device__ inline void triangle_tile(uint64_t k, uint32_t& bi, uint32_t& bj) {
+    uint64_t c = (uint64_t)((sqrt(8.0 * (double)k + 1.0) - 1.0) * 0.5);
+    while (c * (c + 1) / 2 > k) --c;
+    while ((c + 1) * (c + 2) / 2 <= k) ++c;
+    bj = (uint32_t)c;
+    bi = (uint32_t)(k - c * (c + 1) / 2);
+}
+
+// One block per tile of the upper triangle (tile first + blockIdx.x in
+// triangle_tile order), so no block is launched below the diagonal. The
+// column boxes are staged in shared memory as columns, each thread holds its
+// row box in registers and tests it against the whole tile. The loop bound
+// depends only on the tile, so the warps stay converged for the ballots; the
+// diagonal tiles mask out j <= i.
+__global__ void brute_force_kernel(
+    const DeviceAABB* boxes, uint32_t N, uint64_t first, const aabb::PairOutput out)
+{
+    uint32_t bi, bj;
+    triangle_tile(first + blockIdx.x, bi, bj);
+
+    __shared__ float s_min_x[kTile];
+    __shared__ float s_min_y[kTile];
+    __shared__ float s_max_x[kTile];
+    __shared__ float s_max_y[kTile];
+    __shared__ uint32_t s_id[kTile];
+
+    const uint32_t j0 = bj * kTile;
+    const uint32_t j = j0 + threadIdx.x;
+    if (j < N) {
+        const DeviceAABB b = boxes[j];
+        s_min_x[threadIdx.x] = b.min_x;
+        s_min_y[threadIdx.x] = b.min_y;
+        s_max_x[threadIdx.x] = b.max_x;
+        s_max_y[threadIdx.x] = b.max_y;
+        s_id[threadIdx.x] = (uint32_t)b.id;
+    }
+    __syncthreads();
+
+    const uint32_t i = bi * kTile + threadIdx.x;
+    const bool valid = i < N;
+    DeviceAABB a{};
+    if (valid) a = boxes[i];
+    const uint32_t len = min(kTile, N - j0);
+    for (uint32_t t = 0; t < len; ++t) {
+        // inclusive overlap: [lo, hi] intersects
+        const bool hit = valid && j0 + t > i &&
+                         !(a.max_x < s_min_x[t] || s_max_x[t] < a.min_x ||
+                           a.max_y < s_min_y[t] || s_max_y[t] < a.min_y);
+        aabb::warp_emit(hit, (uint32_t)a.id, s_id[t], out);
+    }
+}
+
+bool check_cuda(cudaError_t err, const char* msg) {
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_bf] CUDA error: " << msg << " : " << cudaGetErrorString(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Scratch buffers of the context used by this engine
+enum BruteForceBuffer : size_t {
+    kBoxesBuffer,
+    kPairCountBuffer,
+    kPairsBuffer,
+    kPairStagingBuffer,
+    kPairStagingAltBuffer,  // second staging buffer of the pair stream
+};
+
+} // namespace
+
+void cuda_brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    aabb::CudaContext& context)
+{
+    if (N < 2) return;
+    if (!context.activate()) {
+        std::cerr << "[cuda_bf] no CUDA context: " << context.error() << "\n";
+        return;
+    }
+    cudaStream_t stream = context.stream();
+    aabb::CudaPhaseTimer phases(context);
+    phases.mark(aabb::Phase::Build);
+
+    // Uploaded in chunks, each copy overlapping the conversion of the next
+    DeviceAABB* h_boxes = context.host<DeviceAABB>(kBoxesBuffer, N);
+    DeviceAABB* d_boxes = context.device<DeviceAABB>(kBoxesBuffer, N);
+    if (!h_boxes || !d_boxes) return;
+    for (uint32_t first = 0; first < N; first += aabb::CudaContext::kUploadChunk) {
+        const uint32_t last = std::min(N, first + aabb::CudaContext::kUploadChunk);
+        for (uint32_t i = first; i < last; ++i) {
+            const auto& b = boxes[i];
+            h_boxes[i] = DeviceAABB{b.id, b.min_x, b.min_y, b.max_x, b.max_y};
+        }
+        cudaMemcpyAsync(d_boxes + first, h_boxes + first, (last - first) * sizeof(DeviceAABB),
+                        cudaMemcpyHostToDevice, stream);
+    }
+    if (!check_cuda(cudaStreamSynchronize(stream), "upload boxes")) return;
+
+    // Single pass, rerun with a larger buffer if the pairs overflow it
+    phases.mark(aabb::Phase::Sweep);
+    const uint64_t tiles = (N + kTile - 1) / kTile;
+    const uint64_t num_tiles = tiles * (tiles + 1) / 2;
+    aabb::PairOutput out{};
+    uint64_t total_pairs = 0;
+    auto launch = [&](const aabb::PairOutput& output) {
+        for (uint64_t first = 0; first < num_tiles; first += kMaxBlocksPerLaunch) {
+            const uint32_t grid = (uint32_t)std::min(kMaxBlocksPerLaunch, num_tiles - first);
+            brute_force_kernel<<<grid, kTile, 0, stream>>>(d_boxes, N, first, output);
+        }
+    };
+    if (!aabb::run_single_pass(context, kPairsBuffer, kPairCountBuffer, N, "cuda_bf", launch, out, total_pairs)) {
+        return;
+    }
+    if (aabb::EngineStats* stats = aabb::stats_recorder()) {
+        stats->pairs_tested += uint64_t(N) * (N - 1) / 2;
+        stats->pairs_hit += total_pairs;
+    }
+
+    // Download in chunks; the sink consumes one chunk while the next copies
+    phases.mark(aabb::Phase::Scatter);
+    if (total_pairs > 0) {
+        aabb::CudaPairStream download(context, sink, kPairStagingBuffer);
+        if (!download.push(out.pairs, 0, total_pairs) || !download.finish()) return;
+    }
+    phases.finish();
+}
+
+void cuda_brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink)
+{
+    cuda_brute_force(N, boxes, sink, aabb::CudaContext::shared());
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    cuda_brute_force(N, boxes, sink);
+    return pairs;
+}
@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <vector>
+#include <cuda_runtime.h>
+#include <thrust/device_ptr.h>
+#include <thrust/execution_policy.h>
+#include <thrust/sort.h>
+#include <thrust/scan.h>
+#include <iostream>
+
+#include "cuda_bvh.cuh"
+#include "cuda_pair_stream.cuh"
+#include "engine_stats.h"
+
+namespace {
+
+struct DeviceAABB {
+    int id;
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+};
+
+// Internal node of the radix tree. It covers the sorted leaves [first, last];
+// a child >= 0 is an internal node, a child < 0 is the leaf ~child.
+struct InternalNode {
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+    int left;
+    int right;
+    uint32_t first;
+    uint32_t last;
+};
+
+// Deepest tree the traversal stack holds (30 code bits + 32 index bits)
+constexpr int kStackSize = 64;
+
+__device__ inline bool intersects_device(
+    float a_min_x, float a_min_y, float a_max_x, float a_max_y, const DeviceAABB& b)
+{
+    return !(a_max_x < b.min_x || b.max_x < a_min_x || a_max_y < b.min_y || b.max_y < a_min_y);
+}
+
+// Spread the low 15 bits of v to the even bit positions
+__device__ inline uint32_t expand_bits(uint32_t v) {
+    v &= 0x7FFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+// Same codes as the CPU engine: one scale for both axes
+__global__ void morton_codes_kernel(
+    const DeviceAABB* boxes, uint32_t N, float lo_x, float lo_y, float inv,
+    uint32_t* codes, uint32_t* indices)
+{
+    uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= N) return;
+    const DeviceAABB& b = boxes[idx];
+    const float fx = fminf(fmaxf(((b.min_x + b.max_x) * 0.5f - lo_x) * inv, 0.0f), 1.0f);
+    const float fy = fminf(fmaxf(((b.min_y + b.max_y) * 0.5f - lo_y) * inv, 0.0f), 1.0f);
+    const uint32_t ix = min((uint32_t)(fx * 32768.0f), 32767u);
+    const uint32_t iy = min((uint32_t)(fy * 32768.0f), 32767u);
+    codes[idx] = (expand_bits(ix) << 1) | expand_bits(iy);
+    indices[idx] = idx;
+}
+
+__global__ void gather_boxes_kernel(
+    const DeviceAABB* boxes, const uint32_t* indices, uint32_t N, DeviceAABB* sorted)
+{
+    uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= N) return;
+    sorted[idx] = boxes[indices[idx]];
+}
+
+// Length of the common prefix of the keys (code, index) of leaves i and j,
+// -1 outside [0, N)
+__device__ inline int common_prefix(const uint32_t* codes, int N, int i, int j) {
+    if (j < 0 || j >= N) return -1;
+    const uint32_t a = codes[i];
+    const uint32_t b = codes[j];
+    if (a == b) return 32 + __clz((uint32_t)i ^ (uint32_t)j);
+    return __clz(a ^ b);
+}
+
+// Karras 2012: internal node i finds its range and split independently
+__global__ void build_tree_kernel(
+    const uint32_t* codes, int N, InternalNode* nodes, int* internal_parent, int* leaf_parent)
+{
+    const int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i >= N - 1) return;
+
+    // Direction of the range and its maximal extent
+    const int d = (common_prefix(codes, N, i, i + 1) - common_prefix(codes, N, i, i - 1)) >= 0 ? 1 : -1;
+    const int min_prefix = common_prefix(codes, N, i, i - d);
+    int max_len = 2;
+    while (common_prefix(codes, N, i, i + max_len * d) > min_prefix) max_len *= 2;
+    int len = 0;
+    for (int t = max_len / 2; t >= 1; t /= 2) {
+        if (common_prefix(codes, N, i, i + (len + t) * d) > min_prefix) len += t;
+    }
+    const int j = i + len * d;
+
+    // Split position: the last leaf sharing more than the node prefix with i
+    const int node_prefix = common_prefix(codes, N, i, j);
+    int s = 0;
+    int t = len;
+    do {
+        t = (t + 1) / 2;
+        if (common_prefix(codes, N, i, i + (s + t) * d) > node_prefix) s += t;
+    } while (t > 1);
+    const int gamma = i + s * d + min(d, 0);
+
+    const int first = min(i, j);
+    const int last = max(i, j);
+    InternalNode& node = nodes[i];
+    node.first = (uint32_t)first;
+    node.last = (uint32_t)last;
+    if (first == gamma) {
+        node.left = ~gamma;
+        leaf_parent[gamma] = i;
+    } else {
+        node.left = gamma;
+        internal_parent[gamma] = i;
+    }
+    if (last == gamma + 1) {
+        node.right = ~(gamma + 1);
+        leaf_parent[gamma + 1] = i;
+    } else {
+        node.right = gamma + 1;
+        internal_parent[gamma + 1] = i;
+    }
+}
+
+// Bottom-up bounds: one thread per leaf walks towards the root; the second
+// thread to reach a node (both children done) computes its bounds and goes on
+__global__ void compute_bounds_kernel(
+    const DeviceAABB* leaves, int N, InternalNode* nodes,
+    const int* internal_parent, const int* leaf_parent, int* visits)
+{
+    const int k = blockIdx.x * blockDim.x + threadIdx.x;
+    if (k >= N) return;
+
+    int node = leaf_parent[k];
+    while (node >= 0) {
+        __threadfence();
+        if (atomicAdd(&visits[node], 1) == 0) return;
+
+        volatile InternalNode* n = nodes + node;
+        float min_x, min_y, max_x, max_y;
+        const int children[2] = {n->left, n->right};
+        for (int c = 0; c < 2; ++c) {
+            float cmin_x, cmin_y, cmax_x, cmax_y;
+            if (children[c] < 0) {
+                const DeviceAABB& b = leaves[~children[c]];
+                cmin_x = b.min_x; cmin_y = b.min_y; cmax_x = b.max_x; cmax_y = b.max_y;
+            } else {
+                volatile InternalNode* ch = nodes + children[c];
+                cmin_x = ch->min_x; cmin_y = ch->min_y; cmax_x = ch->max_x; cmax_y = ch->max_y;
+            }
+            if (c == 0) {
+                min_x = cmin_x; min_y = cmin_y; max_x = cmax_x; max_y = cmax_y;
+            } else {
+                min_x = fminf(min_x, cmin_x); min_y = fminf(min_y, cmin_y);
+                max_x = fmaxf(max_x, cmax_x); max_y = fmaxf(max_y, cmax_y);
+            }
+        }
+        n->min_x = min_x; n->min_y = min_y; n->max_x = max_x; n->max_y = max_y;
+        node = internal_parent[node];
+    }
+}
+
+// Calls visit(j) for every leaf j > i whose box overlaps leaf i; subtrees
+// that only hold leaves <= i are skipped, so each pair is visited once.
+// Returns the number of nodes popped.
+template <typename Visit>
+__device__ uint32_t for_each_later_overlap(
+    int i, const DeviceAABB* leaves, const InternalNode* nodes, Visit visit)
+{
+    const DeviceAABB& q = leaves[i];
+    int stack[kStackSize];
+    int top = 0;
+    uint32_t visited = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        ++visited;
+        const InternalNode& node = nodes[stack[--top]];
+        const int children[2] = {node.left, node.right};
+        for (int c = 0; c < 2; ++c) {
+            const int child = children[c];
+            if (child < 0) {
+                const int j = ~child;
+                if (j > i && intersects_device(q.min_x, q.min_y, q.max_x, q.max_y, leaves[j])) visit(j);
+            } else {
+                const InternalNode& ch = nodes[child];
+                if ((int)ch.last <= i) continue;
+                if (ch.max_x < q.min_x || q.max_x < ch.min_x ||
+                    ch.max_y < q.min_y || q.max_y < ch.min_y) continue;
+                if (top < kStackSize) stack[top++] = child;
+            }
+        }
+    }
+    return visited;
+}
+
+__global__ void count_pairs_kernel(
+    const DeviceAABB* leaves, int N, const InternalNode* nodes, uint64_t* counts, uint32_t* lane_work)
+{
+    const int i = blockIdx.x * blockDim.x + threadIdx.x;
+    if (i >= N) return;
+    uint64_t count = 0;
+    const uint32_t visited = for_each_later_overlap(i, leaves, nodes, [&](int) { ++count; });
+    counts[i] = count;
+    if (aabb::kStatsEnabled && lane_work) lane_work[i] = visited;
+}
+
+__global__ void scatter_pairs_kernel(
+    const DeviceAABB* leaves, int first, int end, const InternalNode* nodes,
+    const uint64_t* offsets, aabb::DevicePair* pairs)
+{
+    const int i = first + blockIdx.x * blockDim.x + threadIdx.x;
+    if (i >= end) return;
+    uint64_t pos = offsets[i];
+    const uint32_t id_i = (uint32_t)leaves[i].id;
+    for_each_later_overlap(i, leaves, nodes, [&](int j) {
+        const uint32_t id_j = (uint32_t)leaves[j].id;
+        pairs[pos] = make_uint2(min(id_i, id_j), max(id_i, id_j));
+        ++pos;
+    });
+}
+
+bool check_cuda(cudaError_t err, const char* msg) {
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_bvh] CUDA error: " << msg << " : " << cudaGetErrorString(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Scratch buffers of the context used by this engine
+enum BvhBuffer : size_t {
+    kBoxesBuffer,
+    kCodesBuffer,
+    kIndicesBuffer,
+    kLeavesBuffer,
+    kNodesBuffer,
+    kInternalParentBuffer,
+    kLeafParentBuffer,
+    kVisitsBuffer,
+    kCountsBuffer,
+    kOffsetsBuffer,
+    kPartBoundsBuffer,
+    kPairsBuffer,
+    kPairStagingBuffer,
+    kPairStagingAltBuffer,  // second staging buffer of the pair stream
+    kLaneWorkBuffer,
+};
+
+// Scatter launches over leaf ranges, so each range's pairs download while
+// the next range runs; small inputs use one launch
+constexpr int kScatterParts = 8;
+constexpr int kMinLeavesPerPart = 1 << 16;
+
+} // namespace
+
+void cuda_bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    aabb::CudaContext& context)
+{
+    if (N < 2) return;
+    if (!context.activate()) {
+        std::cerr << "[cuda_bvh] no CUDA context: " << context.error() << "\n";
+        return;
+    }
+    cudaStream_t stream = context.stream();
+    auto policy = thrust::cuda::par(context.thrust_allocator()).on(stream);
+    aabb::CudaPhaseTimer phases(context);
+    phases.mark(aabb::Phase::Build);
+
+    // Scene bounds of the box centers (host side; one pass over the input)
+    DeviceAABB* h_boxes = context.host<DeviceAABB>(kBoxesBuffer, N);
+    DeviceAABB* d_boxes = context.device<DeviceAABB>(kBoxesBuffer, N);
+    if (!h_boxes || !d_boxes) return;
+    float lo_x = boxes[0].min_x, lo_y = boxes[0].min_y;
+    float hi_x = lo_x, hi_y = lo_y;
+    // Uploaded in chunks, each copy overlapping the conversion of the next
+    for (uint32_t first = 0; first < N; first += aabb::CudaContext::kUploadChunk) {
+        const uint32_t last = std::min(N, first + aabb::CudaContext::kUploadChunk);
+        for (uint32_t i = first; i < last; ++i) {
+            const auto& b = boxes[i];
+            h_boxes[i] = DeviceAABB{b.id, b.min_x, b.min_y, b.max_x, b.max_y};
+            const float cx = (b.min_x + b.max_x) * 0.5f;
+            const float cy = (b.min_y + b.max_y) * 0.5f;
+            lo_x = std::min(lo_x, cx); hi_x = std::max(hi_x, cx);
+            lo_y = std::min(lo_y, cy); hi_y = std::max(hi_y, cy);
+        }
+        cudaMemcpyAsync(d_boxes + first, h_boxes + first, (last - first) * sizeof(DeviceAABB),
+                        cudaMemcpyHostToDevice, stream);
+    }
+    const float extent = std::max(hi_x - lo_x, hi_y - lo_y);
+    const float inv = extent > 0.0f ? 1.0f / extent : 0.0f;
+    if (!check_cuda(cudaStreamSynchronize(stream), "upload boxes")) return;
+
+    const int block = 256;
+    const int grid = (N + block - 1) / block;
+
+    uint32_t* d_codes = context.device<uint32_t>(kCodesBuffer, N);
+    uint32_t* d_indices = context.device<uint32_t>(kIndicesBuffer, N);
+    DeviceAABB* d_leaves = context.device<DeviceAABB>(kLeavesBuffer, N);
+    InternalNode* d_nodes = context.device<InternalNode>(kNodesBuffer, N - 1);
+    int* d_internal_parent = context.device<int>(kInternalParentBuffer, N - 1);
+    int* d_leaf_parent = context.device<int>(kLeafParentBuffer, N);
+    int* d_visits = context.device<int>(kVisitsBuffer, N - 1);
+    uint64_t* d_counts = context.device<uint64_t>(kCountsBuffer, N);
+    uint64_t* d_offsets = context.device<uint64_t>(kOffsetsBuffer, N);
+    if (!d_codes || !d_indices || !d_leaves || !d_nodes || !d_internal_parent ||
+        !d_leaf_parent || !d_visits || !d_counts || !d_offsets) {
+        return;
+    }
+
+    // Step 1: Morton codes, sorted together with the box indices
+    phases.mark(aabb::Phase::Sort);
+    morton_codes_kernel<<<grid, block, 0, stream>>>(d_boxes, N, lo_x, lo_y, inv, d_codes, d_indices);
+    thrust::sort_by_key(policy, thrust::device_ptr<uint32_t>(d_codes),
+                        thrust::device_ptr<uint32_t>(d_codes + N),
+                        thrust::device_ptr<uint32_t>(d_indices));
+    gather_boxes_kernel<<<grid, block, 0, stream>>>(d_boxes, d_indices, N, d_leaves);
+    if (!check_cuda(cudaStreamSynchronize(stream), "morton_codes_kernel")) return;
+
+    // Step 2: radix tree over the sorted codes, then bounds bottom-up
+    phases.mark(aabb::Phase::Build);
+    cudaMemsetAsync(d_internal_parent, 0xFF, (N - 1) * sizeof(int), stream);
+    cudaMemsetAsync(d_leaf_parent, 0xFF, N * sizeof(int), stream);
+    cudaMemsetAsync(d_visits, 0, (N - 1) * sizeof(int), stream);
+    const int grid_internal = (N - 1 + block - 1) / block;
+    build_tree_kernel<<<grid_internal, block, 0, stream>>>(
+        d_codes, (int)N, d_nodes, d_internal_parent, d_leaf_parent);
+    compute_bounds_kernel<<<grid, block, 0, stream>>>(
+        d_leaves, (int)N, d_nodes, d_internal_parent, d_leaf_parent, d_visits);
+    if (!check_cuda(cudaStreamSynchronize(stream), "build_tree_kernel")) return;
+
+    // Step 3: count, scan, scatter (no fixed-size output buffer)
+    phases.mark(aabb::Phase::Sweep);
+    // Nodes visited by every leaf's thread, only while stats are recorded
+    aabb::EngineStats* const stats = aabb::stats_recorder();
+    uint32_t* d_lane_work = stats ? context.device<uint32_t>(kLaneWorkBuffer, N) : nullptr;
+    count_pairs_kernel<<<grid, block, 0, stream>>>(d_leaves, (int)N, d_nodes, d_counts, d_lane_work);
+    thrust::exclusive_scan(policy, thrust::device_ptr<uint64_t>(d_counts),
+                           thrust::device_ptr<uint64_t>(d_counts + N),
+                           thrust::device_ptr<uint64_t>(d_offsets));
+    uint64_t* h_tail = context.host<uint64_t>(kCountsBuffer, 2);
+    if (!h_tail) return;
+    cudaMemcpyAsync(&h_tail[0], d_offsets + (N - 1), sizeof(uint64_t), cudaMemcpyDeviceToHost, stream);
+    cudaMemcpyAsync(&h_tail[1], d_counts + (N - 1), sizeof(uint64_t), cudaMemcpyDeviceToHost, stream);
+    if (!check_cuda(cudaStreamSynchronize(stream), "count_pairs_kernel")) return;
+    const uint64_t total_pairs = h_tail[0] + h_tail[1];
+    if (d_lane_work && !aabb::record_lane_work(context, kLaneWorkBuffer, d_lane_work, N, *stats)) return;
+    if (stats) stats->pairs_hit += total_pairs;
+
+    // Scatter in leaf ranges; the pairs of each range stream to the sink on
+    // the copy stream while the later ranges are still running
+    phases.mark(aabb::Phase::Scatter);
+    if (total_pairs > 0) {
+        aabb::DevicePair* d_pairs = context.device<aabb::DevicePair>(kPairsBuffer, total_pairs);
+        if (!d_pairs) return;
+
+        const int parts = std::max(1, std::min(kScatterParts, (int)N / kMinLeavesPerPart));
+        uint64_t* h_bounds = context.host<uint64_t>(kPartBoundsBuffer, parts + 1);
+        if (!h_bounds) return;
+        for (int k = 1; k < parts; ++k) {
+            cudaMemcpyAsync(&h_bounds[k], d_offsets + (uint64_t)N * k / parts, sizeof(uint64_t),
+                            cudaMemcpyDeviceToHost, stream);
+        }
+        if (!check_cuda(cudaStreamSynchronize(stream), "part bounds")) return;
+        h_bounds[0] = 0;
+        h_bounds[parts] = total_pairs;
+
+        aabb::CudaPairStream download(context, sink, kPairStagingBuffer);
+        for (int k = 0; k < parts; ++k) {
+            const int first = (int)((uint64_t)N * k / parts);
+            const int end = (int)((uint64_t)N * (k + 1) / parts);
+            scatter_pairs_kernel<<<(end - first + block - 1) / block, block, 0, stream>>>(
+                d_leaves, first, end, d_nodes, d_offsets, d_pairs);
+            if (!check_cuda(cudaGetLastError(), "scatter_pairs_kernel")) return;
+            if (!download.push(d_pairs, h_bounds[k], h_bounds[k + 1])) return;
+        }
+        if (!download.finish() || !check_cuda(cudaStreamSynchronize(stream), "scatter_pairs_kernel")) return;
+    }
+    phases.finish();
+}
+
+void cuda_bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink)
+{
+    cuda_bvh(N, boxes, sink, aabb::CudaContext::shared());
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    cuda_bvh(N, boxes, sink);
+    return pairs;
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include "cuda_context.cuh"
+#include "engine_stats.h"
+
+namespace aabb {
+
+// Smallest buffer the arena allocates; smaller requests share its growth steps
+static constexpr size_t kMinBlockBytes = size_t(1) << 16;
+
+CudaContext::CudaContext(int device) : device_index_(device), thrust_allocator_(*this) {
+    auto start = std::chrono::high_resolution_clock::now();
+    cudaError_t err = cudaGetDeviceCount(&device_count_);
+    if (err != cudaSuccess || device_count_ == 0) {
+        fail(err == cudaSuccess ? cudaErrorNoDevice : err, "cudaGetDeviceCount");
+        return;
+    }
+    if (device_index_ < 0 || device_index_ >= device_count_) {
+        fail(cudaErrorInvalidDevice, "device index");
+        return;
+    }
+    // cudaFree(0) forces the lazy runtime context creation to happen here
+    if ((err = cudaSetDevice(device_index_)) != cudaSuccess) {
+        fail(err, "cudaSetDevice");
+        return;
+    }
+    if ((err = cudaFree(0)) != cudaSuccess) {
+        fail(err, "context creation");
+        return;
+    }
+    if ((err = cudaStreamCreateWithFlags(&stream_, cudaStreamNonBlocking)) != cudaSuccess ||
+        (err = cudaStreamCreateWithFlags(&copy_stream_, cudaStreamNonBlocking)) != cudaSuccess) {
+        fail(err, "cudaStreamCreate");
+        return;
+    }
+    ok_ = true;
+    auto end = std::chrono::high_resolution_clock::now();
+    init_seconds_ = std::chrono::duration<double>(end - start).count();
+}
+
+CudaContext::~CudaContext() {
+    if (ok_) cudaSetDevice(device_index_);
+    if (stream_) cudaStreamSynchronize(stream_);
+    if (copy_stream_) cudaStreamSynchronize(copy_stream_);
+    for (Block& b : device_) cudaFree(b.ptr);
+    for (Block& b : host_) cudaFreeHost(b.ptr);
+    for (auto& entry : thrust_free_) cudaFree(entry.second);
+    for (auto& entry : thrust_used_) cudaFree(entry.first);
+    for (cudaEvent_t event : timing_events_) {
+        if (event) cudaEventDestroy(event);
+    }
+    if (copy_stream_) cudaStreamDestroy(copy_stream_);
+    if (stream_) cudaStreamDestroy(stream_);
+}
+
+CudaContext& CudaContext::shared() {
+    return for_device(0);
+}
+
+CudaContext& CudaContext::for_device(int device) {
+    static std::mutex mutex;
+    static std::map<int, std::unique_ptr<CudaContext>> contexts;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<CudaContext>& context = contexts[device];
+    if (!context) context.reset(new CudaContext(device));
+    return *context;
+}
+
+bool CudaContext::activate() {
+    if (!ok_) return false;
+    const cudaError_t err = cudaSetDevice(device_index_);
+    if (err != cudaSuccess) {
+        fail(err, "cudaSetDevice");
+        return false;
+    }
+    return true;
+}
+
+void CudaContext::fail(cudaError_t err, const char* what) {
+    ok_ = false;
+    error_ = std::string(what) + ": " + cudaGetErrorString(err);
+    std::cerr << "[cuda_context] CUDA error: " << error_ << "\n";
+}
+
+void* CudaContext::reserve(std::vector<Block>& blocks, size_t slot, size_t bytes, bool pinned) {
+    if (slot >= blocks.size()) blocks.resize(slot + 1);
+    Block& b = blocks[slot];
+    if (b.ptr && bytes <= b.bytes) return b.ptr;
+
+    // Grow geometrically; the old contents are scratch and are not copied
+    const size_t capacity = std::max({bytes, 2 * b.bytes, kMinBlockBytes});
+    if (stream_) cudaStreamSynchronize(stream_);
+    if (copy_stream_) cudaStreamSynchronize(copy_stream_);
+    if (pinned) {
+        cudaFreeHost(b.ptr);
+    } else {
+        cudaFree(b.ptr);
+        device_bytes_reserved_ -= b.bytes;
+    }
+    b = Block();
+
+    void* ptr = nullptr;
+    const cudaError_t err = pinned ? cudaHostAlloc(&ptr, capacity, cudaHostAllocDefault)
+                                   : cudaMalloc(&ptr, capacity);
+    ++num_allocations_;
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_context] CUDA error: " << (pinned ? "cudaHostAlloc" : "cudaMalloc")
+                  << " of " << capacity << " bytes : " << cudaGetErrorString(err) << "\n";
+        return nullptr;
+    }
+    b.ptr = ptr;
+    b.bytes = capacity;
+    if (!pinned) device_bytes_reserved_ += capacity;
+    return ptr;
+}
+
+cudaEvent_t CudaContext::timing_event(size_t index) {
+    if (index >= timing_events_.size()) timing_events_.resize(index + 1, nullptr);
+    cudaEvent_t& event = timing_events_[index];
+    if (!event && cudaEventCreate(&event) != cudaSuccess) event = nullptr;
+    return event;
+}
+
+CudaPhaseTimer::CudaPhaseTimer(CudaContext& context)
+    : context_(context), times_(phase_recorder()) {}
+
+void CudaPhaseTimer::mark(Phase phase) {
+    if (!times_ || !context_.ok()) return;
+    cudaEvent_t event = context_.timing_event(phases_.size());
+    if (!event || cudaEventRecord(event, context_.stream()) != cudaSuccess) {
+        times_ = nullptr;
+        return;
+    }
+    phases_.push_back(phase);
+}
+
+void CudaPhaseTimer::finish() {
+    if (!times_ || phases_.empty()) return;
+    const size_t n = phases_.size();
+    cudaEvent_t last = context_.timing_event(n);
+    if (last && cudaEventRecord(last, context_.stream()) == cudaSuccess &&
+        cudaEventSynchronize(last) == cudaSuccess) {
+        for (size_t i = 0; i < n; ++i) {
+            float ms = 0.0f;
+            if (cudaEventElapsedTime(&ms, context_.timing_event(i), context_.timing_event(i + 1)) == cudaSuccess) {
+                times_->add(phases_[i], ms * 1e-3);
+            }
+        }
+    }
+    phases_.clear();
+    times_ = nullptr;
+}
+
+bool record_lane_work(CudaContext& context, size_t slot, const uint32_t* lane_work, size_t num_lanes,
+                      EngineStats& stats) {
+    if (num_lanes == 0) return true;
+    uint32_t* h_lane_work = context.host<uint32_t>(slot, num_lanes);
+    if (!lane_work || !h_lane_work) return false;
+    cudaError_t err = cudaMemcpyAsync(h_lane_work, lane_work, num_lanes * sizeof(uint32_t),
+                                      cudaMemcpyDeviceToHost, context.stream());
+    if (err == cudaSuccess) err = cudaStreamSynchronize(context.stream());
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_context] CUDA error: lane work download : " << cudaGetErrorString(err) << "\n";
+        return false;
+    }
+    stats.warp_work.add_lanes(h_lane_work, num_lanes);
+    return true;
+}
+
+char* CudaContext::ThrustAllocator::allocate(std::ptrdiff_t bytes) {
+    const size_t n = static_cast<size_t>(bytes);
+    // Reuse the smallest cached block that fits
+    auto it = context_.thrust_free_.lower_bound(n);
+    if (it != context_.thrust_free_.end()) {
+        void* ptr = it->second;
+        context_.thrust_used_[ptr] = it->first;
+        context_.thrust_free_.erase(it);
+        return static_cast<char*>(ptr);
+    }
+
+    const size_t capacity = std::max(n, kMinBlockBytes);
+    void* ptr = nullptr;
+    ++context_.num_allocations_;
+    if (cudaMalloc(&ptr, capacity) != cudaSuccess) throw std::bad_alloc();
+    context_.device_bytes_reserved_ += capacity;
+    context_.thrust_used_[ptr] = capacity;
+    return static_cast<char*>(ptr);
+}
+
+void CudaContext::ThrustAllocator::deallocate(char* ptr, size_t) {
+    auto it = context_.thrust_used_.find(ptr);
+    if (it == context_.thrust_used_.end()) return;
+    context_.thrust_free_.emplace(it->second, it->first);
+    context_.thrust_used_.erase(it);
+}
+
+} // namespace aabb
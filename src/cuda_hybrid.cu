@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "cuda_hybrid.cuh"
+#include "cuda_context.cuh"
+#include "cuda_sort_and_sweep.cuh"
+#include "cuda_spatial_hashing.cuh"
+#include "radix_sort.h"
+#include "seq_sort_and_sweep_mt.h"
+#include "seq_spatial_hashing.h"
+#include "slab_partition.h"
+#include "thread_pool.h"
+
+// GPU share of the first call, before either side has been measured
+static constexpr double kHybridGpuPrior = 0.5;
+
+// The CPU side of a call, on the calling thread: the engine's own output goes
+// straight to the sink, the boxes keep their input ids
+static void run_cpu_side(aabb::BoxSpan boxes, aabb::PairSink& sink, const HybridOptions& options,
+                         unsigned threads) {
+    if (options.engine == aabb::EngineKind::SortAndSweep) {
+        SortAndSweepOptions ss_options;
+        ss_options.axis = options.axis;
+        ss_options.threads = threads;
+        sort_and_sweep_mt(static_cast<uint32_t>(boxes.size()), boxes, sink, ss_options);
+    } else {
+        SpatialHashingOptions sh_options;
+        sh_options.threads = threads;
+        spatial_hashing_mt(boxes, sink, sh_options);
+    }
+}
+
+static double seconds_since(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void cuda_hybrid(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const HybridOptions& options)
+{
+    HybridReport report;
+    if (options.report) *options.report = report;
+    if (N == 0) return;
+    const unsigned hardware = aabb::resolve_threads(0);
+
+    // Small scenes, and machines without a GPU, stay on the thread pool; the
+    // context is only created for scenes large enough to use it
+    if (N < options.min_gpu_boxes || !aabb::CudaContext::shared().ok()) {
+        auto start = std::chrono::high_resolution_clock::now();
+        run_cpu_side(boxes, sink, options, options.threads ? options.threads : hardware);
+        report.cpu_boxes = N;
+        report.cpu_seconds = seconds_since(start);
+        if (options.report) *options.report = report;
+        return;
+    }
+
+    aabb::CudaContext& context = aabb::CudaContext::shared();
+
+    // The split: quantile slab c of the box minima, the CPU taking the slabs
+    // below it. Both sides keep at least one slab so both stay measured.
+    const size_t num_slabs = std::max<size_t>(options.slabs, 2);
+    const aabb::SlabPartition slabs = aabb::partition_slabs(boxes, num_slabs, options.axis);
+    const double share = options.throughput ? options.throughput->gpu_share(kHybridGpuPrior) : kHybridGpuPrior;
+    const size_t c = std::min(num_slabs - 1, std::max<size_t>(1, static_cast<size_t>(
+                                  std::lround(static_cast<double>(num_slabs) * (1.0 - share)))));
+    aabb::SlabPartition part;
+    part.axis = slabs.axis;
+    part.bounds = {slabs.bounds.front(), slabs.bounds[c], slabs.bounds.back()};
+    report.gpu_used = true;
+    report.axis = part.axis;
+    report.split = part.bounds[1];
+    report.gpu_share = static_cast<double>(num_slabs - c) / static_cast<double>(num_slabs);
+
+    // Every box with its minimum below the split goes to the CPU; the GPU gets
+    // the boxes reaching the split or past it, as local copies whose id is
+    // their local index so its pairs can be checked for ownership. The CPU
+    // side needs no check: its boxes all start below the split, and so do
+    // their pairs' reference points.
+    std::vector<aabb::AABB> cpu_boxes, gpu_boxes;
+    std::vector<uint32_t> gpu_global;  // input index of each GPU box
+    cpu_boxes.reserve(static_cast<size_t>(N * (1.0 - report.gpu_share)) + 1);
+    gpu_boxes.reserve(static_cast<size_t>(N * report.gpu_share) + 1);
+    gpu_global.reserve(gpu_boxes.capacity());
+    for (uint32_t i = 0; i < N; ++i) {
+        const aabb::AABB& b = boxes[i];
+        const bool low = part.first(b) == 0;
+        if (low) cpu_boxes.push_back(b);
+        if (part.last(b) == 1) {
+            aabb::AABB local = b;
+            local.id = static_cast<int>(gpu_boxes.size());
+            gpu_boxes.push_back(local);
+            gpu_global.push_back(i);
+            if (low) ++report.halo;
+        }
+    }
+    report.cpu_boxes = cpu_boxes.size();
+    report.gpu_boxes = gpu_boxes.size();
+
+    // The GPU side on its own host thread, its owned pairs kept until the
+    // CPU side is done with the sink
+    std::vector<aabb::Pair> gpu_pairs;
+    std::thread gpu_worker([&]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        aabb::CallbackPairSink owned([&](const aabb::Pair* pairs, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                if (!part.owns(1, gpu_boxes[pairs[i].first], gpu_boxes[pairs[i].second])) continue;
+                const uint32_t id_a = static_cast<uint32_t>(boxes[gpu_global[pairs[i].first]].id);
+                const uint32_t id_b = static_cast<uint32_t>(boxes[gpu_global[pairs[i].second]].id);
+                gpu_pairs.emplace_back(std::min(id_a, id_b), std::max(id_a, id_b));
+            }
+        });
+        const uint32_t n = static_cast<uint32_t>(gpu_boxes.size());
+        if (options.engine == aabb::EngineKind::SortAndSweep) {
+            CudaSortAndSweepOptions ss_options;
+            ss_options.axis = options.axis;
+            cuda_sort_and_sweep(n, gpu_boxes, owned, ss_options, context);
+        } else {
+            cuda_spatial_hashing(n, gpu_boxes, owned, CudaSpatialHashingOptions{}, context);
+        }
+        report.gpu_seconds = seconds_since(start);
+    });
+
+    // One hardware thread stays with the GPU worker
+    auto cpu_start = std::chrono::high_resolution_clock::now();
+    aabb::CallbackPairSink cpu_sink([&](const aabb::Pair* pairs, size_t count) {
+        report.cpu_pairs += count;
+        sink.on_pairs(pairs, count);
+    });
+    run_cpu_side(cpu_boxes, cpu_sink, options, options.threads ? options.threads : std::max(1u, hardware - 1));
+    report.cpu_seconds = seconds_since(cpu_start);
+    gpu_worker.join();
+
+    if (!gpu_pairs.empty()) sink.on_pairs(gpu_pairs.data(), gpu_pairs.size());
+    report.gpu_pairs = gpu_pairs.size();
+    if (options.throughput && report.cpu_seconds > 0.0 && report.gpu_seconds > 0.0) {
+        options.throughput->update(static_cast<double>(report.cpu_boxes) / report.cpu_seconds,
+                                   static_cast<double>(report.gpu_boxes) / report.gpu_seconds);
+    }
+    if (options.report) *options.report = report;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_hybrid(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const HybridOptions& options)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    cuda_hybrid(N, boxes, sink, options);
+    if (options.order == aabb::PairOrder::Sorted) aabb::sort_pairs(pairs);
+    return pairs;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "cuda_multi_gpu.cuh"
+#include "cuda_context.cuh"
+#include "cuda_sort_and_sweep.cuh"
+#include "cuda_spatial_hashing.cuh"
+#include "radix_sort.h"
+#include "slab_partition.h"
+
+// Boxes of one slab: local copies whose id is their local index, so the
+// device output can be mapped back and checked for ownership
+struct Slab {
+    std::vector<aabb::AABB> boxes;
+    std::vector<uint32_t> global;  // input index of each local box
+    size_t halo = 0;
+    std::vector<aabb::Pair> pairs;
+    size_t candidates = 0;
+    double seconds = 0.0;
+};
+
+static void run_slab(Slab& slab, size_t index, const aabb::SlabPartition& part,
+                     const MultiGpuOptions& options, aabb::BoxSpan input, aabb::CudaContext& context) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const uint32_t n = static_cast<uint32_t>(slab.boxes.size());
+    aabb::CallbackPairSink owned([&](const aabb::Pair* pairs, size_t count) {
+        slab.candidates += count;
+        for (size_t i = 0; i < count; ++i) {
+            if (!part.owns(index, slab.boxes[pairs[i].first], slab.boxes[pairs[i].second])) continue;
+            const uint32_t id_a = static_cast<uint32_t>(input[slab.global[pairs[i].first]].id);
+            const uint32_t id_b = static_cast<uint32_t>(input[slab.global[pairs[i].second]].id);
+            slab.pairs.emplace_back(std::min(id_a, id_b), std::max(id_a, id_b));
+        }
+    });
+    if (options.engine == MultiGpuEngine::SortAndSweep) {
+        cuda_sort_and_sweep(n, slab.boxes, owned, CudaSortAndSweepOptions{}, context);
+    } else {
+        cuda_spatial_hashing(n, slab.boxes, owned, context);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    slab.seconds = std::chrono::duration<double>(end - start).count();
+}
+
+void cuda_multi_gpu(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const MultiGpuOptions& options)
+{
+    if (options.report) options.report->clear();
+    if (N == 0) return;
+    const aabb::CudaContext& first = aabb::CudaContext::shared();
+    if (!first.ok()) {
+        std::cerr << "[cuda_multi_gpu] no CUDA context: " << first.error() << "\n";
+        return;
+    }
+    int devices = first.device_count();
+    if (options.devices > devices) {
+        std::cerr << "[cuda_multi_gpu] " << options.devices << " GPUs requested, " << devices
+                  << " visible; using " << devices << "\n";
+    } else if (options.devices > 0) {
+        devices = options.devices;
+    }
+    const size_t num_slabs = options.slabs ? options.slabs : static_cast<size_t>(devices);
+
+    // Every box goes to the slabs from the one holding its minimum through
+    // the one holding its maximum; the later ones see it as halo
+    const aabb::SlabPartition part = aabb::partition_slabs(boxes, num_slabs, options.axis);
+    std::vector<Slab> slabs(num_slabs);
+    for (Slab& slab : slabs) {
+        slab.boxes.reserve(N / num_slabs + 1);
+        slab.global.reserve(N / num_slabs + 1);
+    }
+    for (uint32_t i = 0; i < N; ++i) {
+        const aabb::AABB& b = boxes[i];
+        const size_t home = part.first(b);
+        const size_t last = part.last(b);
+        for (size_t s = home; s <= last; ++s) {
+            aabb::AABB local = b;
+            local.id = static_cast<int>(slabs[s].boxes.size());
+            slabs[s].boxes.push_back(local);
+            slabs[s].global.push_back(i);
+            if (s != home) ++slabs[s].halo;
+        }
+    }
+
+    // One host thread per device; each runs its slabs in turn on the
+    // device's shared context
+    std::vector<std::thread> workers;
+    for (int d = 0; d < devices; ++d) {
+        workers.emplace_back([&, d]() {
+            aabb::CudaContext& context = aabb::CudaContext::for_device(d);
+            for (size_t s = static_cast<size_t>(d); s < num_slabs; s += static_cast<size_t>(devices)) {
+                if (!context.ok()) {
+                    std::cerr << "[cuda_multi_gpu] device " << d << ": " << context.error() << "\n";
+                    return;
+                }
+                run_slab(slabs[s], s, part, options, boxes, context);
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    for (size_t s = 0; s < num_slabs; ++s) {
+        Slab& slab = slabs[s];
+        if (!slab.pairs.empty()) sink.on_pairs(slab.pairs.data(), slab.pairs.size());
+        if (options.report) {
+            MultiGpuSlab entry;
+            entry.device = static_cast<int>(s % static_cast<size_t>(devices));
+            entry.axis = part.axis;
+            entry.begin = part.bounds[s];
+            entry.end = part.bounds[s + 1];
+            entry.boxes = slab.boxes.size();
+            entry.halo = slab.halo;
+            entry.candidates = slab.candidates;
+            entry.pairs = slab.pairs.size();
+            entry.seconds = slab.seconds;
+            options.report->push_back(entry);
+        }
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_multi_gpu(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const MultiGpuOptions& options)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    cuda_multi_gpu(N, boxes, sink, options);
+    if (options.order == aabb::PairOrder::Sorted) aabb::sort_pairs(pairs);
+    return pairs;
+}
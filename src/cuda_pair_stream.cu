@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <iostream>
+
+#include "cuda_pair_stream.cuh"
+
+namespace aabb {
+
+static_assert(sizeof(DevicePair) == sizeof(Pair), "DevicePair must match the host pair layout");
+
+static bool check_cuda(cudaError_t err, const char* what) {
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_pair_stream] CUDA error: " << what << " : " << cudaGetErrorString(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+CudaPairStream::CudaPairStream(CudaContext& context, PairSink& sink, size_t host_slot, size_t chunk)
+    : context_(context), sink_(sink), chunk_(std::max<size_t>(chunk, 1)) {
+    staging_[0] = context.host<Pair>(host_slot, chunk_);
+    staging_[1] = context.host<Pair>(host_slot + 1, chunk_);
+    ok_ = staging_[0] && staging_[1] &&
+          check_cuda(cudaEventCreateWithFlags(&ready_, cudaEventDisableTiming), "cudaEventCreate") &&
+          check_cuda(cudaEventCreateWithFlags(&copied_[0], cudaEventDisableTiming), "cudaEventCreate") &&
+          check_cuda(cudaEventCreateWithFlags(&copied_[1], cudaEventDisableTiming), "cudaEventCreate");
+}
+
+CudaPairStream::~CudaPairStream() {
+    finish();
+    if (ready_) cudaEventDestroy(ready_);
+    if (copied_[0]) cudaEventDestroy(copied_[0]);
+    if (copied_[1]) cudaEventDestroy(copied_[1]);
+}
+
+bool CudaPairStream::push(const DevicePair* pairs, uint64_t begin, uint64_t end) {
+    if (!ok_) return false;
+    if (begin >= end) return true;
+
+    // The copies wait for the kernels that wrote the range, not for later ones
+    cudaStream_t copy_stream = context_.copy_stream();
+    if (!check_cuda(cudaEventRecord(ready_, context_.stream()), "cudaEventRecord") ||
+        !check_cuda(cudaStreamWaitEvent(copy_stream, ready_, 0), "cudaStreamWaitEvent")) {
+        ok_ = false;
+        return false;
+    }
+    for (uint64_t pos = begin; pos < end; ) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(chunk_, end - pos));
+        const int b = next_;
+        if (!drain(b)) return false;  // the older chunk in this buffer goes first
+        cudaMemcpyAsync(staging_[b], pairs + pos, n * sizeof(DevicePair), cudaMemcpyDeviceToHost, copy_stream);
+        cudaEventRecord(copied_[b], copy_stream);
+        pending_[b] = n;
+        next_ = 1 - b;
+        pos += n;
+    }
+    return true;
+}
+
+bool CudaPairStream::finish() {
+    const int older = next_;
+    return drain(older) && drain(1 - older);
+}
+
+bool CudaPairStream::drain(int buffer) {
+    if (pending_[buffer] == 0) return ok_;
+    const size_t n = pending_[buffer];
+    pending_[buffer] = 0;
+    if (!ok_ || !check_cuda(cudaEventSynchronize(copied_[buffer]), "download pairs")) {
+        ok_ = false;
+        return false;
+    }
+    sink_.on_pairs(staging_[buffer], n);
+    num_pairs_ += n;
+    return true;
+}
+
+} // namespace aabb
@@ -0,0 +1,42 @@
+#include <iostream>
+#include <cub/device/device_radix_sort.cuh>
+
+#include "cuda_radix_sort.cuh"
+
+namespace aabb {
+
+bool cuda_radix_sort_pairs(
+    CudaContext& context,
+    size_t temp_slot,
+    uint64_t*& keys,
+    uint64_t* keys_alt,
+    uint32_t*& values,
+    uint32_t* values_alt,
+    uint32_t count,
+    int key_bits)
+{
+    // The double-buffer form ping-pongs between the two arrays instead of
+    // needing a third copy of the keys in the temporary storage
+    cub::DoubleBuffer<uint64_t> key_buffer(keys, keys_alt);
+    cub::DoubleBuffer<uint32_t> value_buffer(values, values_alt);
+
+    size_t temp_bytes = 0;
+    cudaError_t err = cub::DeviceRadixSort::SortPairs(
+        nullptr, temp_bytes, key_buffer, value_buffer, count, 0, key_bits, context.stream());
+    void* temp = err == cudaSuccess ? context.device<char>(temp_slot, temp_bytes) : nullptr;
+    if (temp) {
+        err = cub::DeviceRadixSort::SortPairs(
+            temp, temp_bytes, key_buffer, value_buffer, count, 0, key_bits, context.stream());
+    }
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_radix_sort] CUDA error: SortPairs : " << cudaGetErrorString(err) << "\n";
+        return false;
+    }
+    if (!temp) return false;
+
+    keys = key_buffer.Current();
+    values = value_buffer.Current();
+    return true;
+}
+
+} // namespace aabb
@@ -1,25 +1,31 @@
 #include <algorithm>
 #include <vector>
 #include <cuda_runtime.h>
-#include <thrust/sort.h>
 #include <thrust/device_vector.h>
 #include <thrust/host_vector.h>
 #include <thrust/sequence.h>
 #include <thrust/remove.h>
 #include <thrust/unique.h>
-#include <chrono>
+#include <thrust/scan.h>
+#include <thrust/execution_policy.h>
+#include <iostream>
 
 #include "cuda_sort_and_sweep.cuh"
+#include "cuda_pair_stream.cuh"
+#include "cuda_radix_sort.cuh"
+#include "engine_stats.h"
+#include "radix_sort.h"
 
 // Endpoint structure for sort-and-sweep algorithm
 // Each AABB generates two endpoints: start (min_x) and end (max_x)
 struct Endpoint {
     float value;       // The x-coordinate (min_x for start, max_x for end)
     uint32_t box_idx;  // Index of the AABB this endpoint belongs to
-    uint32_t is_start; // 1 for start point, 0 for end point (use uint32_t for sorting)
+    uint32_t is_start; // 1 for start point, 0 for end point
 };
 
-// Device-compatible AABB structure
+// Device-compatible AABB structure. The sweep works on projected boxes:
+// x holds the sweep interval and y the filter interval of the chosen axis.
 struct DeviceAABB {
     float min_x;
     float min_y;
@@ -27,225 +33,495 @@ struct DeviceAABB {
     float max_y;
 };
 
-// Comparator for sorting endpoints
-// Sort by value ascending; if equal, start points come before end points
-struct EndpointComparator {
-    __host__ __device__
-    bool operator()(const Endpoint& a, const Endpoint& b) const {
-        if (a.value != b.value) {
-            return a.value < b.value;
-        }
-        // If values are equal, start points (is_start=1) come before end points (is_start=0)
-        return a.is_start > b.is_start;
-    }
-};
+// Sort key of an endpoint: the order-preserving bits of the value (as
+// aabb::float_radix_key) and an end flag below them, so start points come
+// before end points of equal value. The payload is the box index.
+constexpr int kEndpointKeyBits = 33;
 
-// Step 1 Kernel: Create endpoints from AABBs
+__device__ inline uint64_t endpoint_key(float value, uint32_t is_end) {
+    const uint32_t u = __float_as_uint(value);
+    const uint32_t ordered = (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+    return (static_cast<uint64_t>(ordered) << 1) | is_end;
+}
+
+// Step 1 Kernel: Create endpoint keys from AABBs
 // Each thread handles one AABB and writes its start and end points
 __global__ void create_endpoints_kernel(
     const DeviceAABB* boxes,
     const uint32_t N,
-    Endpoint* endpoints)
+    uint64_t* keys,
+    uint32_t* box_indices)
 {
     uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx >= N) return;
 
     const DeviceAABB& box = boxes[idx];
-    
+
     // Write start point at index 2*idx
-    endpoints[2 * idx].value = box.min_x;
-    endpoints[2 * idx].box_idx = idx;
-    endpoints[2 * idx].is_start = 1;
-    
+    keys[2 * idx] = endpoint_key(box.min_x, 0);
+    box_indices[2 * idx] = idx;
+
     // Write end point at index 2*idx + 1
-    endpoints[2 * idx + 1].value = box.max_x;
-    endpoints[2 * idx + 1].box_idx = idx;
-    endpoints[2 * idx + 1].is_start = 0;
+    keys[2 * idx + 1] = endpoint_key(box.max_x, 1);
+    box_indices[2 * idx + 1] = idx;
 }
 
-// Step 3 Kernel: Find overlapping pairs
-// Each thread handles one endpoint in the sorted array
-// If it's an end point, exit immediately
-// If it's a start point, walk forward and test overlaps until hitting the corresponding end point
-__global__ void sweep_find_overlaps_kernel(
+// Step 2 Kernel: Expand the sorted keys into endpoints for the sweep
+__global__ void decode_endpoints_kernel(
+    const DeviceAABB* boxes,
+    const uint64_t* sorted_keys,
+    const uint32_t* sorted_box_indices,
+    const uint32_t num_endpoints,
+    Endpoint* endpoints)
+{
+    uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= num_endpoints) return;
+
+    const uint32_t box_idx = sorted_box_indices[idx];
+    const uint32_t is_end = static_cast<uint32_t>(sorted_keys[idx] & 1);
+    endpoints[idx].value = is_end ? boxes[box_idx].max_x : boxes[box_idx].min_x;
+    endpoints[idx].box_idx = box_idx;
+    endpoints[idx].is_start = 1 - is_end;
+}
+
+// Step 3: Find overlapping pairs
+// The candidates of a start point are the endpoints after it up to the last one
+// whose value does not pass its own end; each pair is found once, from its
+// earlier start. Walking them one thread per start point lets a few huge boxes
+// stall their warps, so the candidates of all start points are laid end to end
+// and cut into chunks of kSweepChunk, one thread per chunk (merge-path style).
+// The run time then follows the candidate count, not the largest box.
+constexpr uint32_t kSweepChunk = 64;
+
+// Candidates of each endpoint (0 for end points), found by binary search for
+// the rank of the first endpoint past the box's end
+__global__ void sweep_work_kernel(
     const Endpoint* endpoints,
     const DeviceAABB* boxes,
     const uint32_t num_endpoints,
-    uint32_t* pair_first,
-    uint32_t* pair_second,
-    uint32_t* pair_count,
-    const uint32_t max_pairs)
+    uint64_t* work)
 {
     uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx >= num_endpoints) return;
 
     const Endpoint& ep = endpoints[idx];
-    
-    // If this is an end point, exit immediately
-    if (ep.is_start == 0) return;
-    
-    // This is a start point - get our box
-    const uint32_t my_box_idx = ep.box_idx;
+    if (ep.is_start == 0) {
+        work[idx] = 0;
+        return;
+    }
+    const float my_end_x = boxes[ep.box_idx].max_x;
+    uint32_t lo = idx + 1;
+    uint32_t hi = num_endpoints;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (endpoints[mid].value > my_end_x) hi = mid;
+        else lo = mid + 1;
+    }
+    work[idx] = lo - (idx + 1);
+}
+
+// Tests candidate j of the start point of my_box_idx, calling visit(a, b) (a < b)
+// if the boxes overlap
+template <typename Visit>
+__device__ inline void test_sweep_candidate(
+    const Endpoint* endpoints,
+    const DeviceAABB* boxes,
+    const DeviceAABB* exact_boxes,
+    const uint32_t my_box_idx,
+    const uint32_t j,
+    Visit& visit)
+{
+    const Endpoint& other_ep = endpoints[j];
+
+    // Only test against start points of other boxes (avoid duplicates)
+    if (other_ep.is_start == 0) return;
+
+    const uint32_t other_box_idx = other_ep.box_idx;
+    if (other_box_idx == my_box_idx) return;
+
     const DeviceAABB& my_box = boxes[my_box_idx];
-    const float my_end_x = my_box.max_x;
-    
-    // Walk forward through the sorted array
-    // Test overlaps until we hit our own end point (where value > my_end_x)
-    for (uint32_t j = idx + 1; j < num_endpoints; ++j) {
-        const Endpoint& other_ep = endpoints[j];
-        
-        // Stop when we pass our end point
-        if (other_ep.value > my_end_x) {
-            break;
-        }
-        
-        // Only test against start points of other boxes (avoid duplicates)
-        if (other_ep.is_start == 0) continue;
-        
-        const uint32_t other_box_idx = other_ep.box_idx;
-        
-        // Skip if same box (shouldn't happen but be safe)
-        if (other_box_idx == my_box_idx) continue;
-        
-        const DeviceAABB& other_box = boxes[other_box_idx];
-        
-        // X-axis overlap is guaranteed since:
-        // - other_ep.value (other's min_x) <= my_end_x (my max_x)
-        // - my_box.min_x (current position) <= other_ep.value (other's min_x)
-        // So we only need to check if other's max_x >= my min_x for full x-overlap
-        // But since we're at a start point of other, and we haven't passed our end,
-        // we need to verify x-overlap more carefully
-        
-        // Check y-axis overlap
-        bool overlap_y = (my_box.min_y <= other_box.max_y) && (my_box.max_y >= other_box.min_y);
-        
-        if (overlap_y) {
-            // Ensure pair is ordered (smaller index first)
-            uint32_t a = my_box_idx;
-            uint32_t b = other_box_idx;
-            if (a > b) {
-                uint32_t tmp = a;
-                a = b;
-                b = tmp;
-            }
-            
-            uint32_t pos = atomicAdd(pair_count, 1);
-            if (pos < max_pairs) {
-                pair_first[pos] = a;
-                pair_second[pos] = b;
-            }
+    const DeviceAABB& other_box = boxes[other_box_idx];
+
+    // The other box starts inside our sweep interval, so the sweep axis
+    // overlaps; check the filter axis
+    bool overlap_y = (my_box.min_y <= other_box.max_y) && (my_box.max_y >= other_box.min_y);
+
+    // Rotated (PCA) projections only bound the boxes, confirm on the originals
+    if (overlap_y && exact_boxes != nullptr) {
+        const DeviceAABB& p = exact_boxes[my_box_idx];
+        const DeviceAABB& q = exact_boxes[other_box_idx];
+        overlap_y = p.min_x <= q.max_x && p.max_x >= q.min_x &&
+                    p.min_y <= q.max_y && p.max_y >= q.min_y;
+    }
+
+    if (overlap_y) {
+        // Ensure pair is ordered (smaller index first)
+        visit(min(my_box_idx, other_box_idx), max(my_box_idx, other_box_idx));
+    }
+}
+
+// Visits the overlaps among candidates [chunk * kSweepChunk, ...) of the
+// concatenated candidate lists, in the same order as a per-start-point walk.
+// work_offsets is the exclusive scan of the work counts, total_work their sum.
+// Returns the steps taken: candidates tested plus owners walked.
+template <typename Visit>
+__device__ inline uint32_t for_each_chunk_overlap(
+    const Endpoint* endpoints,
+    const DeviceAABB* boxes,
+    const DeviceAABB* exact_boxes,
+    const uint64_t* work,
+    const uint64_t* work_offsets,
+    const uint32_t num_endpoints,
+    const uint64_t total_work,
+    const uint64_t chunk,
+    Visit visit)
+{
+    const uint64_t first = chunk * kSweepChunk;
+    const uint64_t last = min(first + kSweepChunk, total_work);
+
+    // Owner of the first candidate: the last endpoint whose offset is <= first.
+    // Endpoints without work share the offset of the next one, so the owner
+    // always has candidates left.
+    uint32_t lo = 0;
+    uint32_t hi = num_endpoints;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (work_offsets[mid] <= first) lo = mid + 1;
+        else hi = mid;
+    }
+    uint32_t owner = lo - 1;
+    uint64_t skip = first - work_offsets[owner];
+    uint32_t owners = 0;
+
+    for (uint64_t k = first; k < last; ) {
+        // Candidates of this owner that fall into the chunk
+        const uint64_t remaining = work[owner] - skip;
+        const uint64_t take = min(remaining, last - k);
+        const uint32_t my_box_idx = endpoints[owner].box_idx;
+        const uint32_t begin = owner + 1 + static_cast<uint32_t>(skip);
+        for (uint32_t j = begin; j < begin + take; ++j) {
+            test_sweep_candidate(endpoints, boxes, exact_boxes, my_box_idx, j, visit);
         }
+        k += take;
+        skip = 0;
+        // Next endpoint with candidates (start points always have at least
+        // their own end)
+        do {
+            ++owner;
+            ++owners;
+        } while (k < last && work[owner] == 0);
     }
+    return static_cast<uint32_t>(last - first) + owners;
 }
 
-std::vector<std::pair<uint32_t, uint32_t>> cuda_sort_and_sweep(
+// Pass 1: pairs found in every chunk
+__global__ void sweep_count_kernel(
+    const Endpoint* endpoints,
+    const DeviceAABB* boxes,
+    const DeviceAABB* exact_boxes,
+    const uint64_t* work,
+    const uint64_t* work_offsets,
+    const uint32_t num_endpoints,
+    const uint64_t total_work,
+    const uint64_t num_chunks,
+    uint64_t* counts,
+    uint32_t* lane_work)
+{
+    const uint64_t chunk = static_cast<uint64_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (chunk >= num_chunks) return;
+
+    uint64_t count = 0;
+    const uint32_t steps = for_each_chunk_overlap(endpoints, boxes, exact_boxes, work, work_offsets,
+                                                  num_endpoints, total_work, chunk,
+                                                  [&](uint32_t, uint32_t) { ++count; });
+    counts[chunk] = count;
+    if (aabb::kStatsEnabled && lane_work) lane_work[chunk] = steps;
+}
+
+// Pass 2: the same walk writes the pairs from the chunk's scanned offset,
+// so the output is exactly sized and in endpoint order. The walk visits box
+// indices; the pairs hold the boxes' ids. Runs over chunks
+// [first_chunk, end_chunk), so the pairs of one part can be downloaded while
+// the next part is computed.
+__global__ void sweep_scatter_kernel(
+    const Endpoint* endpoints,
+    const DeviceAABB* boxes,
+    const DeviceAABB* exact_boxes,
+    const uint64_t* work,
+    const uint64_t* work_offsets,
+    const uint32_t num_endpoints,
+    const uint64_t total_work,
+    const uint64_t first_chunk,
+    const uint64_t end_chunk,
+    const uint64_t* offsets,
+    const uint32_t* ids,
+    aabb::DevicePair* pairs)
+{
+    const uint64_t chunk = first_chunk + static_cast<uint64_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+    if (chunk >= end_chunk) return;
+
+    uint64_t pos = offsets[chunk];
+    for_each_chunk_overlap(endpoints, boxes, exact_boxes, work, work_offsets,
+                           num_endpoints, total_work, chunk,
+                           [&](uint32_t a, uint32_t b) {
+                               const uint32_t id_a = ids[a];
+                               const uint32_t id_b = ids[b];
+                               pairs[pos] = make_uint2(min(id_a, id_b), max(id_a, id_b));
+                               ++pos;
+                           });
+}
+
+// Scratch buffers of the context used by this engine
+enum SortAndSweepBuffer : size_t {
+    kBoxesBuffer,
+    kExactBoxesBuffer,
+    kIdsBuffer,
+    kEndpointKeysBuffer,
+    kEndpointKeysAltBuffer,
+    kBoxIndicesBuffer,
+    kBoxIndicesAltBuffer,
+    kSortTempBuffer,
+    kEndpointsBuffer,
+    kWorkBuffer,
+    kWorkOffsetsBuffer,
+    kCountsBuffer,
+    kOffsetsBuffer,
+    kPartBoundsBuffer,
+    kPairsBuffer,
+    kPairStagingBuffer,
+    kPairStagingAltBuffer,  // second staging buffer of the pair stream
+    kLaneWorkBuffer,
+};
+
+// Scatter launches per call when there are enough chunks for each to keep
+// the device busy; each part's pairs download while the next one runs
+constexpr uint64_t kScatterParts = 8;
+constexpr uint64_t kMinChunksPerPart = 1u << 14;
+
+static bool check_cuda(cudaError_t err, const char* msg) {
+    if (err != cudaSuccess) {
+        std::cerr << "[cuda_sort_and_sweep] CUDA error: " << msg << " : "
+                  << cudaGetErrorString(err) << "\n";
+        return false;
+    }
+    return true;
+}
+
+void cuda_sort_and_sweep(
     const uint32_t N,
-    const std::vector<aabb::AABB>& boxes)
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSortAndSweepOptions& options,
+    aabb::CudaContext& context)
 {
     if (N == 0) {
-        return {};
+        return;
     }
-
-    // Convert to device-compatible format
-    std::vector<DeviceAABB> h_boxes(N);
-    for (uint32_t i = 0; i < N; ++i) {
-        h_boxes[i].min_x = boxes[i].min_x;
-        h_boxes[i].min_y = boxes[i].min_y;
-        h_boxes[i].max_x = boxes[i].max_x;
-        h_boxes[i].max_y = boxes[i].max_y;
+    if (!context.activate()) {
+        std::cerr << "[cuda_sort_and_sweep] no CUDA context: " << context.error() << "\n";
+        return;
     }
+    cudaStream_t stream = context.stream();
+    auto policy = thrust::cuda::par(context.thrust_allocator()).on(stream);
+    aabb::CudaPhaseTimer phases(context);
+    phases.mark(aabb::Phase::Build);
 
-    // Allocate device memory for boxes
-    DeviceAABB* d_boxes;
-    cudaMalloc(&d_boxes, N * sizeof(DeviceAABB));
-    cudaMemcpy(d_boxes, h_boxes.data(), N * sizeof(DeviceAABB), cudaMemcpyHostToDevice);
+    // Pick the sweep axis on the host and convert to the projected device
+    // format, staged in pinned memory for the upload
+    const aabb::AxisEstimate axis = aabb::choose_sweep_axis(boxes, options.axis);
+    if (options.report) *options.report = axis;
+    const bool exact = axis.axis == aabb::SweepAxis::PCA;
 
-    // Record Computation Start Time
-    auto start = std::chrono::high_resolution_clock::now();
+    DeviceAABB* h_boxes = context.host<DeviceAABB>(kBoxesBuffer, N);
+    DeviceAABB* d_boxes = context.device<DeviceAABB>(kBoxesBuffer, N);
+    DeviceAABB* h_exact = nullptr;
+    DeviceAABB* d_exact_boxes = nullptr;
+    if (exact) {
+        h_exact = context.host<DeviceAABB>(kExactBoxesBuffer, N);
+        d_exact_boxes = context.device<DeviceAABB>(kExactBoxesBuffer, N);
+        if (!h_exact || !d_exact_boxes) return;
+    }
+    uint32_t* h_ids = context.host<uint32_t>(kIdsBuffer, N);
+    uint32_t* d_ids = context.device<uint32_t>(kIdsBuffer, N);
+    if (!h_boxes || !d_boxes || !h_ids || !d_ids) return;
+
+    // Upload in chunks, each copy overlapping the conversion of the next
+    for (uint32_t first = 0; first < N; first += aabb::CudaContext::kUploadChunk) {
+        const uint32_t last = std::min(N, first + aabb::CudaContext::kUploadChunk);
+        for (uint32_t i = first; i < last; ++i) {
+            aabb::project_box(boxes[i], axis,
+                              h_boxes[i].min_x, h_boxes[i].max_x,
+                              h_boxes[i].min_y, h_boxes[i].max_y);
+        }
+        cudaMemcpyAsync(d_boxes + first, h_boxes + first, (last - first) * sizeof(DeviceAABB),
+                        cudaMemcpyHostToDevice, stream);
+        for (uint32_t i = first; i < last; ++i) h_ids[i] = static_cast<uint32_t>(boxes[i].id);
+        cudaMemcpyAsync(d_ids + first, h_ids + first, (last - first) * sizeof(uint32_t),
+                        cudaMemcpyHostToDevice, stream);
+        if (!exact) continue;
+        for (uint32_t i = first; i < last; ++i) {
+            h_exact[i].min_x = boxes[i].min_x;
+            h_exact[i].min_y = boxes[i].min_y;
+            h_exact[i].max_x = boxes[i].max_x;
+            h_exact[i].max_y = boxes[i].max_y;
+        }
+        cudaMemcpyAsync(d_exact_boxes + first, h_exact + first, (last - first) * sizeof(DeviceAABB),
+                        cudaMemcpyHostToDevice, stream);
+    }
+    if (!check_cuda(cudaStreamSynchronize(stream), "upload boxes")) return;
 
     // =========================================================================
     // Step 1: Create endpoints (2 per AABB: start and end)
     // =========================================================================
     const uint32_t num_endpoints = 2 * N;
-    Endpoint* d_endpoints;
-    cudaMalloc(&d_endpoints, num_endpoints * sizeof(Endpoint));
-    
+    uint64_t* d_keys = context.device<uint64_t>(kEndpointKeysBuffer, num_endpoints);
+    uint64_t* d_keys_alt = context.device<uint64_t>(kEndpointKeysAltBuffer, num_endpoints);
+    uint32_t* d_box_indices = context.device<uint32_t>(kBoxIndicesBuffer, num_endpoints);
+    uint32_t* d_box_indices_alt = context.device<uint32_t>(kBoxIndicesAltBuffer, num_endpoints);
+    Endpoint* d_endpoints = context.device<Endpoint>(kEndpointsBuffer, num_endpoints);
+    if (!d_keys || !d_keys_alt || !d_box_indices || !d_box_indices_alt || !d_endpoints) return;
+
     int block_size = 256;
     int num_blocks = (N + block_size - 1) / block_size;
-    
-    create_endpoints_kernel<<<num_blocks, block_size>>>(d_boxes, N, d_endpoints);
-    cudaDeviceSynchronize();
+
+    phases.mark(aabb::Phase::Sort);
+    create_endpoints_kernel<<<num_blocks, block_size, 0, stream>>>(d_boxes, N, d_keys, d_box_indices);
 
     // =========================================================================
-    // Step 2: Sort endpoints using parallel sort (Thrust radix sort)
+    // Step 2: Sort endpoints by key (CUB radix sort, box indices as payload)
     // =========================================================================
-    thrust::device_ptr<Endpoint> endpoints_ptr(d_endpoints);
-    thrust::sort(endpoints_ptr, endpoints_ptr + num_endpoints, EndpointComparator());
-    cudaDeviceSynchronize();
+    if (!aabb::cuda_radix_sort_pairs(context, kSortTempBuffer, d_keys, d_keys_alt,
+                                     d_box_indices, d_box_indices_alt, num_endpoints,
+                                     kEndpointKeyBits)) {
+        return;
+    }
+    num_blocks = (num_endpoints + block_size - 1) / block_size;
+    decode_endpoints_kernel<<<num_blocks, block_size, 0, stream>>>(
+        d_boxes, d_keys, d_box_indices, num_endpoints, d_endpoints);
 
     // =========================================================================
-    // Step 3: Sweep to find overlapping pairs
+    // Step 3: Sweep to find overlapping pairs: balance, count, scan, scatter
     // =========================================================================
-    // Estimate max pairs
-    uint64_t total_possible = (uint64_t)N * (N - 1) / 2;
-    uint32_t max_pairs = (uint32_t)std::min(total_possible, (uint64_t)100000000);  // 100M max
-
-    uint32_t* d_pair_first;
-    uint32_t* d_pair_second;
-    uint32_t* d_pair_count;
-    
-    cudaMalloc(&d_pair_first, max_pairs * sizeof(uint32_t));
-    cudaMalloc(&d_pair_second, max_pairs * sizeof(uint32_t));
-    cudaMalloc(&d_pair_count, sizeof(uint32_t));
-    cudaMemset(d_pair_count, 0, sizeof(uint32_t));
-
-    // Launch sweep kernel - one thread per endpoint
-    num_blocks = (num_endpoints + block_size - 1) / block_size;
-    
-    sweep_find_overlaps_kernel<<<num_blocks, block_size>>>(
-        d_endpoints, d_boxes, num_endpoints,
-        d_pair_first, d_pair_second, d_pair_count, max_pairs
-    );
-    cudaDeviceSynchronize();
-
-    // Get pair count
-    uint32_t h_pair_count;
-    cudaMemcpy(&h_pair_count, d_pair_count, sizeof(uint32_t), cudaMemcpyDeviceToHost);
-    
-    if (h_pair_count > max_pairs) {
-        h_pair_count = max_pairs;  // Truncate if overflow
-    }
-
-    // Copy results back
-    std::vector<uint32_t> h_pair_first(h_pair_count);
-    std::vector<uint32_t> h_pair_second(h_pair_count);
-    
-    if (h_pair_count > 0) {
-        cudaMemcpy(h_pair_first.data(), d_pair_first, h_pair_count * sizeof(uint32_t), cudaMemcpyDeviceToHost);
-        cudaMemcpy(h_pair_second.data(), d_pair_second, h_pair_count * sizeof(uint32_t), cudaMemcpyDeviceToHost);
-    }
-
-    // Build result pairs
-    std::vector<std::pair<uint32_t, uint32_t>> pairs(h_pair_count);
-    for (uint32_t i = 0; i < h_pair_count; ++i) {
-        pairs[i] = {h_pair_first[i], h_pair_second[i]};
-    }
-
-    // Sort and deduplicate
-    std::sort(pairs.begin(), pairs.end());
-    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
-
-    // Free device memory
-    cudaFree(d_boxes);
-    cudaFree(d_endpoints);
-    cudaFree(d_pair_first);
-    cudaFree(d_pair_second);
-    cudaFree(d_pair_count);
-
-    // Record Computation End Time
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Computation Time: " << elapsed.count() << " seconds\n";
+    uint64_t* d_work = context.device<uint64_t>(kWorkBuffer, num_endpoints);
+    uint64_t* d_work_offsets = context.device<uint64_t>(kWorkOffsetsBuffer, num_endpoints);
+    uint64_t* h_tail = context.host<uint64_t>(kCountsBuffer, 2);
+    if (!d_work || !d_work_offsets || !h_tail) return;
+
+    // Candidates per endpoint - one thread per endpoint
+    phases.mark(aabb::Phase::Sweep);
+    sweep_work_kernel<<<num_blocks, block_size, 0, stream>>>(
+        d_endpoints, d_boxes, num_endpoints, d_work);
+    thrust::exclusive_scan(policy, thrust::device_ptr<uint64_t>(d_work),
+                           thrust::device_ptr<uint64_t>(d_work + num_endpoints),
+                           thrust::device_ptr<uint64_t>(d_work_offsets));
+    cudaMemcpyAsync(&h_tail[0], d_work_offsets + (num_endpoints - 1), sizeof(uint64_t), cudaMemcpyDeviceToHost, stream);
+    cudaMemcpyAsync(&h_tail[1], d_work + (num_endpoints - 1), sizeof(uint64_t), cudaMemcpyDeviceToHost, stream);
+    if (!check_cuda(cudaStreamSynchronize(stream), "sweep_work_kernel")) return;
+    const uint64_t total_work = h_tail[0] + h_tail[1];
+    const uint64_t num_chunks = (total_work + kSweepChunk - 1) / kSweepChunk;
+
+    // Pairs per chunk - one thread per chunk
+    uint64_t* d_counts = context.device<uint64_t>(kCountsBuffer, num_chunks);
+    uint64_t* d_offsets = context.device<uint64_t>(kOffsetsBuffer, num_chunks);
+    if (!d_counts || !d_offsets) return;
+    const unsigned int chunk_blocks = static_cast<unsigned int>((num_chunks + block_size - 1) / block_size);
+
+    // Steps of every chunk's thread, only while stats are recorded
+    aabb::EngineStats* const stats = aabb::stats_recorder();
+    uint32_t* d_lane_work = stats ? context.device<uint32_t>(kLaneWorkBuffer, num_chunks) : nullptr;
+
+    uint64_t pair_count = 0;
+    if (num_chunks > 0) {
+        sweep_count_kernel<<<chunk_blocks, block_size, 0, stream>>>(
+            d_endpoints, d_boxes, d_exact_boxes, d_work, d_work_offsets,
+            num_endpoints, total_work, num_chunks, d_counts, d_lane_work);
+        thrust::exclusive_scan(policy, thrust::device_ptr<uint64_t>(d_counts),
+                               thrust::device_ptr<uint64_t>(d_counts + num_chunks),
+                               thrust::device_ptr<uint64_t>(d_offsets));
+        cudaMemcpyAsync(&h_tail[0], d_offsets + (num_chunks - 1), sizeof(uint64_t), cudaMemcpyDeviceToHost, stream);
+        cudaMemcpyAsync(&h_tail[1], d_counts + (num_chunks - 1), sizeof(uint64_t), cudaMemcpyDeviceToHost, stream);
+        if (!check_cuda(cudaStreamSynchronize(stream), "sweep_count_kernel")) return;
+        pair_count = h_tail[0] + h_tail[1];
+        if (d_lane_work && !aabb::record_lane_work(context, kLaneWorkBuffer, d_lane_work, num_chunks, *stats)) return;
+    }
+    if (stats) {
+        stats->pairs_tested += total_work;
+        stats->pairs_hit += pair_count;
+    }
 
+    // Exactly sized output, scattered in parts. Each part's pairs stream to
+    // the sink on the copy stream while the later parts are still running.
+    phases.mark(aabb::Phase::Scatter);
+    if (pair_count > 0) {
+        aabb::DevicePair* d_pairs = context.device<aabb::DevicePair>(kPairsBuffer, pair_count);
+        if (!d_pairs) return;
+
+        const uint64_t parts = std::max<uint64_t>(1, std::min(kScatterParts, num_chunks / kMinChunksPerPart));
+        uint64_t* h_bounds = context.host<uint64_t>(kPartBoundsBuffer, parts + 1);
+        if (!h_bounds) return;
+        for (uint64_t k = 1; k < parts; ++k) {
+            cudaMemcpyAsync(&h_bounds[k], d_offsets + num_chunks * k / parts, sizeof(uint64_t),
+                            cudaMemcpyDeviceToHost, stream);
+        }
+        if (!check_cuda(cudaStreamSynchronize(stream), "part bounds")) return;
+        h_bounds[0] = 0;
+        h_bounds[parts] = pair_count;
+
+        aabb::CudaPairStream download(context, sink, kPairStagingBuffer);
+        for (uint64_t k = 0; k < parts; ++k) {
+            const uint64_t first_chunk = num_chunks * k / parts;
+            const uint64_t end_chunk = num_chunks * (k + 1) / parts;
+            const unsigned int part_blocks =
+                static_cast<unsigned int>((end_chunk - first_chunk + block_size - 1) / block_size);
+            sweep_scatter_kernel<<<part_blocks, block_size, 0, stream>>>(
+                d_endpoints, d_boxes, d_exact_boxes, d_work, d_work_offsets,
+                num_endpoints, total_work, first_chunk, end_chunk, d_offsets, d_ids, d_pairs);
+            if (!check_cuda(cudaGetLastError(), "sweep_scatter_kernel")) return;
+            if (!download.push(d_pairs, h_bounds[k], h_bounds[k + 1])) return;
+        }
+        if (!download.finish() || !check_cuda(cudaStreamSynchronize(stream), "sweep_scatter_kernel")) return;
+    }
+
+    phases.finish();
+}
+
+void cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSortAndSweepOptions& options)
+{
+    cuda_sort_and_sweep(N, boxes, sink, options, aabb::CudaContext::shared());
+}
+
+void cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink)
+{
+    cuda_sort_and_sweep(N, boxes, sink, CudaSortAndSweepOptions{});
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const CudaSortAndSweepOptions& options)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    cuda_sort_and_sweep(N, boxes, sink, options);
+
+    // Every overlap is found by exactly one start endpoint, so only order the result
+    if (options.order == aabb::PairOrder::Sorted) {
+        aabb::ScopedPhase dedupe_phase(aabb::Phase::Dedupe);
+        aabb::sort_pairs(pairs);
+    }
     return pairs;
 }
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes)
+{
+    return cuda_sort_and_sweep(N, boxes, CudaSortAndSweepOptions{});
+}
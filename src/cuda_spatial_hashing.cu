@@ -3,14 +3,16 @@
 #include <cmath>
 #include <cuda_runtime.h>
 #include <thrust/device_vector.h>
-#include <thrust/sort.h>
 #include <thrust/copy.h>
-#include <thrust/scan.h>
+#include <thrust/execution_policy.h>
+#include <thrust/iterator/counting_iterator.h>
 #include <iostream>
-#include <chrono>
-#include <iomanip>
 
 #include "cuda_spatial_hashing.cuh"
+#include "cuda_pair_stream.cuh"
+#include "cuda_radix_sort.cuh"
+#include "engine_stats.h"
+#include "grid_levels.h"
 
 struct DeviceAABB {
     int id;
@@ -25,20 +27,31 @@ struct CellBoxPair {
     int32_t cell_x;
     int32_t cell_y;
     uint32_t box_id;
+    int32_t level;     // hierarchical grid level (see grid_levels.h)
 };
 
+// Cell sizes of the grid levels, ascending (passed by value to the kernels)
+struct LevelTable {
+    int num_levels;
+    int cell_size[aabb::kMaxGridLevels];
+};
+
+// Cell hashes keep the low kCellHashBits bits, so the level fits above them
+// in a 64-bit sort key
+constexpr int kCellHashBits = 59;
+static_assert(aabb::kMaxGridLevels <= (1 << (64 - kCellHashBits)), "level must fit the sort key");
+
 __host__ __device__ inline int64_t compute_cell_hash(int cx, int cy) {
     const int64_t P1 = 73856093LL;
     const int64_t P2 = 19349663LL;
-    return int64_t(cx) * P1 ^ int64_t(cy) * P2;
+    return (int64_t(cx) * P1 ^ int64_t(cy) * P2) & ((int64_t(1) << kCellHashBits) - 1);
 }
 
-struct CellBoxComparator {
-    __host__ __device__ bool operator()(const CellBoxPair& a, const CellBoxPair& b) const {
-        if (a.cell_hash != b.cell_hash) return a.cell_hash < b.cell_hash;
-        return a.box_id < b.box_id;
-    }
-};
+// Level-major order: the cells and boxes of a level form one contiguous range.
+// The radix sort is stable, so boxes of a cell stay in id order.
+__device__ inline uint64_t cell_sort_key(int level, int64_t cell_hash) {
+    return (static_cast<uint64_t>(level) << kCellHashBits) | static_cast<uint64_t>(cell_hash);
+}
 
 struct IsValidStart {
     __host__ __device__ bool operator()(uint32_t v) const { return v != 0xFFFFFFFFu; }
@@ -48,20 +61,55 @@ __device__ inline bool intersects_device(const DeviceAABB& a, const DeviceAABB&
     return !(a.max_x < b.min_x || b.max_x < a.min_x || a.max_y < b.min_y || b.max_y < a.min_y);
 }
 
+// Same rule as aabb::grid_level_of
+__device__ inline int level_of_device(const DeviceAABB& box, const LevelTable& levels) {
+    const float extent = fmaxf(box.max_x - box.min_x, box.max_y - box.min_y);
+    for (int l = 0; l + 1 < levels.num_levels; ++l) {
+        if (extent <= (float)levels.cell_size[l]) return l;
+    }
+    return levels.num_levels - 1;
+}
+
 __global__ void assign_boxes_to_cells_kernel(
-    const DeviceAABB* boxes, uint32_t N, int cell_size, CellBoxPair* out_pairs)
+    const DeviceAABB* boxes, uint32_t N, const LevelTable levels, uint64_t* keys, uint32_t* box_ids)
 {
     uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx >= N) return;
     const DeviceAABB& box = boxes[idx];
+    const int level = level_of_device(box, levels);
+    const int cell_size = levels.cell_size[level];
     const float cx = (box.min_x + box.max_x) * 0.5f;
     const float cy = (box.min_y + box.max_y) * 0.5f;
     const int cell_x = (int)floorf(cx / cell_size);
     const int cell_y = (int)floorf(cy / cell_size);
-    out_pairs[idx].cell_x = cell_x;
-    out_pairs[idx].cell_y = cell_y;
-    out_pairs[idx].cell_hash = compute_cell_hash(cell_x, cell_y);
-    out_pairs[idx].box_id = idx;
+    keys[idx] = cell_sort_key(level, compute_cell_hash(cell_x, cell_y));
+    box_ids[idx] = idx;
+}
+
+// Expands the sorted keys into cell/box entries; the cell coordinates are
+// recomputed from the box rather than carried through the sort
+__global__ void build_cell_box_pairs_kernel(
+    const DeviceAABB* boxes,
+    const uint64_t* sorted_keys,
+    const uint32_t* sorted_box_ids,
+    uint32_t N,
+    const LevelTable levels,
+    CellBoxPair* out_pairs)
+{
+    uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= N) return;
+    const uint64_t key = sorted_keys[idx];
+    const uint32_t box_id = sorted_box_ids[idx];
+    const int level = (int)(key >> kCellHashBits);
+    const int cell_size = levels.cell_size[level];
+    const DeviceAABB& box = boxes[box_id];
+    const float cx = (box.min_x + box.max_x) * 0.5f;
+    const float cy = (box.min_y + box.max_y) * 0.5f;
+    out_pairs[idx].cell_x = (int)floorf(cx / cell_size);
+    out_pairs[idx].cell_y = (int)floorf(cy / cell_size);
+    out_pairs[idx].cell_hash = (int64_t)(key & ((uint64_t(1) << kCellHashBits) - 1));
+    out_pairs[idx].box_id = box_id;
+    out_pairs[idx].level = level;
 }
 
 __global__ void find_cell_starts_kernel(
@@ -70,7 +118,8 @@ __global__ void find_cell_starts_kernel(
     uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx >= N) return;
     const int64_t my_hash = sorted_pairs[idx].cell_hash;
-    if (idx == 0 || sorted_pairs[idx - 1].cell_hash != my_hash) {
+    if (idx == 0 || sorted_pairs[idx - 1].cell_hash != my_hash ||
+        sorted_pairs[idx - 1].level != sorted_pairs[idx].level) {
         cell_starts_flags[idx] = idx;
     } else {
         cell_starts_flags[idx] = 0xFFFFFFFFu;
@@ -116,142 +165,330 @@ __device__ int find_cell_index(
     return -1;
 }
 
-__global__ void count_collisions_kernel(
-    const DeviceAABB* boxes,
-    const CellBoxPair* pairs,
-    const int64_t* cell_hashes,
+// level_cell_begin[l] = first cell of level l (cells are level-major)
+__global__ void find_level_bounds_kernel(
+    const CellBoxPair* sorted_pairs,
+    const uint32_t* cell_starts,
+    uint32_t num_cells,
+    uint32_t* level_cell_begin)
+{
+    uint32_t idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= num_cells) return;
+    const int level = sorted_pairs[cell_starts[idx]].level;
+    if (idx == 0 || sorted_pairs[cell_starts[idx - 1]].level != level) {
+        level_cell_begin[level] = idx;
+    }
+}
+
+// Cell of `level` at (cx, cy), searched within that level's cell range
+__device__ inline int find_level_cell(
+    const int64_t* cell_hashes, const uint32_t* level_cell_begin, int level, int cx, int cy)
+{
+    const uint32_t begin = level_cell_begin[level];
+    const uint32_t end = level_cell_begin[level + 1];
+    const int k = find_cell_index(cell_hashes + begin, end - begin, compute_cell_hash(cx, cy));
+    return k < 0 ? -1 : (int)(begin + k);
+}
+
+// Box of the quantized layout: int16 steps from its cell's origin, rounded
+// outward (see quantized_boxes.h)
+struct QuantBox {
+    int16_t min_x;
+    int16_t min_y;
+    int16_t max_x;
+    int16_t max_y;
+};
+
+// Boxes permuted into cell-sorted entry order, one array per field, so the
+// boxes of a cell are contiguous and a warp loads them coalesced
+struct SortedBoxes {
+    float* min_x;
+    float* min_y;
+    float* max_x;
+    float* max_y;
+    uint32_t* id;
+    QuantBox* quantized;  // null unless the quantized layout was requested
+};
+
+__device__ inline DeviceAABB load_box(const SortedBoxes& boxes, uint32_t e) {
+    DeviceAABB box;
+    box.id = (int)boxes.id[e];
+    box.min_x = boxes.min_x[e];
+    box.min_y = boxes.min_y[e];
+    box.max_x = boxes.max_x[e];
+    box.max_y = boxes.max_y[e];
+    return box;
+}
+
+__global__ void permute_boxes_kernel(
+    const DeviceAABB* boxes, const CellBoxPair* sorted_pairs, uint32_t N, const SortedBoxes out)
+{
+    uint32_t e = blockIdx.x * blockDim.x + threadIdx.x;
+    if (e >= N) return;
+    const DeviceAABB& box = boxes[sorted_pairs[e].box_id];
+    out.id[e] = (uint32_t)box.id;
+    out.min_x[e] = box.min_x;
+    out.min_y[e] = box.min_y;
+    out.max_x[e] = box.max_x;
+    out.max_y[e] = box.max_y;
+}
+
+// Same rounding as aabb::quantize_lo / quantize_hi, in double so that the
+// frames of neighbor cells stay within the one-step margin
+__device__ inline int16_t quantize_lo_device(float v, double origin, double scale) {
+    return (int16_t)fmax(-32768.0, fmin(32767.0, floor(((double)v - origin) * scale) - 1.0));
+}
+
+__device__ inline int16_t quantize_hi_device(float v, double origin, double scale) {
+    return (int16_t)fmax(-32768.0, fmin(32767.0, ceil(((double)v - origin) * scale) + 1.0));
+}
+
+// A box that spans the whole int16 range in both axes; no quantized box does
+__host__ __device__ inline bool is_wide(const QuantBox& q) {
+    return q.min_x == INT16_MIN && q.max_x == INT16_MAX && q.min_y == INT16_MIN && q.max_y == INT16_MAX;
+}
+
+// Quantizes the boxes of every cell in the frame of the cell's first entry.
+// Cells are runs of equal hashes, so a run may mix cells; a box of another
+// cell than the first is made wide and is a candidate of every test.
+__global__ void quantize_cells_kernel(
+    const SortedBoxes boxes,
+    const CellBoxPair* sorted_pairs,
     const uint32_t* cell_starts,
     const uint32_t* cell_lengths,
     uint32_t num_cells,
-    uint64_t* counts)
+    const LevelTable levels)
 {
-    uint32_t cell_idx = blockIdx.x * blockDim.x + threadIdx.x;
-    if (cell_idx >= num_cells) return;
+    uint32_t cell = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cell >= num_cells) return;
+    const uint32_t start = cell_starts[cell];
+    const CellBoxPair& first = sorted_pairs[start];
+    const double L = (double)levels.cell_size[first.level];
+    const double scale = (double)aabb::kQuantStepsPerCell / L;
+    const double ox = (double)first.cell_x * L;
+    const double oy = (double)first.cell_y * L;
+    for (uint32_t e = start; e < start + cell_lengths[cell]; ++e) {
+        QuantBox q{INT16_MIN, INT16_MIN, INT16_MAX, INT16_MAX};
+        if (sorted_pairs[e].cell_x == first.cell_x && sorted_pairs[e].cell_y == first.cell_y) {
+            q.min_x = quantize_lo_device(boxes.min_x[e], ox, scale);
+            q.min_y = quantize_lo_device(boxes.min_y[e], oy, scale);
+            q.max_x = quantize_hi_device(boxes.max_x[e], ox, scale);
+            q.max_y = quantize_hi_device(boxes.max_y[e], oy, scale);
+        }
+        boxes.quantized[e] = q;
+    }
+}
 
-    const uint32_t start = cell_starts[cell_idx];
-    const uint32_t len = cell_lengths[cell_idx];
-    if (len == 0) return;
-
-    const int cx = pairs[start].cell_x;
-    const int cy = pairs[start].cell_y;
-
-    uint64_t local_count = 0;
-
-    for (int dx = -1; dx <= 1; ++dx) {
-        for (int dy = -1; dy <= 1; ++dy) {
-            const int nx = cx + dx;
-            const int ny = cy + dy;
-            if (!(dx > 0 || (dx == 0 && dy >= 0))) continue; // avoid duplicates
-
-            const int64_t nh = compute_cell_hash(nx, ny);
-            const int neigh_idx = find_cell_index(cell_hashes, num_cells, nh);
-            if (neigh_idx < 0) continue;
-
-            const uint32_t nstart = cell_starts[neigh_idx];
-            const uint32_t nlen = cell_lengths[neigh_idx];
-            if (nlen == 0) continue;
-
-            if (neigh_idx == (int)cell_idx) {
-                for (uint32_t i = 0; i < len; ++i) {
-                    for (uint32_t j = i + 1; j < len; ++j) {
-                        const DeviceAABB& A = boxes[pairs[start + i].box_id];
-                        const DeviceAABB& B = boxes[pairs[start + j].box_id];
-                        if (intersects_device(A, B)) local_count++;
-                    }
-                }
-            } else {
-                for (uint32_t i = 0; i < len; ++i) {
-                    const DeviceAABB& A = boxes[pairs[start + i].box_id];
-                    for (uint32_t j = 0; j < nlen; ++j) {
-                        const DeviceAABB& B = boxes[pairs[nstart + j].box_id];
-                        if (intersects_device(A, B)) local_count++;
-                    }
-                }
+// Quantized test of A, shifted by (sx, sy) steps into B's frame, against B
+__device__ inline bool intersects_quantized(const QuantBox& A, int sx, int sy, const QuantBox& B) {
+    return !((int)A.max_x - sx < B.min_x || (int)B.max_x < (int)A.min_x - sx ||
+             (int)A.max_y - sy < B.min_y || (int)B.max_y < (int)A.min_y - sy);
+}
+
+// Steps from the frame of cell a to that of cell b. Boxes of cells two or more
+// apart never overlap, so the offset is clamped to keep the shift in int range.
+__device__ inline int frame_shift(int a, int b) {
+    const long long d = (long long)b - (long long)a;
+    return (int)max(-2ll, min(2ll, d)) * aabb::kQuantStepsPerCell;
+}
+
+// Forward half of the 3x3 stencil (dx > 0 || (dx == 0 && dy > 0)); with the
+// cell itself it finds every same-level pair once
+constexpr int kNumForward = 4;
+
+// neighbors[kNumForward * c + k] = index of the k-th forward neighbor of cell
+// c on its level, or -1; looked up once instead of in every pair pass
+__global__ void build_neighbor_table_kernel(
+    const CellBoxPair* sorted_pairs,
+    const uint32_t* cell_starts,
+    uint32_t num_cells,
+    const int64_t* cell_hashes,
+    const uint32_t* level_cell_begin,
+    int* neighbors)
+{
+    uint32_t cell = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cell >= num_cells) return;
+    const int dx[kNumForward] = {0, 1, 1, 1};
+    const int dy[kNumForward] = {1, -1, 0, 1};
+    const CellBoxPair& p = sorted_pairs[cell_starts[cell]];
+    for (int k = 0; k < kNumForward; ++k) {
+        neighbors[kNumForward * cell + k] =
+            find_level_cell(cell_hashes, level_cell_begin, p.level, p.cell_x + dx[k], p.cell_y + dy[k]);
+    }
+}
+
+// Calls visit(e) for every entry e whose box, of a finer level, may overlap
+// box A. A box of level m reaches at most cell_size[m] / 2 from its center, so
+// the centers lie in A grown by that much; when the window has more cells than
+// level m, the whole level is scanned instead. Each cross-level pair is thus
+// visited once, from its coarser box.
+template <typename Visit>
+__device__ void visit_finer_levels(
+    const DeviceAABB& A,
+    int level,
+    const int64_t* cell_hashes,
+    const uint32_t* cell_starts,
+    const uint32_t* cell_lengths,
+    const uint32_t* level_cell_begin,
+    const LevelTable& levels,
+    uint32_t total_entries,
+    Visit visit)
+{
+    for (int m = 0; m < level; ++m) {
+        const float L = (float)levels.cell_size[m];
+        const float reach = 0.5f * L;
+        const int x0 = (int)floorf((A.min_x - reach) / L);
+        const int y0 = (int)floorf((A.min_y - reach) / L);
+        const int x1 = (int)floorf((A.max_x + reach) / L);
+        const int y1 = (int)floorf((A.max_y + reach) / L);
+        const uint32_t cells_in_level = level_cell_begin[m + 1] - level_cell_begin[m];
+        if (cells_in_level == 0) continue;
+        const uint64_t window = (uint64_t)(x1 - x0 + 1) * (uint64_t)(y1 - y0 + 1);
+
+        if (window > cells_in_level) {
+            const uint32_t first = cell_starts[level_cell_begin[m]];
+            const uint32_t last = level_cell_begin[m + 1] < level_cell_begin[levels.num_levels]
+                ? cell_starts[level_cell_begin[m + 1]] : total_entries;
+            for (uint32_t e = first; e < last; ++e) visit(e);
+            continue;
+        }
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                const int k = find_level_cell(cell_hashes, level_cell_begin, m, x, y);
+                if (k < 0) continue;
+                const uint32_t nstart = cell_starts[k];
+                const uint32_t nlen = cell_lengths[k];
+                for (uint32_t j = 0; j < nlen; ++j) visit(nstart + j);
             }
         }
     }
+}
 
-    counts[cell_idx] = local_count;
+using aabb::kWarpSize;
+constexpr uint32_t kCellsPerBlock = 4;  // one warp per cell
+
+// Sum over the warp, in lane 0
+__device__ inline unsigned warp_sum(unsigned v) {
+    for (unsigned offset = kWarpSize / 2; offset > 0; offset /= 2) v += __shfl_down_sync(0xFFFFFFFFu, v, offset);
+    return v;
 }
 
-__global__ void scatter_collisions_kernel(
-    const DeviceAABB* boxes,
-    const CellBoxPair* pairs,
+// One warp per cell. Lane l holds box ib + l of the cell in registers; the
+// boxes of the cell itself (later entries only) and of its forward neighbors
+// are staged through shared memory one warp-sized tile at a time, and every
+// lane tests its box against the whole tile. The loop bounds depend only on
+// the cell, so the warp stays converged for the ballots. With the quantized
+// layout the tiles hold QuantBoxes, and only the candidates load their float
+// box to be re-checked; quant_counts gets the candidates and rejections.
+__global__ void collide_cells_kernel(
+    const SortedBoxes boxes,
+    const CellBoxPair* sorted_pairs,
     const int64_t* cell_hashes,
     const uint32_t* cell_starts,
     const uint32_t* cell_lengths,
+    const int* neighbors,
     uint32_t num_cells,
-    const uint64_t* offsets,
-    uint32_t* out_a,
-    uint32_t* out_b)
+    const uint32_t* level_cell_begin,
+    const LevelTable levels,
+    uint32_t total_entries,
+    const aabb::PairOutput out,
+    uint32_t* lane_work,
+    unsigned long long* quant_counts)
 {
-    uint32_t cell_idx = blockIdx.x * blockDim.x + threadIdx.x;
-    if (cell_idx >= num_cells) return;
-
-    const uint32_t start = cell_starts[cell_idx];
-    const uint32_t len = cell_lengths[cell_idx];
-    if (len == 0) return;
-
-    const int cx = pairs[start].cell_x;
-    const int cy = pairs[start].cell_y;
-
-    uint64_t write_pos = offsets[cell_idx];
-
-    for (int dx = -1; dx <= 1; ++dx) {
-        for (int dy = -1; dy <= 1; ++dy) {
-            const int nx = cx + dx;
-            const int ny = cy + dy;
-            if (!(dx > 0 || (dx == 0 && dy >= 0))) continue;
-
-            const int64_t nh = compute_cell_hash(nx, ny);
-            const int neigh_idx = find_cell_index(cell_hashes, num_cells, nh);
-            if (neigh_idx < 0) continue;
-
-            const uint32_t nstart = cell_starts[neigh_idx];
-            const uint32_t nlen = cell_lengths[neigh_idx];
-            if (nlen == 0) continue;
-
-            if (neigh_idx == (int)cell_idx) {
-                for (uint32_t i = 0; i < len; ++i) {
-                    for (uint32_t j = i + 1; j < len; ++j) {
-                        const DeviceAABB& A = boxes[pairs[start + i].box_id];
-                        const DeviceAABB& B = boxes[pairs[start + j].box_id];
-                        if (!intersects_device(A, B)) continue;
-                        uint32_t a = static_cast<uint32_t>(A.id);
-                        uint32_t b = static_cast<uint32_t>(B.id);
-                        if (a > b) { uint32_t t = a; a = b; b = t; }
-                        out_a[write_pos] = a;
-                        out_b[write_pos] = b;
-                        write_pos++;
+    __shared__ DeviceAABB tiles[kCellsPerBlock][kWarpSize];
+    __shared__ QuantBox quant_tiles[kCellsPerBlock][kWarpSize];
+    const uint32_t warp = threadIdx.x / kWarpSize;
+    const uint32_t lane = threadIdx.x % kWarpSize;
+    const uint32_t cell = blockIdx.x * kCellsPerBlock + warp;
+    if (cell >= num_cells) return;  // the whole warp leaves together
+    DeviceAABB* tile = tiles[warp];
+    QuantBox* quant_tile = quant_tiles[warp];
+    const bool quantized = boxes.quantized != nullptr;
+
+    const uint32_t start = cell_starts[cell];
+    const uint32_t len = cell_lengths[cell];
+    const CellBoxPair& origin = sorted_pairs[start];
+    const int level = origin.level;
+    uint32_t work = 0;  // pair tests of this lane, for the stats
+    unsigned candidates = 0, rejected = 0;
+
+    for (uint32_t ib = 0; ib < len; ib += kWarpSize) {
+        const uint32_t i = ib + lane;
+        const bool has_box = i < len;
+        DeviceAABB A{};
+        QuantBox QA{};
+        if (has_box) A = load_box(boxes, start + i);
+        if (has_box && quantized) QA = boxes.quantized[start + i];
+        const bool a_wide = quantized && is_wide(QA);
+
+        // The cell itself (k < 0), then its forward neighbors
+        for (int k = -1; k < kNumForward; ++k) {
+            const int other = k < 0 ? (int)cell : neighbors[kNumForward * cell + k];
+            if (other < 0) continue;
+            const uint32_t ostart = cell_starts[other];
+            const uint32_t olen = cell_lengths[other];
+            int sx = 0, sy = 0;
+            if (quantized && !a_wide) {
+                sx = frame_shift(origin.cell_x, sorted_pairs[ostart].cell_x);
+                sy = frame_shift(origin.cell_y, sorted_pairs[ostart].cell_y);
+            }
+            for (uint32_t jb = (k < 0 ? ib : 0); jb < olen; jb += kWarpSize) {
+                __syncwarp();
+                if (jb + lane < olen) {
+                    if (quantized) {
+                        quant_tile[lane] = boxes.quantized[ostart + jb + lane];
+                    } else {
+                        tile[lane] = load_box(boxes, ostart + jb + lane);
                     }
                 }
-            } else {
-                for (uint32_t i = 0; i < len; ++i) {
-                    const DeviceAABB& A = boxes[pairs[start + i].box_id];
-                    for (uint32_t j = 0; j < nlen; ++j) {
-                        const DeviceAABB& B = boxes[pairs[nstart + j].box_id];
-                        if (!intersects_device(A, B)) continue;
-                        uint32_t a = static_cast<uint32_t>(A.id);
-                        uint32_t b = static_cast<uint32_t>(B.id);
-                        if (a > b) { uint32_t t = a; a = b; b = t; }
-                        out_a[write_pos] = a;
-                        out_b[write_pos] = b;
-                        write_pos++;
+                __syncwarp();
+                const uint32_t tile_len = min(kWarpSize, olen - jb);
+                for (uint32_t t = 0; t < tile_len; ++t) {
+                    const bool later = k >= 0 || jb + t > i;
+                    if (aabb::kStatsEnabled) work += has_box && later;
+                    if (!quantized) {
+                        const DeviceAABB& B = tile[t];
+                        const bool hit = has_box && later && intersects_device(A, B);
+                        aabb::warp_emit(hit, (uint32_t)A.id, (uint32_t)B.id, out);
+                        continue;
+                    }
+                    const QuantBox& QB = quant_tile[t];
+                    bool hit = false;
+                    uint32_t id_b = 0;
+                    if (has_box && later && (a_wide || is_wide(QB) || intersects_quantized(QA, sx, sy, QB))) {
+                        const DeviceAABB B = load_box(boxes, ostart + jb + t);
+                        hit = intersects_device(A, B);
+                        id_b = (uint32_t)B.id;
+                        ++candidates;
+                        rejected += !hit;
                     }
+                    aabb::warp_emit(hit, (uint32_t)A.id, id_b, out);
                 }
             }
         }
-    }
-}
 
-__host__ int compute_cell_size_host(const std::vector<aabb::AABB>& boxes) {
-    float max_dim = 0.0f;
-    for (const auto& b : boxes) {
-        max_dim = std::max(max_dim, b.max_x - b.min_x);
-        max_dim = std::max(max_dim, b.max_y - b.min_y);
+        // Pairs with boxes of finer levels; these walks diverge, so each lane
+        // reserves its own slots
+        if (has_box) {
+            visit_finer_levels(A, level, cell_hashes, cell_starts, cell_lengths,
+                               level_cell_begin, levels, total_entries,
+                               [&](uint32_t e) {
+                                   if (aabb::kStatsEnabled) ++work;
+                                   const DeviceAABB B = load_box(boxes, e);
+                                   if (!intersects_device(A, B)) return;
+                                   aabb::write_pair(out, atomicAdd(out.count, 1ull), (uint32_t)A.id, (uint32_t)B.id);
+                               });
+        }
+    }
+    if (aabb::kStatsEnabled && lane_work) lane_work[cell * kWarpSize + lane] = work;
+    if (quant_counts) {
+        candidates = warp_sum(candidates);
+        rejected = warp_sum(rejected);
+        if (lane == 0) {
+            atomicAdd(&quant_counts[0], (unsigned long long)candidates);
+            atomicAdd(&quant_counts[1], (unsigned long long)rejected);
+        }
     }
-    int L = static_cast<int>(std::ceil(max_dim));
-    return (L <= 0) ? 1 : L;
 }
 
 __host__ bool check_cuda(cudaError_t err, const char* msg) {
@@ -263,236 +500,297 @@ __host__ bool check_cuda(cudaError_t err, const char* msg) {
     return true;
 }
 
-std::vector<std::pair<uint32_t, uint32_t>> cuda_spatial_hashing(
+// Scratch buffers of the context used by this engine
+enum SpatialHashingBuffer : size_t {
+    kBoxesBuffer,
+    kCellKeysBuffer,
+    kCellKeysAltBuffer,
+    kBoxIdsBuffer,
+    kBoxIdsAltBuffer,
+    kSortTempBuffer,
+    kCellBoxPairsBuffer,
+    kCellStartFlagsBuffer,
+    kCellStartsBuffer,
+    kCellLengthsBuffer,
+    kCellHashesBuffer,
+    kLevelBoundsBuffer,
+    kSortedMinXBuffer,
+    kSortedMinYBuffer,
+    kSortedMaxXBuffer,
+    kSortedMaxYBuffer,
+    kSortedIdsBuffer,
+    kNeighborsBuffer,
+    kPairCountBuffer,
+    kPairsBuffer,
+    kPairStagingBuffer,
+    kPairStagingAltBuffer,  // second staging buffer of the pair stream
+    kLaneWorkBuffer,
+    kSortedQuantBuffer,
+    kQuantCountsBuffer,
+};
+
+void cuda_spatial_hashing(
     const uint32_t N,
-    const std::vector<aabb::AABB>& boxes)
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSpatialHashingOptions& options,
+    aabb::CudaContext& context)
 {
-    if (N == 0) return {};
-
-    auto t0 = std::chrono::high_resolution_clock::now();
-
-    const int cell_size = compute_cell_size_host(boxes);
-    std::cerr << "[cuda_sh] cell_size=" << cell_size << ", N=" << N << std::endl;
-
-    int dev_count = 0;
-    if (!check_cuda(cudaGetDeviceCount(&dev_count), "cudaGetDeviceCount")) return {};
-    std::cerr << "[cuda_sh] device_count=" << dev_count << std::endl;
-
-    // 使用 pinned host memory 提升 H2D 拷貝效率
-    DeviceAABB* h_boxes = nullptr;
-    if (!check_cuda(cudaHostAlloc(&h_boxes, N * sizeof(DeviceAABB), cudaHostAllocDefault), "cudaHostAlloc h_boxes")) {
-        return {};
-    }
-    for (uint32_t i = 0; i < N; ++i) {
-        h_boxes[i].id = boxes[i].id;
-        h_boxes[i].min_x = boxes[i].min_x;
-        h_boxes[i].min_y = boxes[i].min_y;
-        h_boxes[i].max_x = boxes[i].max_x;
-        h_boxes[i].max_y = boxes[i].max_y;
+    if (options.quant_report) *options.quant_report = aabb::QuantizationStats{};
+    if (N == 0) return;
+    if (!context.activate()) {
+        std::cerr << "[cuda_sh] no CUDA context: " << context.error() << "\n";
+        return;
     }
-    // 重用 device buffer
-    static DeviceAABB* d_boxes = nullptr;
-    static size_t d_boxes_capacity = 0;
-    const size_t needed_boxes = static_cast<size_t>(N) * sizeof(DeviceAABB);
-    if (needed_boxes > d_boxes_capacity) {
-        if (d_boxes) cudaFreeAsync(d_boxes, 0);
-        std::cerr << "[cuda_sh] cudaMalloc d_boxes..." << std::endl;
-        if (!check_cuda(cudaMallocAsync(&d_boxes, needed_boxes, 0), "cudaMallocAsync d_boxes")) {
-            cudaFreeHost(h_boxes);
-            return {};
+    cudaStream_t stream = context.stream();
+    auto policy = thrust::cuda::par(context.thrust_allocator()).on(stream);
+    aabb::CudaPhaseTimer phases(context);
+    phases.mark(aabb::Phase::Build);
+
+    // Hierarchical grid: one level per occupied power-of-two cell size
+    const std::vector<int> level_sizes = aabb::choose_grid_levels(boxes);
+    LevelTable levels{};
+    levels.num_levels = static_cast<int>(level_sizes.size());
+    for (int l = 0; l < levels.num_levels; ++l) levels.cell_size[l] = level_sizes[l];
+
+    // Boxes go up through the context's pinned staging buffer
+    DeviceAABB* h_boxes = context.host<DeviceAABB>(kBoxesBuffer, N);
+    DeviceAABB* d_boxes = context.device<DeviceAABB>(kBoxesBuffer, N);
+    if (!h_boxes || !d_boxes) return;
+    for (uint32_t first = 0; first < N; first += aabb::CudaContext::kUploadChunk) {
+        const uint32_t last = std::min(N, first + aabb::CudaContext::kUploadChunk);
+        for (uint32_t i = first; i < last; ++i) {
+            h_boxes[i].id = boxes[i].id;
+            h_boxes[i].min_x = boxes[i].min_x;
+            h_boxes[i].min_y = boxes[i].min_y;
+            h_boxes[i].max_x = boxes[i].max_x;
+            h_boxes[i].max_y = boxes[i].max_y;
+        }
+        if (!check_cuda(cudaMemcpyAsync(d_boxes + first, h_boxes + first, (last - first) * sizeof(DeviceAABB),
+                                        cudaMemcpyHostToDevice, stream),
+                        "memcpy boxes")) {
+            return;
         }
-        d_boxes_capacity = needed_boxes;
     }
-    std::cerr << "[cuda_sh] cudaMemcpy boxes..." << std::endl;
-    if (!check_cuda(cudaMemcpyAsync(d_boxes, h_boxes, needed_boxes, cudaMemcpyHostToDevice, 0), "memcpy boxes")) {
-        cudaFreeHost(h_boxes);
-        return {};
+    if (!check_cuda(cudaStreamSynchronize(stream), "memcpy boxes")) return;
+
+    uint64_t* d_keys = context.device<uint64_t>(kCellKeysBuffer, N);
+    uint64_t* d_keys_alt = context.device<uint64_t>(kCellKeysAltBuffer, N);
+    uint32_t* d_box_ids = context.device<uint32_t>(kBoxIdsBuffer, N);
+    uint32_t* d_box_ids_alt = context.device<uint32_t>(kBoxIdsAltBuffer, N);
+    CellBoxPair* d_pairs = context.device<CellBoxPair>(kCellBoxPairsBuffer, N);
+    uint32_t* d_cell_starts_flags = context.device<uint32_t>(kCellStartFlagsBuffer, N);
+    uint32_t* d_cell_starts = context.device<uint32_t>(kCellStartsBuffer, N);
+    if (!d_keys || !d_keys_alt || !d_box_ids || !d_box_ids_alt || !d_pairs ||
+        !d_cell_starts_flags || !d_cell_starts) {
+        return;
     }
-    cudaStreamSynchronize(0);
-    cudaFreeHost(h_boxes);
-
-    // Record Computation Start Time
-    auto start = std::chrono::high_resolution_clock::now();
 
-    auto t_prep = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] prep done" << std::endl;
-
-    thrust::device_vector<CellBoxPair> d_pairs(N);
     const int block = 256;
     const int grid = (N + block - 1) / block;
-    std::cerr << "[cuda_sh] launch assign kernel" << std::endl;
-    assign_boxes_to_cells_kernel<<<grid, block>>>(d_boxes, N, cell_size, thrust::raw_pointer_cast(d_pairs.data()));
-    if (!check_cuda(cudaDeviceSynchronize(), "assign_boxes_to_cells_kernel")) {
-        cudaFree(d_boxes);
-        return {};
-    }
-    auto t_assign = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] assign done" << std::endl;
-
-    thrust::sort(d_pairs.begin(), d_pairs.end(), CellBoxComparator());
-    auto t_sort = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] sort done" << std::endl;
-
-    thrust::device_vector<uint32_t> d_cell_starts_flags(N);
-    find_cell_starts_kernel<<<grid, block>>>(thrust::raw_pointer_cast(d_pairs.data()), N,
-                                             thrust::raw_pointer_cast(d_cell_starts_flags.data()));
-    if (!check_cuda(cudaDeviceSynchronize(), "find_cell_starts_kernel")) {
-        cudaFree(d_boxes);
-        return {};
+    assign_boxes_to_cells_kernel<<<grid, block, 0, stream>>>(d_boxes, N, levels, d_keys, d_box_ids);
+    if (!check_cuda(cudaStreamSynchronize(stream), "assign_boxes_to_cells_kernel")) return;
+
+    // Key-only radix sort over the level and hash bits in use
+    phases.mark(aabb::Phase::Sort);
+    int key_bits = kCellHashBits;
+    while ((1 << (key_bits - kCellHashBits)) < levels.num_levels) ++key_bits;
+    if (!aabb::cuda_radix_sort_pairs(context, kSortTempBuffer, d_keys, d_keys_alt,
+                                     d_box_ids, d_box_ids_alt, N, key_bits)) {
+        return;
     }
+    build_cell_box_pairs_kernel<<<grid, block, 0, stream>>>(d_boxes, d_keys, d_box_ids, N, levels, d_pairs);
+    if (!check_cuda(cudaStreamSynchronize(stream), "build_cell_box_pairs_kernel")) return;
+
+    phases.mark(aabb::Phase::Build);
+    find_cell_starts_kernel<<<grid, block, 0, stream>>>(d_pairs, N, d_cell_starts_flags);
+    if (!check_cuda(cudaStreamSynchronize(stream), "find_cell_starts_kernel")) return;
 
-    thrust::device_vector<uint32_t> d_cell_starts(N);
+    thrust::device_ptr<uint32_t> starts_ptr(d_cell_starts);
     auto end_it = thrust::copy_if(
+        policy,
         thrust::counting_iterator<uint32_t>(0),
         thrust::counting_iterator<uint32_t>(N),
-        d_cell_starts_flags.begin(),
-        d_cell_starts.begin(),
+        thrust::device_ptr<uint32_t>(d_cell_starts_flags),
+        starts_ptr,
         IsValidStart());
-    const uint32_t num_cells = static_cast<uint32_t>(end_it - d_cell_starts.begin());
-    std::cerr << "[cuda_sh] num_cells=" << num_cells << "\n";
-    d_cell_starts.resize(num_cells);
+    const uint32_t num_cells = static_cast<uint32_t>(end_it - starts_ptr);
 
-    thrust::device_vector<uint32_t> d_cell_lengths(num_cells);
-    if (num_cells > 0) {
-        const int grid_cells = (num_cells + block - 1) / block;
-        compute_cell_lengths_kernel<<<grid_cells, block>>>(
-            thrust::raw_pointer_cast(d_cell_starts.data()),
-            num_cells,
-            N,
-            thrust::raw_pointer_cast(d_cell_lengths.data()));
-        if (!check_cuda(cudaDeviceSynchronize(), "compute_cell_lengths_kernel")) {
-            cudaFree(d_boxes);
-            return {};
-        }
-    }
-    auto t_bucket = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] bucket done\n";
+    uint32_t* d_cell_lengths = context.device<uint32_t>(kCellLengthsBuffer, num_cells);
+    int64_t* d_cell_hashes = context.device<int64_t>(kCellHashesBuffer, num_cells);
+    uint32_t* d_level_cell_begin = context.device<uint32_t>(kLevelBoundsBuffer, levels.num_levels + 1);
+    if (!d_cell_lengths || !d_cell_hashes || !d_level_cell_begin) return;
 
-    thrust::device_vector<int64_t> d_cell_hashes(num_cells);
+    const int grid_cells = (num_cells + block - 1) / block;
     if (num_cells > 0) {
-        const int grid_cells = (num_cells + block - 1) / block;
-        fill_cell_hashes_kernel<<<grid_cells, block>>>(
-            thrust::raw_pointer_cast(d_pairs.data()),
-            thrust::raw_pointer_cast(d_cell_starts.data()),
-            num_cells,
-            thrust::raw_pointer_cast(d_cell_hashes.data()));
-        if (!check_cuda(cudaDeviceSynchronize(), "fill_cell_hashes_kernel")) {
-            cudaFree(d_boxes);
-            return {};
-        }
+        compute_cell_lengths_kernel<<<grid_cells, block, 0, stream>>>(
+            d_cell_starts, num_cells, N, d_cell_lengths);
+        if (!check_cuda(cudaStreamSynchronize(stream), "compute_cell_lengths_kernel")) return;
     }
-    auto t_hashes = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] hashes done\n";
 
-    thrust::device_vector<uint64_t> d_counts(num_cells, 0);
     if (num_cells > 0) {
-        const int grid_cells = (num_cells + block - 1) / block;
-        count_collisions_kernel<<<grid_cells, block>>>(
-            d_boxes,
-            thrust::raw_pointer_cast(d_pairs.data()),
-            thrust::raw_pointer_cast(d_cell_hashes.data()),
-            thrust::raw_pointer_cast(d_cell_starts.data()),
-            thrust::raw_pointer_cast(d_cell_lengths.data()),
-            num_cells,
-            thrust::raw_pointer_cast(d_counts.data()));
-        if (!check_cuda(cudaDeviceSynchronize(), "count_collisions_kernel")) {
-            cudaFree(d_boxes);
-            return {};
-        }
+        fill_cell_hashes_kernel<<<grid_cells, block, 0, stream>>>(
+            d_pairs, d_cell_starts, num_cells, d_cell_hashes);
+        if (!check_cuda(cudaStreamSynchronize(stream), "fill_cell_hashes_kernel")) return;
     }
-    auto t_count = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] count done\n";
 
-    thrust::device_vector<uint64_t> d_offsets(num_cells + 1, 0);
+    // First cell of every level; a level no box landed on gets an empty range
+    cudaMemsetAsync(d_level_cell_begin, 0xFF, (levels.num_levels + 1) * sizeof(uint32_t), stream);
     if (num_cells > 0) {
-        thrust::exclusive_scan(d_counts.begin(), d_counts.end(), d_offsets.begin());
+        find_level_bounds_kernel<<<grid_cells, block, 0, stream>>>(
+            d_pairs, d_cell_starts, num_cells, d_level_cell_begin);
     }
-    uint64_t total_pairs = 0;
+    uint32_t* h_level_cell_begin = context.host<uint32_t>(kLevelBoundsBuffer, levels.num_levels + 1);
+    if (!h_level_cell_begin) return;
+    cudaMemcpyAsync(h_level_cell_begin, d_level_cell_begin, (levels.num_levels + 1) * sizeof(uint32_t),
+                    cudaMemcpyDeviceToHost, stream);
+    if (!check_cuda(cudaStreamSynchronize(stream), "find_level_bounds_kernel")) return;
+    h_level_cell_begin[levels.num_levels] = num_cells;
+    for (int l = levels.num_levels - 1; l >= 0; --l) {
+        if (h_level_cell_begin[l] == 0xFFFFFFFFu) h_level_cell_begin[l] = h_level_cell_begin[l + 1];
+    }
+    cudaMemcpyAsync(d_level_cell_begin, h_level_cell_begin, (levels.num_levels + 1) * sizeof(uint32_t),
+                    cudaMemcpyHostToDevice, stream);
+
+    // Boxes in cell order and the forward neighbor table for the pair kernel
+    SortedBoxes sorted_boxes;
+    sorted_boxes.min_x = context.device<float>(kSortedMinXBuffer, N);
+    sorted_boxes.min_y = context.device<float>(kSortedMinYBuffer, N);
+    sorted_boxes.max_x = context.device<float>(kSortedMaxXBuffer, N);
+    sorted_boxes.max_y = context.device<float>(kSortedMaxYBuffer, N);
+    sorted_boxes.id = context.device<uint32_t>(kSortedIdsBuffer, N);
+    sorted_boxes.quantized = nullptr;
+    int* d_neighbors = context.device<int>(kNeighborsBuffer, size_t(kNumForward) * num_cells);
+    if (!sorted_boxes.min_x || !sorted_boxes.min_y || !sorted_boxes.max_x || !sorted_boxes.max_y ||
+        !sorted_boxes.id || !d_neighbors) {
+        return;
+    }
+    permute_boxes_kernel<<<grid, block, 0, stream>>>(d_boxes, d_pairs, N, sorted_boxes);
     if (num_cells > 0) {
-        uint64_t last_offset = 0;
-        uint64_t last_count = 0;
-        cudaMemcpy(&last_offset,
-                   thrust::raw_pointer_cast(d_offsets.data()) + (num_cells - 1),
-                   sizeof(uint64_t),
-                   cudaMemcpyDeviceToHost);
-        cudaMemcpy(&last_count,
-                   thrust::raw_pointer_cast(d_counts.data()) + (num_cells - 1),
-                   sizeof(uint64_t),
-                   cudaMemcpyDeviceToHost);
-        total_pairs = last_offset + last_count;
-        cudaMemcpy(thrust::raw_pointer_cast(d_offsets.data()) + num_cells,
-                   &total_pairs,
-                   sizeof(uint64_t),
-                   cudaMemcpyHostToDevice);
+        build_neighbor_table_kernel<<<grid_cells, block, 0, stream>>>(
+            d_pairs, d_cell_starts, num_cells, d_cell_hashes, d_level_cell_begin, d_neighbors);
     }
-    auto t_scan = std::chrono::high_resolution_clock::now();
-    std::cerr << "[cuda_sh] scan done, total_pairs=" << total_pairs << "\n";
-
-    auto t_scatter = t_scan;
-    std::vector<std::pair<uint32_t, uint32_t>> pairs;
-    if (total_pairs > 0) {
-        thrust::device_vector<uint32_t> d_pair_a(total_pairs);
-        thrust::device_vector<uint32_t> d_pair_b(total_pairs);
-
-        const int grid_cells = (num_cells + block - 1) / block;
-        scatter_collisions_kernel<<<grid_cells, block>>>(
-            d_boxes,
-            thrust::raw_pointer_cast(d_pairs.data()),
-            thrust::raw_pointer_cast(d_cell_hashes.data()),
-            thrust::raw_pointer_cast(d_cell_starts.data()),
-            thrust::raw_pointer_cast(d_cell_lengths.data()),
-            num_cells,
-            thrust::raw_pointer_cast(d_offsets.data()),
-            thrust::raw_pointer_cast(d_pair_a.data()),
-            thrust::raw_pointer_cast(d_pair_b.data()));
-        if (!check_cuda(cudaDeviceSynchronize(), "scatter_collisions_kernel")) {
-            cudaFree(d_boxes);
-            return {};
+    if (!check_cuda(cudaStreamSynchronize(stream), "build_neighbor_table_kernel")) return;
+    unsigned long long* d_quant_counts = nullptr;
+    if (options.quantized) {
+        sorted_boxes.quantized = context.device<QuantBox>(kSortedQuantBuffer, N);
+        d_quant_counts = context.device<unsigned long long>(kQuantCountsBuffer, 2);
+        if (!sorted_boxes.quantized || !d_quant_counts) return;
+        if (num_cells > 0) {
+            quantize_cells_kernel<<<grid_cells, block, 0, stream>>>(
+                sorted_boxes, d_pairs, d_cell_starts, d_cell_lengths, num_cells, levels);
         }
+        if (!check_cuda(cudaStreamSynchronize(stream), "quantize_cells_kernel")) return;
+    }
 
-        std::vector<uint32_t> h_a(total_pairs);
-        std::vector<uint32_t> h_b(total_pairs);
-        if (!check_cuda(cudaMemcpy(h_a.data(), thrust::raw_pointer_cast(d_pair_a.data()),
-                   total_pairs * sizeof(uint32_t), cudaMemcpyDeviceToHost), "copy pair_a") ||
-            !check_cuda(cudaMemcpy(h_b.data(), thrust::raw_pointer_cast(d_pair_b.data()),
-                   total_pairs * sizeof(uint32_t), cudaMemcpyDeviceToHost), "copy pair_b")) {
-            cudaFree(d_boxes);
-            return {};
+    // Single pass, rerun with a larger buffer if the pairs overflow it
+    phases.mark(aabb::Phase::Sweep);
+    aabb::PairOutput out{};
+    uint64_t total_pairs = 0;
+    // Pair tests of every lane, one warp per cell, only while stats are recorded
+    aabb::EngineStats* const stats = aabb::stats_recorder();
+    const size_t num_lanes = size_t(num_cells) * kWarpSize;
+    uint32_t* d_lane_work = stats ? context.device<uint32_t>(kLaneWorkBuffer, num_lanes) : nullptr;
+    auto launch = [&](const aabb::PairOutput& output) {
+        if (d_quant_counts) cudaMemsetAsync(d_quant_counts, 0, 2 * sizeof(unsigned long long), stream);
+        const uint32_t collide_blocks = (num_cells + kCellsPerBlock - 1) / kCellsPerBlock;
+        collide_cells_kernel<<<collide_blocks, kCellsPerBlock * kWarpSize, 0, stream>>>(
+            sorted_boxes,
+            d_pairs,
+            d_cell_hashes,
+            d_cell_starts,
+            d_cell_lengths,
+            d_neighbors,
+            num_cells,
+            d_level_cell_begin,
+            levels,
+            N,
+            output,
+            d_lane_work,
+            d_quant_counts);
+    };
+    if (num_cells > 0 &&
+        !aabb::run_single_pass(context, kPairsBuffer, kPairCountBuffer, N, "cuda_sh", launch, out, total_pairs)) {
+        return;
+    }
+    if (stats) {
+        // Occupancy comes off the device; the kernel's tests are the lane work
+        uint32_t* h_cell_lengths = context.host<uint32_t>(kCellLengthsBuffer, num_cells);
+        if (!h_cell_lengths) return;
+        cudaMemcpyAsync(h_cell_lengths, d_cell_lengths, num_cells * sizeof(uint32_t),
+                        cudaMemcpyDeviceToHost, stream);
+        if (!check_cuda(cudaStreamSynchronize(stream), "cell lengths")) return;
+        for (uint32_t c = 0; c < num_cells; ++c) stats->cell_occupancy.add(h_cell_lengths[c]);
+        const uint64_t tested_before = stats->warp_work.work;
+        if (d_lane_work && !aabb::record_lane_work(context, kLaneWorkBuffer, d_lane_work, num_lanes, *stats)) {
+            return;
         }
+        stats->pairs_tested += stats->warp_work.work - tested_before;
+        stats->pairs_hit += total_pairs;
+    }
+    if (options.quant_report && d_quant_counts) {
+        unsigned long long* h_quant_counts = context.host<unsigned long long>(kQuantCountsBuffer, 2);
+        if (!h_quant_counts) return;
+        cudaMemcpyAsync(h_quant_counts, d_quant_counts, 2 * sizeof(unsigned long long),
+                        cudaMemcpyDeviceToHost, stream);
+        if (!check_cuda(cudaStreamSynchronize(stream), "quantized counts")) return;
+        aabb::QuantizationStats& report = *options.quant_report;
+        report.boxes = N;
+        report.float_bytes = uint64_t(N) * 4 * sizeof(float);
+        report.quantized_bytes = uint64_t(N) * sizeof(QuantBox);
+        report.candidates = num_cells > 0 ? h_quant_counts[0] : 0;
+        report.false_positives = num_cells > 0 ? h_quant_counts[1] : 0;
+    }
 
-        pairs.reserve(static_cast<size_t>(total_pairs));
-        for (uint64_t i = 0; i < total_pairs; ++i) {
-            pairs.emplace_back(h_a[i], h_b[i]);
-        }
-        t_scatter = std::chrono::high_resolution_clock::now();
-        std::cerr << "[cuda_sh] scatter done\n";
-    } else {
-        std::cerr << "[cuda_sh] total_pairs=0\n";
+    // Download in chunks; the sink consumes one chunk while the next copies
+    phases.mark(aabb::Phase::Scatter);
+    if (total_pairs > 0) {
+        aabb::CudaPairStream download(context, sink, kPairStagingBuffer);
+        if (!download.push(out.pairs, 0, total_pairs) || !download.finish()) return;
     }
+    phases.finish();
+}
 
-    auto t_end = std::chrono::high_resolution_clock::now();
-    auto ms = [](auto a, auto b) {
-        return std::chrono::duration<double, std::milli>(b - a).count();
-    };
-    std::cerr << "[cuda_sh] timings (ms):\n"
-              << "  prep     : " << std::fixed << std::setprecision(3) << ms(t0, t_prep) << "\n"
-              << "  assign   : " << std::fixed << std::setprecision(3) << ms(t_prep, t_assign) << "\n"
-              << "  sort     : " << std::fixed << std::setprecision(3) << ms(t_assign, t_sort) << "\n"
-              << "  bucket   : " << std::fixed << std::setprecision(3) << ms(t_sort, t_bucket) << "\n"
-              << "  hashes   : " << std::fixed << std::setprecision(3) << ms(t_bucket, t_hashes) << "\n"
-              << "  count    : " << std::fixed << std::setprecision(3) << ms(t_hashes, t_count) << "\n"
-              << "  scan     : " << std::fixed << std::setprecision(3) << ms(t_count, t_scan) << "\n"
-              << "  scatter  : " << std::fixed << std::setprecision(3) << ms(t_scan, t_scatter) << "\n"
-              << "  finalize : " << std::fixed << std::setprecision(3) << ms(t_scatter, t_end) << "\n"
-              << "  total    : " << std::fixed << std::setprecision(3) << ms(t0, t_end) << "\n";
-
-    cudaFree(d_boxes);
-    std::cerr << "[cuda_sh] return pairs=" << pairs.size() << "\n";
-
-    // Record Computation End Time
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Computation Time: " << elapsed.count() << " seconds\n";
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    aabb::CudaContext& context)
+{
+    cuda_spatial_hashing(N, boxes, sink, CudaSpatialHashingOptions{}, context);
+}
+
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink,
+    const CudaSpatialHashingOptions& options)
+{
+    cuda_spatial_hashing(N, boxes, sink, options, aabb::CudaContext::shared());
+}
+
+void cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink& sink)
+{
+    cuda_spatial_hashing(N, boxes, sink, CudaSpatialHashingOptions{});
+}
 
+std::vector<std::pair<uint32_t, uint32_t>> cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const CudaSpatialHashingOptions& options)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    cuda_spatial_hashing(N, boxes, sink, options);
     return pairs;
 }
+
+std::vector<std::pair<uint32_t, uint32_t>> cuda_spatial_hashing(
+    const uint32_t N,
+    aabb::BoxSpan boxes)
+{
+    return cuda_spatial_hashing(N, boxes, CudaSpatialHashingOptions{});
+}
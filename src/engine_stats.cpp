@@ -0,0 +1,53 @@
+#include "engine_stats.h"
+
+#include <algorithm>
+
+namespace aabb {
+
+void Log2Histogram::merge(const Log2Histogram &other) {
+    for (size_t k = 0; k < kBuckets; ++k) buckets[k] += other.buckets[k];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+void WarpWork::add_lanes(const uint32_t *lane_work, size_t num_lanes) {
+    for (size_t first = 0; first < num_lanes; first += 32) {
+        const size_t last = std::min(num_lanes, first + 32);
+        uint64_t slowest = 0;
+        for (size_t i = first; i < last; ++i) {
+            work += lane_work[i];
+            slowest = std::max<uint64_t>(slowest, lane_work[i]);
+        }
+        max_work += slowest;
+        ++warps;
+    }
+}
+
+void WarpWork::merge(const WarpWork &other) {
+    warps += other.warps;
+    work += other.work;
+    max_work += other.max_work;
+}
+
+void EngineStats::merge(const EngineStats &other) {
+    pairs_tested += other.pairs_tested;
+    pairs_hit += other.pairs_hit;
+    active_set.merge(other.active_set);
+    cell_occupancy.merge(other.cell_occupancy);
+    warp_work.merge(other.warp_work);
+}
+
+#ifdef AABB_STATS
+namespace {
+
+thread_local EngineStats *t_stats = nullptr;
+
+} // namespace
+
+EngineStats *stats_recorder() { return t_stats; }
+
+void set_stats_recorder(EngineStats *stats) { t_stats = stats; }
+#endif
+
+} // namespace aabb
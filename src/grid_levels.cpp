@@ -0,0 +1,42 @@
+#include <cmath>
+
+#include "grid_levels.h"
+
+namespace aabb {
+
+std::vector<int> choose_grid_levels(BoxSpan boxes) {
+    std::vector<float> extents(boxes.size());
+    float max_extent = 0.0f;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        extents[i] = box_extent(boxes[i]);
+        max_extent = std::max(max_extent, extents[i]);
+    }
+
+    int base = 1;
+    if (!extents.empty()) {
+        const size_t q = static_cast<size_t>(kGridLevelPercentile * (extents.size() - 1));
+        std::nth_element(extents.begin(), extents.begin() + q, extents.end());
+        base = std::max(1, static_cast<int>(std::ceil(extents[q])));
+    }
+
+    // A narrow size range gains nothing from a second level
+    const int top = std::max(1, static_cast<int>(std::ceil(max_extent)));
+    if (top <= 2 * base) return {top};
+
+    std::vector<int> sizes{base};
+    while (static_cast<int>(sizes.size()) + 1 < kMaxGridLevels &&
+           top > 2 * sizes.back()) {
+        sizes.push_back(sizes.back() * 2);
+    }
+    sizes.push_back(top);
+
+    std::vector<bool> used(sizes.size(), false);
+    for (const AABB &b : boxes) used[grid_level_of(box_extent(b), sizes)] = true;
+    std::vector<int> occupied;
+    for (size_t l = 0; l < sizes.size(); ++l) {
+        if (used[l]) occupied.push_back(sizes[l]);
+    }
+    return occupied;
+}
+
+} // namespace aabb
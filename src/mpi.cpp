@@ -0,0 +1,368 @@
+// MPI driver: the scene is cut into one slab per rank and every rank runs a
+// multithreaded CPU engine on its slab
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "aabb_io.h"
+#include "seq_sort_and_sweep_mt.h"
+#include "seq_spatial_hashing.h"
+#include "slab_partition.h"
+#include "thread_pool.h"
+
+// Largest MPI-IO write of one call; int counts cap a single write at 2 GiB
+static constexpr size_t kWriteChunkBytes = size_t(1) << 30;
+
+// Boxes [n * rank / ranks, n * (rank + 1) / ranks) of the input file. A binary
+// file is mapped, so each rank only pages in its own slice; a text file is
+// parsed whole on every rank (convert large scenes with aabb_tool first).
+static bool read_slice(const std::string &path, int rank, int ranks,
+                       std::vector<aabb::AABB> &slice, uint64_t &total, std::string &err) {
+    if (aabb::is_binary_box_file(path)) {
+        aabb::MappedBoxFile file;
+        if (!file.open(path, err)) return false;
+        total = file.size();
+        const size_t begin = static_cast<size_t>(total * rank / ranks);
+        const size_t end = static_cast<size_t>(total * (rank + 1) / ranks);
+        if (file.layout() == aabb::BoxLayout::AoS) {
+            slice.assign(file.boxes() + begin, file.boxes() + end);
+        } else {
+            slice.resize(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                slice[i - begin] = {static_cast<int>(i), file.min_x()[i], file.min_y()[i],
+                                    file.max_x()[i], file.max_y()[i]};
+            }
+        }
+        return true;
+    }
+    std::vector<aabb::AABB> boxes;
+    if (!aabb::read_boxes(path, boxes, err)) return false;
+    total = boxes.size();
+    slice.assign(boxes.begin() + static_cast<size_t>(total * rank / ranks),
+                 boxes.begin() + static_cast<size_t>(total * (rank + 1) / ranks));
+    return true;
+}
+
+// Sends every box to the ranks of its slabs; returns the boxes this rank holds
+static bool exchange_boxes(const std::vector<aabb::AABB> &slice, const aabb::SlabPartition &part,
+                           MPI_Datatype box_type, int ranks, std::vector<aabb::AABB> &local,
+                           std::string &err) {
+    std::vector<size_t> send_count(ranks, 0);
+    for (const aabb::AABB &b : slice) {
+        for (size_t s = part.first(b); s <= part.last(b); ++s) ++send_count[s];
+    }
+    std::vector<size_t> send_offset(ranks + 1, 0);
+    for (int r = 0; r < ranks; ++r) send_offset[r + 1] = send_offset[r] + send_count[r];
+    std::vector<aabb::AABB> send(send_offset[ranks]);
+    std::vector<size_t> fill(send_offset.begin(), send_offset.end() - 1);
+    for (const aabb::AABB &b : slice) {
+        for (size_t s = part.first(b); s <= part.last(b); ++s) send[fill[s]++] = b;
+    }
+
+    // Alltoallv counts and displacements are ints
+    bool fits = send_offset[ranks] <= INT_MAX;
+    std::vector<int> counts(ranks), displs(ranks), recv_counts(ranks), recv_displs(ranks);
+    for (int r = 0; r < ranks; ++r) {
+        counts[r] = static_cast<int>(send_count[r]);
+        displs[r] = static_cast<int>(send_offset[r]);
+    }
+    MPI_Alltoall(counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    size_t received = 0;
+    for (int r = 0; r < ranks; ++r) {
+        recv_displs[r] = static_cast<int>(std::min<size_t>(received, INT_MAX));
+        received += static_cast<size_t>(recv_counts[r]);
+    }
+    fits = fits && received <= INT_MAX;
+    int all_fit = fits ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &all_fit, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!all_fit) {
+        err = "a rank sends or receives more than INT_MAX boxes; run with more ranks";
+        return false;
+    }
+    local.resize(received);
+    MPI_Alltoallv(send.data(), counts.data(), displs.data(), box_type,
+                  local.data(), recv_counts.data(), recv_displs.data(), box_type, MPI_COMM_WORLD);
+    return true;
+}
+
+// Owned pairs of this rank in the output format, for one shared MPI-IO file
+static std::string encode_pairs(const std::vector<aabb::Pair> &pairs, aabb::PairFormat format) {
+    std::string out;
+    if (format == aabb::PairFormat::Binary) {
+        out.resize(pairs.size() * 2 * sizeof(uint32_t));
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            std::memcpy(&out[i * 8], &pairs[i].first, sizeof(uint32_t));
+            std::memcpy(&out[i * 8 + 4], &pairs[i].second, sizeof(uint32_t));
+        }
+        return out;
+    }
+    out.reserve(pairs.size() * 16);
+    char digits[12];
+    for (const aabb::Pair &p : pairs) {
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), p.first).ptr);
+        out.push_back(' ');
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), p.second).ptr);
+        out.push_back('\n');
+    }
+    return out;
+}
+
+// Writes every rank's bytes at its offset in one file, with a pair file
+// header first for the binary format
+static bool write_shared(const std::string &path, const std::string &bytes, aabb::PairFormat format,
+                         uint64_t total_pairs, int rank, std::string &err) {
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        err = "cannot open " + path;
+        return false;
+    }
+    MPI_File_set_size(file, 0);
+    unsigned long long size = bytes.size(), offset = 0;
+    MPI_Exscan(&size, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) offset = 0;
+    if (format == aabb::PairFormat::Binary) {
+        offset += sizeof(aabb::PairFileHeader);
+        if (rank == 0) {
+            aabb::PairFileHeader header{};
+            std::memcpy(header.magic, aabb::kPairFileMagicBinary, sizeof(header.magic));
+            header.version = aabb::kPairFileVersion;
+            header.count = total_pairs;
+            MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        }
+    }
+
+    // Collective writes need the same number of calls on every rank
+    unsigned long long rounds = (size + kWriteChunkBytes - 1) / kWriteChunkBytes;
+    MPI_Allreduce(MPI_IN_PLACE, &rounds, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    int ok = 1;
+    for (unsigned long long k = 0; k < rounds; ++k) {
+        const size_t begin = std::min<size_t>(k * kWriteChunkBytes, bytes.size());
+        const size_t count = std::min(kWriteChunkBytes, bytes.size() - begin);
+        if (MPI_File_write_at_all(file, static_cast<MPI_Offset>(offset + begin), bytes.data() + begin,
+                                  static_cast<int>(count), MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+            ok = 0;
+        }
+    }
+    MPI_File_close(&file);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!ok) err = "write to " + path + " failed";
+    return ok != 0;
+}
+
+int main(int argc, char **argv) {
+    int provided = 0;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank = 0, ranks = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    // Every rank parses the arguments; only rank 0 explains them
+    auto fail = [&](int code) {
+        MPI_Finalize();
+        return code;
+    };
+    if (argc < 3) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0] << " <algorithm> <testcase number> [--format text|bin|varint] [--axis x|y|auto] [--threads N] [--per-rank]\n";
+            std::cerr << "  algorithm: SS (SS_MT on each rank) or SH (SH_MT on each rank)\n";
+            std::cerr << "  --axis:   axis the rank slabs cut; auto picks the one with fewer halo boxes (default: auto)\n";
+            std::cerr << "  --threads: worker threads per rank (default: hardware threads)\n";
+            std::cerr << "  --per-rank: write out/<testcase>_mpi.<rank>.out per rank instead of one file with MPI-IO\n";
+        }
+        return fail(1);
+    }
+
+    aabb::PairFormat out_format = aabb::PairFormat::Text;
+    aabb::SweepAxis axis = aabb::SweepAxis::Auto;
+    unsigned threads = 0;
+    bool per_rank = false;
+    for (int i = 3; i < argc; ++i) {
+        const std::string opt = argv[i];
+        if (opt == "--format" && i + 1 < argc && aabb::parse_pair_format(argv[i + 1], out_format)) {
+            ++i;
+        } else if (opt == "--axis" && i + 1 < argc && aabb::parse_sweep_axis(argv[i + 1], axis)) {
+            ++i;
+        } else if (opt == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (opt == "--per-rank") {
+            per_rank = true;
+        } else {
+            if (rank == 0) std::cerr << "Unknown option: " << opt << '\n';
+            return fail(1);
+        }
+    }
+    const std::string algorithm = argv[1];
+    if (algorithm != "SS" && algorithm != "SH") {
+        if (rank == 0) {
+            std::cerr << "Unknown algorithm: " << algorithm << '\n';
+            std::cerr << "Valid options are: SS, SH\n";
+        }
+        return fail(4);
+    }
+    if (!per_rank && out_format == aabb::PairFormat::Varint) {
+        if (rank == 0) std::cerr << "varint output needs --per-rank (its deltas cannot be split)\n";
+        return fail(1);
+    }
+
+    const std::string testcase = argv[2];
+    const std::string in_path = aabb::testcase_input_path(testcase);
+    const std::string out_path = per_rank ? "out/" + testcase + "_mpi." + std::to_string(rank) + ".out"
+                                          : "out/" + testcase + ".out";
+
+    MPI_Datatype box_type;
+    MPI_Type_contiguous(sizeof(aabb::AABB), MPI_BYTE, &box_type);
+    MPI_Type_commit(&box_type);
+
+    // Phase wall times of this rank: load, partition, exchange, detect, write
+    double phase[5] = {};
+    double mark = MPI_Wtime();
+    auto next_phase = [&](int p) {
+        const double now = MPI_Wtime();
+        phase[p] = now - mark;
+        mark = now;
+    };
+
+    std::vector<aabb::AABB> slice;
+    uint64_t total = 0;
+    std::string err;
+    int ok = read_slice(in_path, rank, ranks, slice, total, err) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!ok) {
+        if (!err.empty()) std::cerr << "[mpi] rank " << rank << ": failed to read file: " << err << '\n';
+        return fail(2);
+    }
+    if (total > static_cast<uint64_t>(INT_MAX)) {
+        if (rank == 0) std::cerr << "[mpi] box ids are ints; " << total << " boxes do not fit\n";
+        return fail(2);
+    }
+    next_phase(0);
+
+    // Splitters from a gathered sample of every slice, so clustered scenes
+    // still give each rank about as many boxes
+    const size_t per_rank_sample = (aabb::kSlabSample + ranks - 1) / ranks;
+    std::vector<aabb::AABB> sample;
+    const size_t s = std::min(slice.size(), per_rank_sample);
+    for (size_t k = 0; k < s; ++k) sample.push_back(slice[k * slice.size() / s]);
+    int sample_count = static_cast<int>(s);
+    std::vector<int> sample_counts(ranks), sample_displs(ranks, 0);
+    MPI_Allgather(&sample_count, 1, MPI_INT, sample_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r = 1; r < ranks; ++r) sample_displs[r] = sample_displs[r - 1] + sample_counts[r - 1];
+    std::vector<aabb::AABB> gathered(sample_displs[ranks - 1] + sample_counts[ranks - 1]);
+    MPI_Allgatherv(sample.data(), sample_count, box_type, gathered.data(), sample_counts.data(),
+                   sample_displs.data(), box_type, MPI_COMM_WORLD);
+    const aabb::SlabPartition part =
+        aabb::partition_slabs(gathered, static_cast<size_t>(ranks), axis, gathered.size());
+    next_phase(1);
+
+    std::vector<aabb::AABB> local;
+    if (!exchange_boxes(slice, part, box_type, ranks, local, err)) {
+        if (rank == 0) std::cerr << "[mpi] " << err << '\n';
+        return fail(2);
+    }
+    std::vector<aabb::AABB>().swap(slice);
+    next_phase(2);
+
+    // Local ids index the received boxes; the file ids are kept aside
+    std::vector<uint32_t> ids(local.size());
+    uint64_t halo = 0;
+    for (size_t i = 0; i < local.size(); ++i) {
+        ids[i] = static_cast<uint32_t>(local[i].id);
+        local[i].id = static_cast<int>(i);
+        if (part.first(local[i]) != static_cast<size_t>(rank)) ++halo;
+    }
+
+    aabb::PairWriter writer;
+    ok = (!per_rank || writer.open(out_path, out_format, err)) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!ok) {
+        if (!err.empty()) std::cerr << "[mpi] rank " << rank << ": failed to write pairs: " << err << '\n';
+        return fail(3);
+    }
+
+    // Keep the pairs this rank owns, in file ids
+    std::vector<aabb::Pair> owned, chunk;
+    uint64_t candidates = 0;
+    aabb::CallbackPairSink filter([&](const aabb::Pair *pairs, size_t count) {
+        candidates += count;
+        chunk.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (!part.owns(static_cast<size_t>(rank), local[pairs[i].first], local[pairs[i].second])) continue;
+            const uint32_t a = ids[pairs[i].first], b = ids[pairs[i].second];
+            chunk.emplace_back(std::min(a, b), std::max(a, b));
+        }
+        if (per_rank) {
+            writer.write(chunk.data(), chunk.size());
+        } else {
+            owned.insert(owned.end(), chunk.begin(), chunk.end());
+        }
+    });
+    const uint32_t n = static_cast<uint32_t>(local.size());
+    if (algorithm == "SS") {
+        SortAndSweepOptions options;
+        options.threads = threads;
+        sort_and_sweep_mt(n, local, filter, options);
+    } else {
+        spatial_hashing_mt(local, filter, threads);
+    }
+    uint64_t num_pairs = per_rank ? writer.count() : owned.size();
+    next_phase(3);
+
+    uint64_t total_pairs = 0;
+    MPI_Allreduce(&num_pairs, &total_pairs, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    ok = per_rank ? (writer.close(err) ? 1 : 0)
+                  : (write_shared(out_path, encode_pairs(owned, out_format), out_format, total_pairs, rank, err) ? 1 : 0);
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!ok) {
+        if (!err.empty()) std::cerr << "[mpi] rank " << rank << ": failed to write pairs: " << err << '\n';
+        return fail(3);
+    }
+    next_phase(4);
+
+    // Per-rank report on rank 0: boxes, halo, candidates, pairs, then phases
+    const int kFields = 9;
+    double row[kFields] = {static_cast<double>(local.size()), static_cast<double>(halo),
+                           static_cast<double>(candidates), static_cast<double>(num_pairs),
+                           phase[0], phase[1], phase[2], phase[3], phase[4]};
+    std::vector<double> rows(rank == 0 ? kFields * ranks : 0);
+    MPI_Gather(row, kFields, MPI_DOUBLE, rows.data(), kFields, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        // The detection time is the slowest rank's partition, exchange and detect
+        double slowest[5] = {}, elapsed = 0.0;
+        uint64_t halo_total = 0;
+        for (int r = 0; r < ranks; ++r) {
+            const double *v = &rows[r * kFields];
+            halo_total += static_cast<uint64_t>(v[1]);
+            for (int p = 0; p < 5; ++p) slowest[p] = std::max(slowest[p], v[4 + p]);
+            elapsed = std::max(elapsed, v[5] + v[6] + v[7]);
+        }
+        std::cout << "Loaded " << total << " boxes from " << in_path << " on " << ranks << " ranks, "
+                  << aabb::resolve_threads(threads) << " threads each\n";
+        std::cout << "Slabs along " << aabb::sweep_axis_name(part.axis) << ", halo copies " << halo_total << "\n";
+        for (int r = 0; r < ranks; ++r) {
+            const double *v = &rows[r * kFields];
+            std::cout << "  rank " << r << " [" << part.bounds[r] << ", " << part.bounds[r + 1] << "): "
+                      << static_cast<uint64_t>(v[0]) << " boxes (" << static_cast<uint64_t>(v[1]) << " halo), "
+                      << static_cast<uint64_t>(v[2]) << " candidates, " << static_cast<uint64_t>(v[3])
+                      << " owned pairs, detect " << v[7] << " seconds\n";
+        }
+        std::cout << "Slowest rank: load " << slowest[0] << ", partition " << slowest[1] << ", exchange "
+                  << slowest[2] << ", detect " << slowest[3] << ", write " << slowest[4] << " seconds\n";
+        std::cout << "Algorithm: MPI " << (algorithm == "SS" ? "Sort-and-Sweep" : "Spatial Hashing")
+                  << ", Time elapsed: " << elapsed << " seconds\n";
+        std::cout << "Read " << total << " boxes, found " << total_pairs << " pairs. Wrote: "
+                  << (per_rank ? "out/" + testcase + "_mpi.<rank>.out" : out_path) << "\n";
+    }
+
+    MPI_Type_free(&box_type);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace aabb {
+
+#ifdef __linux__
+static int open_counter(uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;  // include the worker threads of the _MT engines
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd >= 0) ::close(fd);
+    }
+#endif
+}
+
+bool PerfCounters::open(std::string &err) {
+#ifdef __linux__
+    static const uint64_t configs[kNumCounters] = {
+        PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    bool any = false;
+    for (int c = 0; c < kNumCounters; ++c) {
+        if (fds_[c] < 0) fds_[c] = open_counter(configs[c]);
+        if (fds_[c] >= 0) {
+            any = true;
+        } else {
+            err = std::string("perf_event_open: ") + std::strerror(errno);
+        }
+    }
+    if (any) err.clear();
+    return any;
+#else
+    err = "perf_event counters need Linux";
+    return false;
+#endif
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void PerfCounters::stop() {
+#ifdef __linux__
+    for (int c = 0; c < kNumCounters; ++c) {
+        values_[c] = 0;
+        if (fds_[c] < 0) continue;
+        ioctl(fds_[c], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t v = 0;
+        if (read(fds_[c], &v, sizeof(v)) == static_cast<ssize_t>(sizeof(v))) values_[c] = v;
+    }
+#endif
+}
+
+const char *PerfCounters::name(Counter c) {
+    switch (c) {
+    case kInstructions: return "instructions";
+    case kCacheMisses: return "cache_misses";
+    case kBranchMisses: return "branch_misses";
+    case kNumCounters: break;
+    }
+    return "unknown";
+}
+
+} // namespace aabb
@@ -0,0 +1,50 @@
+#include "phase_timer.h"
+
+namespace aabb {
+
+namespace {
+
+thread_local PhaseTimes *t_recorder = nullptr;
+thread_local ScopedPhase *t_current = nullptr;
+
+} // namespace
+
+const char *phase_name(Phase phase) {
+    switch (phase) {
+    case Phase::Load: return "load";
+    case Phase::Build: return "build";
+    case Phase::Sort: return "sort";
+    case Phase::Sweep: return "sweep";
+    case Phase::Scatter: return "scatter";
+    case Phase::Dedupe: return "dedupe";
+    case Phase::Write: return "write";
+    }
+    return "unknown";
+}
+
+PhaseTimes *phase_recorder() { return t_recorder; }
+
+void set_phase_recorder(PhaseTimes *times) {
+    t_recorder = times;
+    t_current = nullptr;
+}
+
+ScopedPhase::ScopedPhase(Phase phase) : times_(t_recorder), phase_(phase) {
+    if (!times_) return;
+    start_ = Clock::now();
+    parent_ = t_current;
+    if (parent_) {
+        parent_->times_->add(parent_->phase_, std::chrono::duration<double>(start_ - parent_->start_).count());
+    }
+    t_current = this;
+}
+
+ScopedPhase::~ScopedPhase() {
+    if (!times_) return;
+    const Clock::time_point now = Clock::now();
+    times_->add(phase_, std::chrono::duration<double>(now - start_).count());
+    t_current = parent_;
+    if (parent_) parent_->start_ = now;
+}
+
+} // namespace aabb
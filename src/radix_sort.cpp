@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <array>
+
+#include "radix_sort.h"
+#include "thread_pool.h"
+
+namespace aabb {
+
+// 11-bit digits (three passes for 32-bit keys), histograms stay in L1
+static constexpr unsigned kRadixBits = 11;
+static constexpr unsigned kBuckets = 1u << kRadixBits;
+
+// Below this many items per block the pass runs on the calling thread
+static constexpr size_t kMinBlock = size_t(1) << 16;
+
+// sort_pairs: fewer pairs than this, or more id buckets per pair, use std::sort
+static constexpr size_t kMinCountingPairs = 1024;
+static constexpr size_t kMaxBucketsPerPair = 4;
+
+template <typename Key>
+static void radix_sort_impl(
+    std::vector<Key> &keys,
+    std::vector<uint32_t> &values,
+    ThreadPool *pool,
+    RadixScratch<Key> *scratch)
+{
+    constexpr unsigned kPasses = (sizeof(Key) * 8 + kRadixBits - 1) / kRadixBits;
+    const size_t n = keys.size();
+    if (n < 2) return;
+
+    size_t num_blocks = pool ? std::min<size_t>(pool->size(), n / kMinBlock) : 1;
+    num_blocks = std::max<size_t>(1, num_blocks);
+    std::vector<size_t> block_begin(num_blocks + 1);
+    for (size_t b = 0; b <= num_blocks; ++b) block_begin[b] = n * b / num_blocks;
+
+    RadixScratch<Key> local;
+    if (!scratch) scratch = &local;
+    std::vector<Key> &tmp_keys = scratch->keys;
+    std::vector<uint32_t> &tmp_values = scratch->values;
+    tmp_keys.resize(n);
+    tmp_values.resize(n);
+    std::vector<std::array<size_t, kBuckets>> hist(num_blocks);
+
+    auto for_blocks = [&](const auto &fn) {
+        if (num_blocks == 1) {
+            fn(0);
+        } else {
+            pool->run(num_blocks, [&](size_t b, unsigned) { fn(b); });
+        }
+    };
+
+    for (unsigned pass = 0; pass < kPasses; ++pass) {
+        const unsigned shift = pass * kRadixBits;
+
+        // Per-block digit histograms
+        for_blocks([&](size_t b) {
+            auto &h = hist[b];
+            h.fill(0);
+            for (size_t i = block_begin[b]; i < block_begin[b + 1]; ++i) {
+                ++h[(keys[i] >> shift) & (kBuckets - 1)];
+            }
+        });
+
+        // Digit-major, block-minor prefix sum gives every block its write offsets
+        size_t offset = 0;
+        bool trivial = false;
+        for (unsigned d = 0; d < kBuckets; ++d) {
+            size_t digit_total = 0;
+            for (size_t b = 0; b < num_blocks; ++b) {
+                const size_t c = hist[b][d];
+                hist[b][d] = offset;
+                offset += c;
+                digit_total += c;
+            }
+            if (digit_total == n) trivial = true;
+        }
+        // Every key has the same digit (e.g. unused high bits): nothing to move
+        if (trivial) continue;
+
+        for_blocks([&](size_t b) {
+            auto &pos = hist[b];
+            for (size_t i = block_begin[b]; i < block_begin[b + 1]; ++i) {
+                const size_t p = pos[(keys[i] >> shift) & (kBuckets - 1)]++;
+                tmp_keys[p] = keys[i];
+                tmp_values[p] = values[i];
+            }
+        });
+        keys.swap(tmp_keys);
+        values.swap(tmp_values);
+    }
+}
+
+void radix_sort_pairs(
+    std::vector<uint32_t> &keys,
+    std::vector<uint32_t> &values,
+    ThreadPool *pool,
+    RadixScratch<uint32_t> *scratch)
+{
+    radix_sort_impl(keys, values, pool, scratch);
+}
+
+void radix_sort_pairs(
+    std::vector<uint64_t> &keys,
+    std::vector<uint32_t> &values,
+    ThreadPool *pool,
+    RadixScratch<uint64_t> *scratch)
+{
+    radix_sort_impl(keys, values, pool, scratch);
+}
+
+void sort_pairs(std::vector<Pair> &pairs) {
+    const size_t n = pairs.size();
+    uint32_t max_id = 0;
+    for (const Pair &p : pairs) max_id = std::max({max_id, p.first, p.second});
+    const size_t buckets = size_t(max_id) + 1;
+    if (n < kMinCountingPairs || buckets > kMaxBucketsPerPair * n) {
+        std::sort(pairs.begin(), pairs.end());
+        return;
+    }
+
+    std::vector<Pair> tmp(n);
+    std::vector<size_t> offset(buckets + 1);
+    auto pass = [&](const std::vector<Pair> &in, std::vector<Pair> &out, auto digit) {
+        std::fill(offset.begin(), offset.end(), 0);
+        for (const Pair &p : in) ++offset[digit(p) + 1];
+        for (size_t b = 1; b <= buckets; ++b) offset[b] += offset[b - 1];
+        for (const Pair &p : in) out[offset[digit(p)]++] = p;
+    };
+    pass(pairs, tmp, [](const Pair &p) { return p.second; });
+    pass(tmp, pairs, [](const Pair &p) { return p.first; });
+}
+
+} // namespace aabb
@@ -5,22 +5,223 @@
 #include <string>
 #include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
 
 #include "seq_sort_and_sweep.h"
+#include "seq_sort_and_sweep_mt.h"
 #include "seq_bruteforce.h"
+#include "seq_bvh.h"
+#include "seq_external_sweep.h"
 #include "seq_spatial_hashing.h"
 
 #include "aabb_io.h"
+#include "broad_phase.h"
+#include "engine_select.h"
+#include "simd_overlap.h"
+#include "thread_pool.h"
+
+// Multi-frame run of an incremental broad phase (gen.py --frames). Each frame
+// is timed from update() through the delta query; reading the frame is not.
+// The deltas are applied to a running pair list, so the output file holds the
+// pairs of the last frame and can be judged against a static run on it.
+static int run_frames(
+    aabb::BroadPhaseMethod method,
+    const std::string &algorithm,
+    const std::string &testcase,
+    unsigned frames,
+    aabb::PairFormat out_format)
+{
+    std::unique_ptr<aabb::BroadPhase> broad_phase = aabb::make_broad_phase(method);
+    std::vector<aabb::AABB> boxes;
+    std::vector<aabb::Pair> pairs, added, removed, merged;
+    std::string err;
+    double total = 0.0, first = 0.0;
+    uint64_t num_added = 0, num_removed = 0, rebuilds = 0, swaps = 0, moved = 0;
+
+    for (unsigned f = 0; f < frames; ++f) {
+        const std::string in_path = aabb::testcase_frame_path(testcase, f);
+        if (!aabb::read_boxes(in_path, boxes, err)) {
+            std::cerr << "Failed to read file: " << err << '\n';
+            return 2;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        broad_phase->update(boxes);
+        broad_phase->query(added, removed);
+        auto end = std::chrono::high_resolution_clock::now();
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        total += seconds;
+        if (f == 0) first = seconds;
+        num_added += added.size();
+        num_removed += removed.size();
+        rebuilds += broad_phase->stats().rebuilt ? 1 : 0;
+        swaps += broad_phase->stats().swaps;
+        moved += broad_phase->stats().moved;
+
+        // pairs := (pairs - removed) + added, all sorted
+        merged.clear();
+        std::set_difference(pairs.begin(), pairs.end(), removed.begin(), removed.end(),
+                            std::back_inserter(merged));
+        pairs.clear();
+        std::merge(merged.begin(), merged.end(), added.begin(), added.end(), std::back_inserter(pairs));
+    }
+
+    const std::string last = frames > 1 ? testcase + ".f" + std::to_string(frames - 1) : testcase;
+    const std::string out_path = "out/" + last + ".out";
+    std::cout << "Algorithm: " << algorithm << " (incremental), Frames: " << frames
+              << ", Time elapsed: " << total << " seconds\n";
+    std::cout << "First frame: " << first << " seconds, later frames: "
+              << (frames > 1 ? (total - first) / (frames - 1) : 0.0) << " seconds per frame\n";
+    std::cout << "Pairs added: " << num_added << ", removed: " << num_removed
+              << ", rebuilds: " << rebuilds;
+    if (method == aabb::BroadPhaseMethod::SortAndSweep) {
+        std::cout << ", endpoint swaps: " << swaps << "\n";
+    } else {
+        std::cout << ", boxes moved between cells: " << moved << "\n";
+    }
+
+    if (!aabb::write_pairs(out_path, pairs, out_format, err)) {
+        std::cerr << "Failed to write pairs: " << err << '\n';
+        return 3;
+    }
+    std::cout << "Read " << boxes.size() << " boxes, found " << pairs.size()
+              << " pairs in the last frame. Wrote: " << out_path << "\n";
+    return 0;
+}
+
+// Out-of-core sort-and-sweep: the binary input is streamed from disk and the
+// pairs straight to the writer, so neither is ever held in memory
+static int run_external(
+    const std::string &testcase,
+    ExternalSweepOptions options,
+    aabb::PairFormat out_format)
+{
+    const std::string in_path = aabb::testcase_input_path(testcase);
+    const std::string out_path = "out/" + testcase + ".out";
+    if (!aabb::is_binary_box_file(in_path)) {
+        std::cerr << "SS_EXT reads binary box files; convert " << in_path
+                  << " with bin/aabb_tool convert first\n";
+        return 2;
+    }
+
+    aabb::PairWriter writer;
+    std::string err;
+    if (!writer.open(out_path, out_format, err)) {
+        std::cerr << "Failed to write pairs: " << err << '\n';
+        return 3;
+    }
+    ExternalSweepReport report;
+    options.report = &report;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!external_sort_and_sweep(in_path, writer, options, err)) {
+        std::cerr << "Failed to run SS_EXT: " << err << '\n';
+        return 2;
+    }
+    if (!writer.close(err)) {
+        std::cerr << "Failed to write pairs: " << err << '\n';
+        return 3;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << "Algorithm: SS_EXT, Time elapsed: " << seconds << " seconds (including reading and streamed output)\n";
+    std::cout << "Sweep axis: " << aabb::sweep_axis_name(report.axis) << ", runs: " << report.runs
+              << " of up to " << options.chunk_boxes << " boxes, spilled " << report.spilled_bytes
+              << " bytes, peak active set " << report.peak_active << " boxes, peak buffers "
+              << report.peak_memory_bytes << " bytes\n";
+    std::cout << "Read " << report.boxes << " boxes, found " << writer.count() << " pairs. Wrote: " << out_path << "\n";
+    return 0;
+}
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <testcase number> <algorithm>\n";
+        std::cerr << "Usage: " << argv[0] << " <algorithm> <testcase number> [--format text|bin|varint] [--stream] [--simd scalar|avx2|avx512|neon] [--active-set ordered|swap] [--axis x|y|auto|pca] [--threads N] [--frames N] [--unsorted] [--chunk N] [--temp DIR] [--quantize]\n";
+        std::cerr << "  algorithm: BF, SS, SH, BVH, the multithreaded SS_MT and SH_MT, AUTO to pick one from sampled scene statistics, or SS_EXT (out-of-core SS on a .bin input)\n";
+        std::cerr << "  --stream: write pairs while detecting instead of collecting and sorting them first\n";
+        std::cerr << "  --simd:   cap the overlap kernels at this instruction set (default: widest available)\n";
+        std::cerr << "  --active-set: SS active-set structure (default: swap)\n";
+        std::cerr << "  --axis:   SS sweep axis; auto samples the boxes and picks x or y (default: auto)\n";
+        std::cerr << "  --threads: worker threads of the _MT engines (default: hardware threads)\n";
+        std::cerr << "  --frames: run SS or SH incrementally over frames 0..N-1 of the testcase\n";
+        std::cerr << "  --unsorted: keep the engine's emission order instead of sorting the pairs\n";
+        std::cerr << "  --chunk:  SS_EXT boxes sorted in memory per run (default: 4194304)\n";
+        std::cerr << "  --temp:   SS_EXT directory of the run files (default: $TMPDIR or /tmp)\n";
+        std::cerr << "  --quantize: SS_MT and SH_MT (or AUTO) test int16 coordinates and re-check hits on the floats\n";
         return 1;
     }
 
+    // Optional flags after the positional arguments
+    aabb::PairFormat out_format = aabb::PairFormat::Text;
+    bool stream = false;
+    SortAndSweepOptions ss_options;
+    aabb::AxisEstimate ss_axis;
+    ss_options.report = &ss_axis;
+    unsigned threads = 0;
+    unsigned frames = 0;
+    ExternalSweepOptions ext_options;
+    aabb::QuantizationStats quant;
+    for (int i = 3; i < argc; ++i) {
+        const std::string opt = argv[i];
+        if (opt == "--format" && i + 1 < argc && aabb::parse_pair_format(argv[i + 1], out_format)) {
+            ++i;
+        } else if (opt == "--stream") {
+            stream = true;
+        } else if (opt == "--unsorted") {
+            ss_options.order = aabb::PairOrder::Engine;
+        } else if (opt == "--active-set" && i + 1 < argc &&
+                   parse_active_set_kind(argv[i + 1], ss_options.active_set)) {
+            ++i;
+        } else if (opt == "--axis" && i + 1 < argc && aabb::parse_sweep_axis(argv[i + 1], ss_options.axis)) {
+            ++i;
+        } else if (opt == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (opt == "--chunk" && i + 1 < argc) {
+            ext_options.chunk_boxes = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+        } else if (opt == "--temp" && i + 1 < argc) {
+            ext_options.temp_dir = argv[++i];
+        } else if (opt == "--quantize") {
+            ss_options.quantized = true;
+            ss_options.quant_report = &quant;
+        } else if (opt == "--frames" && i + 1 < argc) {
+            frames = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (opt == "--simd" && i + 1 < argc) {
+            aabb::simd::Isa isa;
+            if (!aabb::simd::parse_isa(argv[++i], isa) || !aabb::simd::set_isa(isa)) {
+                std::cerr << "Unsupported SIMD instruction set: " << argv[i] << '\n';
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << opt << '\n';
+            return 1;
+        }
+    }
+
+    ss_options.threads = threads;
+    SpatialHashingOptions sh_options;
+    sh_options.threads = threads;
+    sh_options.quantized = ss_options.quantized;
+    sh_options.quant_report = ss_options.quant_report;
+
     // Prepare file paths
     std::string testcase = argv[2];
-    std::string in_path = "testcase/" + testcase + ".in";
+    if (frames > 0) {
+        aabb::BroadPhaseMethod method;
+        if (!aabb::parse_broad_phase_method(argv[1], method)) {
+            std::cerr << "--frames supports the incremental SS and SH only\n";
+            return 4;
+        }
+        return run_frames(method, argv[1], testcase, frames, out_format);
+    }
+
+    if (std::string(argv[1]) == "SS_EXT") {
+        ext_options.axis = ss_options.axis;
+        return run_external(testcase, ext_options, out_format);
+    }
+
+    std::string in_path = aabb::testcase_input_path(testcase);
     std::string out_path = "out/" + testcase + ".out";
 
     // Read boxes from input file
@@ -32,35 +233,109 @@ int main(int argc, char **argv) {
     }
     const uint32_t N = static_cast<uint32_t>(boxes.size());
 
+    // Select the algorithm
+    std::string algorithm = argv[1];
+    if (algorithm != "BF" && algorithm != "SS" && algorithm != "SH" && algorithm != "BVH" &&
+        algorithm != "SS_MT" && algorithm != "SH_MT" && algorithm != "AUTO") {
+        std::cerr << "Unknown algorithm: " << algorithm << '\n';
+        std::cerr << "Valid options are: BF, SS, SH, BVH, SS_MT, SH_MT, AUTO, SS_EXT\n";
+        return 4;
+    }
+    // AUTO is resolved inside the timed detection, and it only picks SS_MT or SH_MT
+    const bool quantized_engine = algorithm == "SS_MT" || algorithm == "SH_MT" || algorithm == "AUTO";
+    if (ss_options.quantized && !quantized_engine) {
+        std::cerr << "--quantize supports SS_MT, SH_MT and AUTO only\n";
+        return 4;
+    }
+
+    // Streaming mode: the engine emits into the writer, pairs are never materialized
+    aabb::PairWriter writer;
+    if (stream && !writer.open(out_path, out_format, err)) {
+        std::cerr << "Failed to write pairs: " << err << '\n';
+        return 3;
+    }
+
     // ----------- Detection start ------------
     auto start = std::chrono::high_resolution_clock::now();
 
-    // Select and run the algorithm
-    std::string algorithm = argv[1];
+    // AUTO measures the scene as part of the detection time
+    std::string auto_choice;
+    if (algorithm == "AUTO") {
+        const aabb::SceneStats scene = aabb::measure_scene(boxes);
+        const aabb::EngineChoice choice = aabb::choose_engine(scene, false);
+        algorithm = aabb::engine_name(choice);
+        auto_choice = aabb::describe_choice(scene, choice);
+    }
+
     std::vector<std::pair<uint32_t, uint32_t>> pairs;
-    if (algorithm == "BF") {
+    if (stream) {
+        if (algorithm == "BF") {
+            brute_force(N, boxes, writer);
+        } else if (algorithm == "SS") {
+            sort_and_sweep(N, boxes, writer, ss_options);
+        } else if (algorithm == "SS_MT") {
+            sort_and_sweep_mt(N, boxes, writer, ss_options);
+        } else if (algorithm == "SH_MT") {
+            spatial_hashing_mt(boxes, writer, sh_options);
+        } else if (algorithm == "BVH") {
+            bvh(N, boxes, writer);
+        } else {
+            spatial_hashing(boxes, writer);
+        }
+        if (!writer.close(err)) {
+            std::cerr << "Failed to write pairs: " << err << '\n';
+            return 3;
+        }
+    } else if (algorithm == "BF") {
         pairs = brute_force(N, boxes);
     } else if (algorithm == "SS") {
-        pairs = sort_and_sweep(N, boxes);
-    } else if (algorithm == "SH") {
-        pairs = spatial_hashing(boxes);
+        pairs = sort_and_sweep(N, boxes, ss_options);
+    } else if (algorithm == "SS_MT") {
+        pairs = sort_and_sweep_mt(N, boxes, ss_options);
+    } else if (algorithm == "SH_MT") {
+        pairs = spatial_hashing_mt(boxes, sh_options);
+    } else if (algorithm == "BVH") {
+        pairs = bvh(N, boxes, ss_options.order);
     } else {
-        std::cerr << "Unknown algorithm: " << algorithm << '\n';
-        std::cerr << "Valid options are: BF, SS, SH\n";
-        return 4;
+        pairs = spatial_hashing(boxes, ss_options.order);
     }
 
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Algorithm: " << algorithm << ", Time elapsed: " << elapsed.count() << " seconds\n";
+    std::cout << "SIMD: " << aabb::simd::isa_name(aabb::simd::active_isa()) << "\n";
+    if (!auto_choice.empty()) std::cout << "AUTO picked " << auto_choice << "\n";
+    std::cout << "Algorithm: " << algorithm << ", Time elapsed: " << elapsed.count() << " seconds"
+              << (stream ? " (including streamed output)" : "") << "\n";
+    if (algorithm == "SS_MT" || algorithm == "SH_MT") {
+        std::cout << "Threads: " << aabb::resolve_threads(threads) << "\n";
+    }
+    if (algorithm == "SS" || algorithm == "SS_MT") {
+        std::cout << "Sweep axis: " << aabb::sweep_axis_name(ss_axis.axis);
+        if (ss_axis.axis == aabb::SweepAxis::PCA) {
+            std::cout << " (" << ss_axis.dir_x << ", " << ss_axis.dir_y << ")";
+        }
+        std::cout << ", estimated candidates x=" << static_cast<uint64_t>(ss_axis.candidates_x)
+                  << " y=" << static_cast<uint64_t>(ss_axis.candidates_y);
+        if (ss_axis.candidates_pca >= 0.0) {
+            std::cout << " pca=" << static_cast<uint64_t>(ss_axis.candidates_pca);
+        }
+        std::cout << " (sample " << ss_axis.sample_size << ")\n";
+    }
+    if (ss_options.quantized) {
+        std::cout << "Quantized: " << quant.boxes << " boxes, coordinate columns " << quant.float_bytes
+                  << " -> " << quant.quantized_bytes << " bytes, candidates " << quant.candidates
+                  << ", false positives " << quant.false_positives << " ("
+                  << 100.0 * quant.false_positive_rate() << "%)\n";
+    }
     // ----------- Detection end ------------
 
     // Write output pairs to file
-    if (!aabb::write_pairs(out_path, pairs, err)) {
+    if (!stream && !aabb::write_pairs(out_path, pairs, out_format, err)) {
         std::cerr << "Failed to write pairs: " << err << '\n';
         return 3;
     }
 
-    std::cout << "Read " << N << " boxes, found " << pairs.size() << " pairs. Wrote: " << out_path << "\n";
+    const uint64_t num_pairs = stream ? writer.count() : pairs.size();
+    std::cout << "Read " << N << " boxes, found " << num_pairs << " pairs. Wrote: " << out_path << "\n";
     return 0;
 }
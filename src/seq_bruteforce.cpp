@@ -1,25 +1,50 @@
 #include "seq_bruteforce.h"
 
+#include "box_soa.h"
+#include "engine_stats.h"
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
 
-// Basic AABB intersection test
-static inline bool intersects(const aabb::AABB& box_a, const aabb::AABB& box_b) {
-    return !(box_a.max_x < box_b.min_x ||
-             box_b.max_x < box_a.min_x ||
-             box_a.max_y < box_b.min_y ||
-             box_b.max_y < box_a.min_y);
+
+void brute_force(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink)
+{
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
+    const aabb::BoxSoA soa = aabb::BoxSoA::from_boxes(boxes);
+    aabb::PairEmitter emitter(sink);
+    aabb::EngineStats *const stats = aabb::stats_recorder();
+    if (stats) stats->pairs_tested += uint64_t(N) * (N ? N - 1 : 0) / 2;
+
+    // Test box i against all later boxes, one vector of candidates at a time
+    std::vector<uint32_t> hits(N + aabb::simd::kOutPadding);
+    for (uint32_t i = 0; i < N; ++i) {
+        const size_t n = aabb::simd::overlap_2d(
+            soa.min_x.data(), soa.min_y.data(), soa.max_x.data(), soa.max_y.data(),
+            i + 1, N,
+            soa.min_x[i], soa.min_y[i], soa.max_x[i], soa.max_y[i],
+            hits.data());
+        if (stats) stats->pairs_hit += n;
+        const uint32_t id_i = soa.id[i];
+        for (size_t h = 0; h < n; ++h) {
+            const uint32_t id_j = soa.id[hits[h]];
+            emitter.emit(std::min(id_i, id_j), std::max(id_i, id_j));
+        }
+    }
 }
 
 std::vector<std::pair<uint32_t, uint32_t>> brute_force(
     const uint32_t N,
-    const std::vector<aabb::AABB> boxes)
+    aabb::BoxSpan boxes)
 {
     std::vector<std::pair<uint32_t, uint32_t>> pairs;
     pairs.reserve(64);
 
-    for (uint32_t i = 0; i < N; ++i)
-        for (uint32_t j = i + 1; j < N; ++j)
-            if (intersects(boxes[i], boxes[j]))
-                pairs.emplace_back(i, j);
-
+    aabb::VectorPairSink sink(pairs);
+    brute_force(N, boxes, sink);
+    // Row order is only id order when the ids are the indices
+    aabb::sort_pairs(pairs);
     return pairs;
 }
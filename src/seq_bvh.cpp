@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "seq_bvh.h"
+
+#include "box_soa.h"
+#include "engine_stats.h"
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
+
+// Most boxes per leaf; leaves are tested with one overlap_2d call
+static constexpr uint32_t kLeafSize = 8;
+
+// Node bounds plus the contiguous Morton-order slot range [first, last) it
+// covers. Inner nodes store their children, leaves have left == kLeaf.
+struct BvhNode {
+    float min_x, min_y, max_x, max_y;
+    uint32_t first, last;
+    uint32_t left, right;
+};
+
+static constexpr uint32_t kLeaf = 0xFFFFFFFFu;
+
+// Spread the low 15 bits of v to the even bit positions
+static inline uint32_t expand_bits(uint32_t v) {
+    v &= 0x7FFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+// 30-bit Morton code of a point inside the square [lo, lo + 1 / inv]
+static inline uint32_t morton_code(float x, float y, float lo_x, float lo_y, float inv) {
+    const float fx = std::min(std::max((x - lo_x) * inv, 0.0f), 1.0f);
+    const float fy = std::min(std::max((y - lo_y) * inv, 0.0f), 1.0f);
+    const uint32_t ix = std::min(static_cast<uint32_t>(fx * 32768.0f), 32767u);
+    const uint32_t iy = std::min(static_cast<uint32_t>(fy * 32768.0f), 32767u);
+    return (expand_bits(ix) << 1) | expand_bits(iy);
+}
+
+class Bvh {
+public:
+    // Boxes in Morton order and the tree over them (nodes[0] is the root)
+    aabb::BoxSoA boxes;
+    std::vector<BvhNode> nodes;
+
+    void build(aabb::BoxSpan input) {
+        const size_t n = input.size();
+        nodes.clear();
+        if (n == 0) return;
+
+        float lo_x = input[0].min_x, lo_y = input[0].min_y;
+        float hi_x = lo_x, hi_y = lo_y;
+        for (const auto &b : input) {
+            const float cx = (b.min_x + b.max_x) * 0.5f;
+            const float cy = (b.min_y + b.max_y) * 0.5f;
+            lo_x = std::min(lo_x, cx); hi_x = std::max(hi_x, cx);
+            lo_y = std::min(lo_y, cy); hi_y = std::max(hi_y, cy);
+        }
+        // One scale for both axes keeps cells square, so elongated worlds
+        // split along their long side instead of wasting bits on the short one
+        const float extent = std::max(hi_x - lo_x, hi_y - lo_y);
+        const float inv = extent > 0.0f ? 1.0f / extent : 0.0f;
+
+        codes_.resize(n);
+        std::vector<uint32_t> order(n);
+        for (size_t i = 0; i < n; ++i) {
+            const auto &b = input[i];
+            codes_[i] = morton_code((b.min_x + b.max_x) * 0.5f, (b.min_y + b.max_y) * 0.5f,
+                                    lo_x, lo_y, inv);
+            order[i] = static_cast<uint32_t>(i);
+        }
+        {
+            aabb::ScopedPhase sort_phase(aabb::Phase::Sort);
+            aabb::radix_sort_pairs(codes_, order);
+        }
+        boxes = aabb::BoxSoA::from_boxes(input, order);
+
+        nodes.reserve(2 * (n / kLeafSize) + 2);
+        build_node(0, static_cast<uint32_t>(n));
+    }
+
+private:
+    // Split [first, last) where the highest differing Morton bit flips
+    // (the middle when all codes are equal)
+    uint32_t find_split(uint32_t first, uint32_t last) const {
+        const uint32_t a = codes_[first];
+        const uint32_t b = codes_[last - 1];
+        if (a == b) return first + (last - first) / 2;
+        const int common = __builtin_clz(a ^ b);
+        // First slot whose code has the bit below the common prefix set
+        uint32_t lo = first, hi = last - 1;
+        while (lo + 1 < hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            if (__builtin_clz(a ^ codes_[mid]) > common) lo = mid;
+            else hi = mid;
+        }
+        return hi;
+    }
+
+    uint32_t build_node(uint32_t first, uint32_t last) {
+        const uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(BvhNode{0.0f, 0.0f, 0.0f, 0.0f, first, last, kLeaf, kLeaf});
+
+        if (last - first <= kLeafSize) {
+            BvhNode &node = nodes[index];
+            node.min_x = boxes.min_x[first]; node.min_y = boxes.min_y[first];
+            node.max_x = boxes.max_x[first]; node.max_y = boxes.max_y[first];
+            for (uint32_t k = first + 1; k < last; ++k) {
+                node.min_x = std::min(node.min_x, boxes.min_x[k]);
+                node.min_y = std::min(node.min_y, boxes.min_y[k]);
+                node.max_x = std::max(node.max_x, boxes.max_x[k]);
+                node.max_y = std::max(node.max_y, boxes.max_y[k]);
+            }
+            return index;
+        }
+
+        const uint32_t split = find_split(first, last);
+        const uint32_t left = build_node(first, split);
+        const uint32_t right = build_node(split, last);
+        BvhNode &node = nodes[index];
+        const BvhNode &l = nodes[left];
+        const BvhNode &r = nodes[right];
+        node.left = left;
+        node.right = right;
+        node.min_x = std::min(l.min_x, r.min_x);
+        node.min_y = std::min(l.min_y, r.min_y);
+        node.max_x = std::max(l.max_x, r.max_x);
+        node.max_y = std::max(l.max_y, r.max_y);
+        return index;
+    }
+
+    std::vector<uint32_t> codes_;
+};
+
+void bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink)
+{
+    if (N == 0) return;
+    Bvh tree;
+    {
+        aabb::ScopedPhase build_phase(aabb::Phase::Build);
+        tree.build(boxes);
+    }
+    const aabb::BoxSoA &soa = tree.boxes;
+    const std::vector<BvhNode> &nodes = tree.nodes;
+
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
+    aabb::PairEmitter emitter(sink);
+    aabb::EngineStats *const stats = aabb::stats_recorder();
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    uint32_t hits[kLeafSize + aabb::simd::kOutPadding];
+
+    // Query every box against the tree, visiting only slots after its own,
+    // so each pair is found once, from its earlier Morton slot
+    for (uint32_t i = 0; i < N; ++i) {
+        const float q_min_x = soa.min_x[i], q_min_y = soa.min_y[i];
+        const float q_max_x = soa.max_x[i], q_max_y = soa.max_y[i];
+        const uint32_t id_i = soa.id[i];
+
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty()) {
+            const BvhNode &node = nodes[stack.back()];
+            stack.pop_back();
+            if (node.last <= i + 1) continue;
+            if (node.max_x < q_min_x || q_max_x < node.min_x ||
+                node.max_y < q_min_y || q_max_y < node.min_y) continue;
+
+            if (node.left == kLeaf) {
+                const size_t n = aabb::simd::overlap_2d(
+                    soa.min_x.data(), soa.min_y.data(), soa.max_x.data(), soa.max_y.data(),
+                    std::max(node.first, i + 1), node.last,
+                    q_min_x, q_min_y, q_max_x, q_max_y, hits);
+                if (stats) {
+                    stats->pairs_tested += node.last - std::max(node.first, i + 1);
+                    stats->pairs_hit += n;
+                }
+                for (size_t h = 0; h < n; ++h) {
+                    const uint32_t id_j = soa.id[hits[h]];
+                    emitter.emit(std::min(id_i, id_j), std::max(id_i, id_j));
+                }
+            } else {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> bvh(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairOrder order)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(64);
+
+    // Each pair comes from one query only, so just order the result
+    aabb::VectorPairSink sink(pairs);
+    bvh(N, boxes, sink);
+    if (order == aabb::PairOrder::Sorted) {
+        aabb::ScopedPhase dedupe_phase(aabb::Phase::Dedupe);
+        aabb::sort_pairs(pairs);
+    }
+    return pairs;
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "seq_external_sweep.h"
+#include "aabb_io.h"
+#include "engine_stats.h"
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
+
+// Boxes read back per run refill at least, so a merge of many runs still
+// reads in large blocks
+static constexpr size_t kMinMergeBoxes = size_t(1) << 12;
+
+// Unlinked temporary file in `dir`, deleted by the OS when it is closed
+static std::FILE *open_temp_file(const std::string &dir, std::string &err) {
+    std::string base = dir;
+    if (base.empty()) {
+        const char *env = std::getenv("TMPDIR");
+        base = env && *env ? env : "/tmp";
+    }
+    std::string name = base + "/aabb_runs_XXXXXX";
+    const int fd = mkstemp(&name[0]);
+    if (fd < 0) {
+        err = "cannot create a run file in " + base;
+        return nullptr;
+    }
+    unlink(name.c_str());
+    std::FILE *file = fdopen(fd, "w+b");
+    if (!file) {
+        close(fd);
+        err = "cannot open a run file in " + base;
+    }
+    return file;
+}
+
+// Orders a chunk by its sweep-axis minimum
+struct ChunkSorter {
+    std::vector<uint32_t> keys, order;
+    aabb::RadixScratch<uint32_t> scratch;
+    std::vector<aabb::AABB> sorted;
+
+    void sort(std::vector<aabb::AABB> &chunk, const aabb::AxisEstimate &axis) {
+        const size_t n = chunk.size();
+        keys.resize(n);
+        order.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const aabb::AABB &b = chunk[i];
+            keys[i] = aabb::float_radix_key(axis.axis == aabb::SweepAxis::Y ? b.min_y : b.min_x);
+            order[i] = static_cast<uint32_t>(i);
+        }
+        aabb::radix_sort_pairs(keys, order, nullptr, &scratch);
+        sorted.resize(n);
+        for (size_t i = 0; i < n; ++i) sorted[i] = chunk[order[i]];
+        chunk.swap(sorted);
+    }
+
+    size_t bytes() const {
+        return (keys.capacity() + order.capacity() + scratch.keys.capacity() + scratch.values.capacity()) *
+                   sizeof(uint32_t) +
+               sorted.capacity() * sizeof(aabb::AABB);
+    }
+};
+
+// Open boxes: their filter intervals in dense arrays for simd::overlap_1d,
+// and a min-heap of their sweep-axis maxima so they close in order. Slots of
+// closed boxes are reused, so every array is bounded by the peak open count.
+class ExternalActiveSet {
+public:
+    size_t size() const { return slot_.size(); }
+    const float *lo() const { return lo_.data(); }
+    const float *hi() const { return hi_.data(); }
+    uint32_t id(size_t i) const { return id_[i]; }
+
+    // Closes every box that ends before `s_lo`; a box ending at it still overlaps
+    void close_before(float s_lo) {
+        while (!ends_.empty() && ends_.top().first < s_lo) {
+            remove(ends_.top().second);
+            ends_.pop();
+        }
+    }
+
+    void insert(uint32_t id, float s_hi, float f_lo, float f_hi) {
+        uint32_t slot;
+        if (free_.empty()) {
+            slot = static_cast<uint32_t>(pos_.size());
+            pos_.push_back(0);
+        } else {
+            slot = free_.back();
+            free_.pop_back();
+        }
+        pos_[slot] = static_cast<uint32_t>(slot_.size());
+        slot_.push_back(slot);
+        id_.push_back(id);
+        lo_.push_back(f_lo);
+        hi_.push_back(f_hi);
+        ends_.emplace(s_hi, slot);
+    }
+
+    size_t bytes() const {
+        return (pos_.capacity() + slot_.capacity() + id_.capacity() + free_.capacity()) * sizeof(uint32_t) +
+               (lo_.capacity() + hi_.capacity()) * sizeof(float) +
+               ends_.size() * sizeof(std::pair<float, uint32_t>);
+    }
+
+private:
+    void remove(uint32_t slot) {
+        const uint32_t p = pos_[slot];
+        const uint32_t last = static_cast<uint32_t>(slot_.size() - 1);
+        if (p != last) {
+            slot_[p] = slot_[last];
+            id_[p] = id_[last];
+            lo_[p] = lo_[last];
+            hi_[p] = hi_[last];
+            pos_[slot_[p]] = p;
+        }
+        slot_.pop_back();
+        id_.pop_back();
+        lo_.pop_back();
+        hi_.pop_back();
+        free_.push_back(slot);
+    }
+
+    using End = std::pair<float, uint32_t>;
+    std::priority_queue<End, std::vector<End>, std::greater<End>> ends_;
+    std::vector<uint32_t> pos_, slot_, id_, free_;
+    std::vector<float> lo_, hi_;
+};
+
+// Sweep over boxes handed over in ascending sweep-axis minimum
+class ExternalSweep {
+public:
+    ExternalSweep(const aabb::AxisEstimate &axis, aabb::PairSink &sink)
+        : axis_(axis), emitter_(sink), hits_(aabb::simd::kOutPadding) {}
+
+    void visit(const aabb::AABB &b) {
+        float s_lo, s_hi, f_lo, f_hi;
+        aabb::project_box(b, axis_, s_lo, s_hi, f_lo, f_hi);
+        active_.close_before(s_lo);
+        const size_t k = active_.size();
+        if (hits_.size() < k + aabb::simd::kOutPadding) hits_.resize(2 * k + aabb::simd::kOutPadding);
+        if (stats_) {
+            stats_->active_set.add(k);
+            stats_->pairs_tested += k;
+        }
+
+        // inclusive overlap: [lo, hi] intersects
+        const size_t n = aabb::simd::overlap_1d(active_.lo(), active_.hi(), 0, k, f_lo, f_hi, hits_.data());
+        if (stats_) stats_->pairs_hit += n;
+        const uint32_t id_b = static_cast<uint32_t>(b.id);
+        for (size_t h = 0; h < n; ++h) {
+            const uint32_t id_a = active_.id(hits_[h]);
+            emitter_.emit(std::min(id_a, id_b), std::max(id_a, id_b));
+        }
+        active_.insert(id_b, s_hi, f_lo, f_hi);
+        if (active_.size() > peak_active_) {
+            peak_active_ = active_.size();
+            peak_bytes_ = active_.bytes() + hits_.capacity() * sizeof(uint32_t);
+        }
+    }
+
+    size_t peak_active() const { return peak_active_; }
+    size_t peak_bytes() const { return peak_bytes_; }
+
+private:
+    aabb::AxisEstimate axis_;
+    aabb::PairEmitter emitter_;
+    ExternalActiveSet active_;
+    std::vector<uint32_t> hits_;
+    aabb::EngineStats *const stats_ = aabb::stats_recorder();
+    size_t peak_active_ = 0;
+    size_t peak_bytes_ = 0;
+};
+
+// One spilled run: `count` sorted boxes at `offset` of the run file, read
+// back through a buffer
+struct RunCursor {
+    uint64_t offset = 0;
+    uint64_t remaining = 0;
+    std::vector<aabb::AABB> buffer;
+    size_t pos = 0;
+
+    bool refill(std::FILE *file, size_t capacity) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(capacity, remaining));
+        buffer.resize(n);
+        pos = 0;
+        if (n == 0) return true;
+        if (fseeko(file, static_cast<off_t>(offset), SEEK_SET) != 0 ||
+            std::fread(buffer.data(), sizeof(aabb::AABB), n, file) != n) {
+            return false;
+        }
+        offset += n * sizeof(aabb::AABB);
+        remaining -= n;
+        return true;
+    }
+};
+
+bool external_sort_and_sweep(
+    const std::string &path,
+    aabb::PairSink &sink,
+    const ExternalSweepOptions &options,
+    std::string &err)
+{
+    ExternalSweepReport report;
+    if (options.report) *options.report = report;
+    if (options.axis == aabb::SweepAxis::PCA) {
+        err = "the external sort-and-sweep sweeps on x or y only";
+        return false;
+    }
+    aabb::BoxFileReader reader;
+    if (!reader.open(path, err)) return false;
+    report.boxes = reader.size();
+    const size_t chunk_boxes = std::max<size_t>(options.chunk_boxes, 1);
+
+    // Runs: sorted chunks appended to one unlinked file
+    std::vector<aabb::AABB> chunk;
+    ChunkSorter sorter;
+    aabb::AxisEstimate axis;
+    std::FILE *runs_file = nullptr;
+    std::vector<RunCursor> runs;
+    {
+        aabb::ScopedPhase sort_phase(aabb::Phase::Sort);
+        if (!reader.read(chunk, chunk_boxes, err)) return false;
+        axis = aabb::choose_sweep_axis(chunk, options.axis);
+        report.axis = axis.axis;
+        while (!chunk.empty()) {
+            sorter.sort(chunk, axis);
+            report.peak_memory_bytes = std::max(report.peak_memory_bytes,
+                                                chunk.capacity() * sizeof(aabb::AABB) + sorter.bytes());
+            if (runs.empty() && chunk.size() == reader.size()) break;  // fits one chunk, no spill
+            if (!runs_file && !(runs_file = open_temp_file(options.temp_dir, err))) return false;
+            RunCursor run;
+            run.offset = report.spilled_bytes;
+            run.remaining = chunk.size();
+            if (std::fwrite(chunk.data(), sizeof(aabb::AABB), chunk.size(), runs_file) != chunk.size()) {
+                std::fclose(runs_file);
+                err = "cannot write a run file (disk full?)";
+                return false;
+            }
+            report.spilled_bytes += chunk.size() * sizeof(aabb::AABB);
+            runs.push_back(std::move(run));
+            if (!reader.read(chunk, chunk_boxes, err)) {
+                std::fclose(runs_file);
+                return false;
+            }
+        }
+    }
+    report.runs = runs.size();
+
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
+    ExternalSweep sweep(axis, sink);
+    if (runs.empty()) {
+        for (const aabb::AABB &b : chunk) sweep.visit(b);
+    } else {
+        // The chunk memory goes to the merge buffers
+        std::vector<aabb::AABB>().swap(chunk);
+        sorter = ChunkSorter();
+        std::fflush(runs_file);
+        const size_t capacity = std::max(kMinMergeBoxes, chunk_boxes / runs.size());
+        const bool on_y = axis.axis == aabb::SweepAxis::Y;
+        auto key = [&](size_t r) {
+            const aabb::AABB &b = runs[r].buffer[runs[r].pos];
+            return on_y ? b.min_y : b.min_x;
+        };
+        using Head = std::pair<float, size_t>;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        bool ok = true;
+        for (size_t r = 0; r < runs.size() && ok; ++r) {
+            ok = runs[r].refill(runs_file, capacity);
+            if (ok && !runs[r].buffer.empty()) heads.emplace(key(r), r);
+        }
+        while (ok && !heads.empty()) {
+            const size_t r = heads.top().second;
+            heads.pop();
+            RunCursor &run = runs[r];
+            sweep.visit(run.buffer[run.pos]);
+            if (++run.pos == run.buffer.size()) ok = run.refill(runs_file, capacity);
+            if (ok && run.pos < run.buffer.size()) heads.emplace(key(r), r);
+        }
+        std::fclose(runs_file);
+        if (!ok) {
+            err = "cannot read back a run file";
+            return false;
+        }
+        report.peak_memory_bytes = std::max(report.peak_memory_bytes,
+                                            runs.size() * capacity * sizeof(aabb::AABB) + sweep.peak_bytes());
+    }
+    report.peak_active = sweep.peak_active();
+    report.peak_memory_bytes = std::max(report.peak_memory_bytes,
+                                        chunk.capacity() * sizeof(aabb::AABB) + sweep.peak_bytes());
+    if (options.report) *options.report = report;
+    return true;
+}
@@ -5,6 +5,12 @@
 
 #include "seq_sort_and_sweep.h"
 
+#include "box_soa.h"
+#include "engine_stats.h"
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
+
 // Internal helper: Project boxes onto an axis
 struct Point {
     float value;
@@ -12,53 +18,266 @@ struct Point {
     bool is_start;
 };
 
-std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep(
-    const uint32_t N,
-    const std::vector<aabb::AABB> boxes)
-{
-    // Single-pass sort-and-sweep on the x-axis that filters by y-overlap
-    // This avoids materializing two potentially large candidate sets
-    std::vector<Point> points_x;
-    points_x.reserve(N * 2);
-    for (uint32_t i = 0; i < N; ++i) {
-        points_x.push_back({boxes[i].min_x, i, true});
-        points_x.push_back({boxes[i].max_x, i, false});
+// Active sets keep the filter interval (the y-interval when sweeping on x) of
+// each open box next to its slot, so the overlap test is one contiguous pass
+// over two float arrays.
+
+// Legacy behaviour: insertion order, O(k) erase on every end point
+class OrderedActiveSet {
+public:
+    void reset(uint32_t) {
+        slot_.clear();
+        lo_.clear();
+        hi_.clear();
     }
 
-    // Sort points by x value (start points before end points on tie)
-    std::sort(points_x.begin(), points_x.end(), [](const Point &a, const Point &b) {
-        if (a.value == b.value) {
-            return a.is_start && !b.is_start;
+    size_t size() const { return slot_.size(); }
+    const float *lo() const { return lo_.data(); }
+    const float *hi() const { return hi_.data(); }
+    uint32_t slot(size_t i) const { return slot_[i]; }
+
+    void insert(uint32_t s, float lo, float hi) {
+        slot_.push_back(s);
+        lo_.push_back(lo);
+        hi_.push_back(hi);
+    }
+    void remove(uint32_t s) {
+        const auto pos = std::find(slot_.begin(), slot_.end(), s) - slot_.begin();
+        slot_.erase(slot_.begin() + pos);
+        lo_.erase(lo_.begin() + pos);
+        hi_.erase(hi_.begin() + pos);
+    }
+
+private:
+    std::vector<uint32_t> slot_;
+    std::vector<float> lo_;
+    std::vector<float> hi_;
+};
+
+// Slot map: pos_[s] is the position of slot s, removal moves the last entry
+// into the hole, so the arrays stay dense and removal is O(1)
+class SwapRemoveActiveSet {
+public:
+    void reset(uint32_t num_slots) {
+        pos_.resize(num_slots);
+        slot_.clear();
+        lo_.clear();
+        hi_.clear();
+    }
+
+    size_t size() const { return slot_.size(); }
+    const float *lo() const { return lo_.data(); }
+    const float *hi() const { return hi_.data(); }
+    uint32_t slot(size_t i) const { return slot_[i]; }
+
+    void insert(uint32_t s, float lo, float hi) {
+        pos_[s] = static_cast<uint32_t>(slot_.size());
+        slot_.push_back(s);
+        lo_.push_back(lo);
+        hi_.push_back(hi);
+    }
+    void remove(uint32_t s) {
+        const uint32_t p = pos_[s];
+        const uint32_t last = static_cast<uint32_t>(slot_.size() - 1);
+        if (p != last) {
+            slot_[p] = slot_[last];
+            lo_[p] = lo_[last];
+            hi_[p] = hi_[last];
+            pos_[slot_[p]] = p;
         }
-        return a.value < b.value;
-    });
+        slot_.pop_back();
+        lo_.pop_back();
+        hi_.pop_back();
+    }
 
-    std::vector<uint32_t> active_set;
-    std::vector<std::pair<uint32_t, uint32_t>> pairs;
-    pairs.reserve(64);
+private:
+    std::vector<uint32_t> pos_;
+    std::vector<uint32_t> slot_;
+    std::vector<float> lo_;
+    std::vector<float> hi_;
+};
+
+// Filter interval of every slot; `exact` is set when the sweep and filter axes
+// are rotated, so a candidate still needs the full AABB test
+struct SweepFilter {
+    std::vector<float> lo;
+    std::vector<float> hi;
+    bool exact = false;
+};
+
+struct SortAndSweepWorkspace::Sweep {
+    std::vector<Point> points;
+    std::vector<float> f_lo, f_hi;
+    std::vector<uint32_t> order, slot_of;
+    aabb::BoxSoA soa;
+    SweepFilter filter;
+    OrderedActiveSet ordered;
+    SwapRemoveActiveSet swap_remove;
+    std::vector<uint32_t> hits;
+};
+
+SortAndSweepWorkspace::Sweep &SortAndSweepWorkspace::sweep() {
+    if (!sweep_) sweep_ = Part<Sweep>(new Sweep, [](Sweep *p) { delete p; });
+    return *sweep_;
+}
 
-    for (const auto &point : points_x) {
+template <typename ActiveSet>
+static void sweep(
+    const std::vector<Point> &points,
+    const aabb::BoxSoA &soa,
+    const SweepFilter &filter,
+    ActiveSet &active,
+    std::vector<uint32_t> &hits,
+    aabb::PairSink &sink)
+{
+    active.reset(static_cast<uint32_t>(soa.size()));
+    if (hits.size() < aabb::simd::kOutPadding) hits.resize(aabb::simd::kOutPadding);
+    aabb::PairEmitter emitter(sink);
+    aabb::EngineStats *const stats = aabb::stats_recorder();
+
+    for (const auto &point : points) {
+        const uint32_t b = point.index;
         if (point.is_start) {
-            for (const auto &active_index : active_set) {
-                uint32_t a = active_index;
-                uint32_t b = point.index;
-
-                // Quick y-axis overlap test to ensure overlap on both axes
-                const auto &A = boxes[a];
-                const auto &B = boxes[b];
-                // inclusive overlap: [min_y, max_y] intersects
-                if (A.min_y <= B.max_y && A.max_y >= B.min_y) {
-                    if (a > b) std::swap(a, b);
-                    pairs.emplace_back(a, b);
-                }
+            const float b_lo = filter.lo[b];
+            const float b_hi = filter.hi[b];
+            const size_t k = active.size();
+            if (hits.size() < k + aabb::simd::kOutPadding) hits.resize(2 * k + aabb::simd::kOutPadding);
+            if (stats) {
+                stats->active_set.add(k);
+                stats->pairs_tested += k;
+            }
+
+            // inclusive overlap: [lo, hi] intersects
+            const size_t n = aabb::simd::overlap_1d(
+                active.lo(), active.hi(), 0, k, b_lo, b_hi, hits.data());
+            for (size_t h = 0; h < n; ++h) {
+                const uint32_t a = active.slot(hits[h]);
+                if (filter.exact && !soa.overlaps(a, b)) continue;
+                if (stats) ++stats->pairs_hit;
+                uint32_t id_a = soa.id[a];
+                uint32_t id_b = soa.id[b];
+                if (id_a > id_b) std::swap(id_a, id_b);
+                emitter.emit(id_a, id_b);
             }
-            active_set.push_back(point.index);
+            active.insert(b, b_lo, b_hi);
         } else {
-            active_set.erase(std::remove(active_set.begin(), active_set.end(), point.index), active_set.end());
+            active.remove(b);
+        }
+    }
+}
+
+bool parse_active_set_kind(const std::string &name, ActiveSetKind &kind) {
+    if (name == "ordered") {
+        kind = ActiveSetKind::Ordered;
+    } else if (name == "swap") {
+        kind = ActiveSetKind::SwapRemove;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    const SortAndSweepOptions &options)
+{
+    // Single-pass sort-and-sweep on one axis that filters by overlap on the
+    // other. This avoids materializing two potentially large candidate sets
+    aabb::ScopedPhase build_phase(aabb::Phase::Build);
+    const aabb::AxisEstimate axis = aabb::choose_sweep_axis(boxes, options.axis);
+    if (options.report) *options.report = axis;
+
+    SortAndSweepWorkspace local;
+    SortAndSweepWorkspace::Sweep &ws = (options.workspace ? *options.workspace : local).sweep();
+    std::vector<Point> &points = ws.points;
+    points.clear();
+    points.reserve(N * 2);
+    std::vector<float> &f_lo = ws.f_lo, &f_hi = ws.f_hi;
+    f_lo.resize(N);
+    f_hi.resize(N);
+    for (uint32_t i = 0; i < N; ++i) {
+        float s_lo, s_hi;
+        aabb::project_box(boxes[i], axis, s_lo, s_hi, f_lo[i], f_hi[i]);
+        points.push_back({s_lo, i, true});
+        points.push_back({s_hi, i, false});
+    }
+
+    // Sort points by value (start points before end points on tie)
+    {
+        aabb::ScopedPhase sort_phase(aabb::Phase::Sort);
+        std::sort(points.begin(), points.end(), [](const Point &a, const Point &b) {
+            if (a.value == b.value) {
+                return a.is_start && !b.is_start;
+            }
+            return a.value < b.value;
+        });
+    }
+
+    // Reorder the boxes into start order and renumber the points to SoA slots,
+    // so the sweep reads box data sequentially
+    std::vector<uint32_t> &order = ws.order;
+    order.clear();
+    order.reserve(N);
+    std::vector<uint32_t> &slot_of = ws.slot_of;
+    slot_of.resize(N);
+    for (const auto &point : points) {
+        if (point.is_start) {
+            slot_of[point.index] = static_cast<uint32_t>(order.size());
+            order.push_back(point.index);
         }
     }
+    for (auto &point : points) point.index = slot_of[point.index];
+    ws.soa.assign(boxes, order);
+
+    SweepFilter &filter = ws.filter;
+    filter.lo.resize(N);
+    filter.hi.resize(N);
+    for (uint32_t k = 0; k < N; ++k) {
+        filter.lo[k] = f_lo[order[k]];
+        filter.hi[k] = f_hi[order[k]];
+    }
+    filter.exact = axis.axis == aabb::SweepAxis::PCA;
+
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
+    if (options.active_set == ActiveSetKind::Ordered) {
+        sweep(points, ws.soa, filter, ws.ordered, ws.hits, sink);
+    } else {
+        sweep(points, ws.soa, filter, ws.swap_remove, ws.hits, sink);
+    }
+}
+
+void sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink)
+{
+    sort_and_sweep(N, boxes, sink, SortAndSweepOptions{});
+}
 
-    std::sort(pairs.begin(), pairs.end());
-    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const SortAndSweepOptions &options)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(64);
+
+    // Each pair is reported once, when the later-starting box is swept,
+    // so only ordering is needed here
+    aabb::VectorPairSink sink(pairs);
+    sort_and_sweep(N, boxes, sink, options);
+    if (options.order == aabb::PairOrder::Sorted) {
+        aabb::ScopedPhase dedupe_phase(aabb::Phase::Dedupe);
+        aabb::sort_pairs(pairs);
+    }
     return pairs;
 }
+
+std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep(
+    const uint32_t N,
+    aabb::BoxSpan boxes)
+{
+    return sort_and_sweep(N, boxes, SortAndSweepOptions{});
+}
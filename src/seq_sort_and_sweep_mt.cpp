@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "seq_sort_and_sweep_mt.h"
+
+#include "box_soa.h"
+#include "engine_stats.h"
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
+#include "thread_pool.h"
+
+// Boxes per slab; small enough to balance, large enough to amortize the task
+static constexpr size_t kSlabBoxes = 4096;
+// Slabs in flight per thread before their buffers are handed to the sink
+static constexpr size_t kSlabsPerRound = 4;
+// Candidates tested per overlap_1d call (bounds the per-thread hit buffer)
+static constexpr size_t kScanBlock = 2048;
+
+// Boxes in sweep order. Box k overlaps a later box j on the sweep axis iff
+// s_lo[j] <= s_hi[k], so every pair is found once, from its earlier start.
+struct SweepSlots {
+    aabb::AlignedVector<float> s_lo;
+    aabb::AlignedVector<float> s_hi;
+    aabb::AlignedVector<float> f_lo;
+    aabb::AlignedVector<float> f_hi;
+    aabb::AlignedVector<int16_t> q_lo;  // f_lo and f_hi quantized, if requested
+    aabb::AlignedVector<int16_t> q_hi;
+    aabb::BoxSoA boxes;  // original boxes and ids, same slot order
+    bool exact = false;
+    bool quantized = false;
+};
+
+struct SortAndSweepWorkspace::Slabs {
+    std::unique_ptr<aabb::ThreadPool> pool;
+    std::vector<uint32_t> keys, order;
+    aabb::RadixScratch<uint32_t> radix;
+    SweepSlots slots;
+    std::vector<std::vector<uint32_t>> hits;       // per worker
+    std::vector<std::vector<aabb::Pair>> buffers;  // per slab of a round
+};
+
+SortAndSweepWorkspace::Slabs &SortAndSweepWorkspace::slabs() {
+    if (!slabs_) slabs_ = Part<Slabs>(new Slabs, [](Slabs *p) { delete p; });
+    return *slabs_;
+}
+
+static void scan_slab(
+    const SweepSlots &slots,
+    size_t begin,
+    size_t end,
+    std::vector<uint32_t> &hits,
+    std::vector<aabb::Pair> &out,
+    aabb::EngineStats *stats,
+    aabb::QuantizationStats &quant)
+{
+    const size_t n = slots.s_lo.size();
+    const float *s_lo = slots.s_lo.data();
+    for (size_t k = begin; k < end; ++k) {
+        const size_t last = std::upper_bound(s_lo + k + 1, s_lo + n, slots.s_hi[k]) - s_lo;
+        const float q_lo = slots.f_lo[k];
+        const float q_hi = slots.f_hi[k];
+        const uint32_t id_k = slots.boxes.id[k];
+        if (stats) {
+            stats->active_set.add(last - k - 1);
+            stats->pairs_tested += last - k - 1;
+        }
+
+        for (size_t b = k + 1; b < last; b += kScanBlock) {
+            const size_t e = std::min(last, b + kScanBlock);
+            size_t h;
+            if (slots.quantized) {
+                h = aabb::simd::overlap_1d_i16(
+                    slots.q_lo.data(), slots.q_hi.data(), b, e, slots.q_lo[k], slots.q_hi[k], hits.data());
+                quant.candidates += h;
+            } else {
+                h = aabb::simd::overlap_1d(
+                    slots.f_lo.data(), slots.f_hi.data(), b, e, q_lo, q_hi, hits.data());
+            }
+            for (size_t i = 0; i < h; ++i) {
+                const uint32_t j = hits[i];
+                if (slots.quantized && (slots.f_lo[j] > q_hi || slots.f_hi[j] < q_lo)) {
+                    ++quant.false_positives;
+                    continue;
+                }
+                if (slots.exact && !slots.boxes.overlaps(k, j)) continue;
+                if (stats) ++stats->pairs_hit;
+                const uint32_t id_j = slots.boxes.id[j];
+                out.emplace_back(std::min(id_k, id_j), std::max(id_k, id_j));
+            }
+        }
+    }
+}
+
+void sort_and_sweep_mt(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    const SortAndSweepOptions &options)
+{
+    aabb::ScopedPhase build_phase(aabb::Phase::Build);
+    const aabb::AxisEstimate axis = aabb::choose_sweep_axis(boxes, options.axis);
+    if (options.report) *options.report = axis;
+    if (options.quant_report) *options.quant_report = aabb::QuantizationStats{};
+    if (N == 0) return;
+
+    SortAndSweepWorkspace local;
+    SortAndSweepWorkspace::Slabs &ws = (options.workspace ? *options.workspace : local).slabs();
+    const unsigned threads = aabb::resolve_threads(options.threads);
+    if (!ws.pool || ws.pool->size() != threads) ws.pool.reset(new aabb::ThreadPool(threads));
+    aabb::ThreadPool &pool = *ws.pool;
+    const size_t num_slabs = (N + kSlabBoxes - 1) / kSlabBoxes;
+    auto slab_range = [&](size_t s, size_t &begin, size_t &end) {
+        begin = std::min<size_t>(N, s * kSlabBoxes);
+        end = std::min<size_t>(N, begin + kSlabBoxes);
+    };
+
+    // Sort start points: keys on the sweep axis, ties stay in input order
+    std::vector<uint32_t> &keys = ws.keys, &order = ws.order;
+    keys.resize(N);
+    order.resize(N);
+    {
+        aabb::ScopedPhase sort_phase(aabb::Phase::Sort);
+        pool.run(num_slabs, [&](size_t s, unsigned) {
+            size_t begin, end;
+            slab_range(s, begin, end);
+            for (size_t i = begin; i < end; ++i) {
+                float s_lo, s_hi, f_lo, f_hi;
+                aabb::project_box(boxes[i], axis, s_lo, s_hi, f_lo, f_hi);
+                keys[i] = aabb::float_radix_key(s_lo);
+                order[i] = static_cast<uint32_t>(i);
+            }
+        });
+        aabb::radix_sort_pairs(keys, order, &pool, &ws.radix);
+    }
+
+    // Gather boxes into sweep order
+    SweepSlots &slots = ws.slots;
+    slots.s_lo.resize(N);
+    slots.s_hi.resize(N);
+    slots.f_lo.resize(N);
+    slots.f_hi.resize(N);
+    slots.boxes.resize(N);
+    slots.exact = axis.axis == aabb::SweepAxis::PCA;
+    pool.run(num_slabs, [&](size_t s, unsigned) {
+        size_t begin, end;
+        slab_range(s, begin, end);
+        for (size_t k = begin; k < end; ++k) {
+            const aabb::AABB &box = boxes[order[k]];
+            aabb::project_box(box, axis, slots.s_lo[k], slots.s_hi[k], slots.f_lo[k], slots.f_hi[k]);
+            slots.boxes.set(k, box);
+        }
+    });
+
+    // Quantized filter intervals in one frame over the filter-axis range
+    slots.quantized = options.quantized;
+    if (slots.quantized) {
+        std::vector<float> slab_lo(num_slabs), slab_hi(num_slabs);
+        pool.run(num_slabs, [&](size_t s, unsigned) {
+            size_t begin, end;
+            slab_range(s, begin, end);
+            slab_lo[s] = *std::min_element(slots.f_lo.begin() + begin, slots.f_lo.begin() + end);
+            slab_hi[s] = *std::max_element(slots.f_hi.begin() + begin, slots.f_hi.begin() + end);
+        });
+        double origin, scale;
+        aabb::world_quant_frame(*std::min_element(slab_lo.begin(), slab_lo.end()),
+                                *std::max_element(slab_hi.begin(), slab_hi.end()), origin, scale);
+        slots.q_lo.resize(N);
+        slots.q_hi.resize(N);
+        pool.run(num_slabs, [&](size_t s, unsigned) {
+            size_t begin, end;
+            slab_range(s, begin, end);
+            for (size_t k = begin; k < end; ++k) {
+                slots.q_lo[k] = aabb::quantize_lo(slots.f_lo[k], origin, scale);
+                slots.q_hi[k] = aabb::quantize_hi(slots.f_hi[k], origin, scale);
+            }
+        });
+    }
+
+    // Sweep slabs in rounds; each slab fills its own buffer and the buffers go
+    // to the sink in slab order, so the output does not depend on scheduling
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
+    std::vector<std::vector<uint32_t>> &hits = ws.hits;
+    hits.resize(pool.size());
+    for (auto &h : hits) h.resize(kScanBlock + aabb::simd::kOutPadding);
+    const size_t round = std::max<size_t>(1, pool.size() * kSlabsPerRound);
+    std::vector<std::vector<aabb::Pair>> &buffers = ws.buffers;
+    if (buffers.size() < std::min(round, num_slabs)) buffers.resize(std::min(round, num_slabs));
+    aabb::EngineStats *const stats = aabb::stats_recorder();
+    std::vector<aabb::EngineStats> worker_stats(stats ? pool.size() : 0);
+    std::vector<aabb::QuantizationStats> worker_quant(pool.size());
+    for (size_t first = 0; first < num_slabs; first += round) {
+        const size_t count = std::min(round, num_slabs - first);
+        pool.run(count, [&](size_t t, unsigned worker) {
+            size_t begin, end;
+            slab_range(first + t, begin, end);
+            buffers[t].clear();
+            scan_slab(slots, begin, end, hits[worker], buffers[t], stats ? &worker_stats[worker] : nullptr,
+                      worker_quant[worker]);
+        });
+        for (size_t t = 0; t < count; ++t) {
+            if (!buffers[t].empty()) sink.on_pairs(buffers[t].data(), buffers[t].size());
+        }
+    }
+    for (const aabb::EngineStats &s : worker_stats) stats->merge(s);
+
+    if (options.quant_report) {
+        aabb::QuantizationStats report;
+        if (slots.quantized) {
+            report.boxes = N;
+            report.float_bytes = uint64_t(N) * 2 * sizeof(float);
+            report.quantized_bytes = uint64_t(N) * 2 * sizeof(int16_t);
+            for (const aabb::QuantizationStats &q : worker_quant) report.merge(q);
+        }
+        *options.quant_report = report;
+    }
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> sort_and_sweep_mt(
+    const uint32_t N,
+    aabb::BoxSpan boxes,
+    const SortAndSweepOptions &options)
+{
+    // Pairs are unique by construction; slab order is kept, no global sort
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    sort_and_sweep_mt(N, boxes, sink, options);
+    return pairs;
+}
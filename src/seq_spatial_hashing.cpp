@@ -1,133 +1,365 @@
-#include <unordered_map>
-#include <cmath>
 #include <algorithm>
 
 #include "seq_spatial_hashing.h"
 
+#include "box_soa.h"
+#include "engine_stats.h"
+#include "grid_levels.h"
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
 
-struct CellCoord {
-    int x;
-    int y;
-    bool operator==(const CellCoord& other) const noexcept {
-        return x == other.x && y == other.y;
+using aabb::Bucket;
+using aabb::CellCoord;
+using aabb::CellIndex;
+using aabb::Grid;
+using aabb::GridLevel;
+using aabb::build_grid;
+using aabb::test_range;
+using aabb::visit_fine_buckets;
+
+// Quantize every box in the frame of its own cell (see quantized_boxes.h)
+static void quantize_grid(Grid& grid, int L) {
+    grid.quantized.resize(grid.boxes.size());
+    const double scale = static_cast<double>(aabb::kQuantStepsPerCell) / L;
+    for (size_t k = 0; k < grid.cells.size(); ++k) {
+        const double ox = static_cast<double>(grid.cells[k].x) * L;
+        const double oy = static_cast<double>(grid.cells[k].y) * L;
+        const Bucket& bucket = grid.buckets[k];
+        for (uint32_t slot = bucket.begin; slot < bucket.begin + bucket.count; ++slot) {
+            grid.quantized.set(slot, grid.boxes, slot, ox, oy, scale);
+        }
     }
-};
+}
+
 
-struct CellCoordHash {
-    size_t operator()(const CellCoord& k) const noexcept {
-        const size_t P1 = 73856093u;
-        const size_t P2 = 19349663u;
-        return size_t(k.x) * P1 ^ size_t(k.y) * P2;
+// Collect the buckets of the 3x3 neighborhood around a cell (including itself)
+static inline size_t gather_neighbor_buckets(
+    const Grid& grid,
+    const CellCoord& center,
+    Bucket (&out_buckets)[9])
+{
+    size_t n = 0;
+    for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            const uint32_t k = grid.index.find(CellCoord{center.x + dx, center.y + dy});
+            if (k != CellIndex::kEmpty) {
+                out_buckets[n++] = grid.buckets[k];
+            }
+        }
     }
-};
+    return n;
+}
 
-using Bucket = std::vector<const aabb::AABB*>;
 
+// Split the boxes by grid_level_of and build one grid per occupied level
+static std::vector<GridLevel> build_levels(
+    aabb::BoxSpan boxes,
+    aabb::ThreadPool* pool = nullptr,
+    bool quantized = false)
+{
+    aabb::ScopedPhase build_phase(aabb::Phase::Build);
+    const std::vector<int> sizes = aabb::choose_grid_levels(boxes);
+    std::vector<std::vector<aabb::AABB>> members(sizes.size());
+    for (const auto& box : boxes) {
+        members[aabb::grid_level_of(aabb::box_extent(box), sizes)].push_back(box);
+    }
 
-// Basic AABB intersection test
-static inline bool intersects(const aabb::AABB& box_a, const aabb::AABB& box_b) {
-    return !(box_a.max_x < box_b.min_x ||
-             box_b.max_x < box_a.min_x ||
-             box_a.max_y < box_b.min_y ||
-             box_b.max_y < box_a.min_y);
+    std::vector<GridLevel> levels;
+    levels.reserve(sizes.size());
+    for (size_t l = 0; l < sizes.size(); ++l) {
+        levels.push_back({sizes[l], build_grid(members[l], sizes[l], pool)});
+        if (quantized) quantize_grid(levels.back().grid, sizes[l]);
+    }
+    return levels;
 }
 
+// Inclusive overlap test of slot a of p and slot b of q
+static inline bool overlaps(const aabb::BoxSoA& p, size_t a, const aabb::BoxSoA& q, size_t b) {
+    return !(p.max_x[a] < q.min_x[b] || q.max_x[b] < p.min_x[a] ||
+             p.max_y[a] < q.min_y[b] || q.max_y[b] < p.min_y[a]);
+}
 
-// Compute a reasonable cell size from the input boxes (>= 1)
-static inline int compute_cell_size(const std::vector<aabb::AABB>& boxes) {
-    float max_dim = 0.0f;
-    for (const auto& b : boxes) {
-        max_dim = std::max(max_dim, b.max_x - b.min_x);
-        max_dim = std::max(max_dim, b.max_y - b.min_y);
+void spatial_hashing(
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink)
+{
+    // 1) Choose the cell sizes and 2) build one grid per level
+    const std::vector<GridLevel> levels = build_levels(boxes);
+
+    // 3) Detect collisions
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
+    aabb::PairEmitter emitter(sink);
+    aabb::EngineStats* const stats = aabb::stats_recorder();
+
+    Bucket neighbors[9];
+    for (size_t l = 0; l < levels.size(); ++l) {
+        const Grid& grid = levels[l].grid;
+        const aabb::BoxSoA& soa = grid.boxes;
+
+        // Same level: check 3x3 neighboring cells (including own cell)
+        for (size_t k = 0; k < grid.cells.size(); ++k) {
+            const size_t num_neighbors = gather_neighbor_buckets(grid, grid.cells[k], neighbors);
+
+            // Check for intersections between boxes in current cell and neighboring boxes
+            const Bucket& bucket = grid.buckets[k];
+            if (stats) stats->cell_occupancy.add(bucket.count);
+            for (uint32_t a = bucket.begin; a < bucket.begin + bucket.count; ++a) {
+                const uint32_t id_a = soa.id[a];
+                for (size_t n = 0; n < num_neighbors; ++n) {
+                    const Bucket& nb = neighbors[n];
+                    for (uint32_t b = nb.begin; b < nb.begin + nb.count; ++b) {
+                        if (id_a >= soa.id[b]) continue; // ensure i<j
+                        if (stats) ++stats->pairs_tested;
+                        if (!soa.overlaps(a, b)) continue;
+                        if (stats) ++stats->pairs_hit;
+                        emitter.emit(id_a, soa.id[b]);
+                    }
+                }
+            }
+        }
+
+        // Finer levels: each pair is found once, from its larger box (coarser
+        // levels hold few boxes, so this side issues far fewer lookups)
+        for (size_t m = 0; m < l; ++m) {
+            const aabb::BoxSoA& other = levels[m].grid.boxes;
+            for (uint32_t a = 0; a < soa.size(); ++a) {
+                const uint32_t id_a = soa.id[a];
+                visit_fine_buckets(levels[m].grid, levels[m].cell_size, soa, a, [&](const Bucket& nb) {
+                    if (stats) stats->pairs_tested += nb.count;
+                    for (uint32_t b = nb.begin; b < nb.begin + nb.count; ++b) {
+                        if (!overlaps(soa, a, other, b)) continue;
+                        if (stats) ++stats->pairs_hit;
+                        const uint32_t id_b = other.id[b];
+                        emitter.emit(std::min(id_a, id_b), std::max(id_a, id_b));
+                    }
+                });
+            }
+        }
     }
-    int L = static_cast<int>(std::ceil(max_dim));
-    if (L <= 0) L = 1;
-    return L;
 }
 
-// Build the spatial hash grid mapping cell coordinates to box pointers
-static std::unordered_map<CellCoord, Bucket, CellCoordHash>
-build_grid(const std::vector<aabb::AABB>& boxes, int L) 
+std::vector<std::pair<uint32_t,uint32_t>> spatial_hashing(
+    aabb::BoxSpan boxes,
+    aabb::PairOrder order)
 {
-    std::unordered_map<CellCoord, Bucket, CellCoordHash> grid;
-    grid.reserve(boxes.size());
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(64);
 
-    for (const auto& box : boxes) {
-        // Compute cell coordinate for box center
-        const float cx = (box.min_x + box.max_x) * 0.5f;
-        const float cy = (box.min_y + box.max_y) * 0.5f;
-        const CellCoord c{
-            static_cast<int>(std::floor(cx / L)),
-            static_cast<int>(std::floor(cy / L))
-        };
-        grid[c].push_back(&box);
+    // A box lives in exactly one cell of one level, a same-level pair is only
+    // taken from the cell of its smaller id and a cross-level pair only from
+    // the coarser level, so emission is already unique; only order it
+    aabb::VectorPairSink sink(pairs);
+    spatial_hashing(boxes, sink);
+    if (order == aabb::PairOrder::Sorted) {
+        aabb::ScopedPhase dedupe_phase(aabb::Phase::Dedupe);
+        aabb::sort_pairs(pairs);
     }
-    return grid;
+    return pairs;
 }
 
+// Cells per task of the multithreaded variant
+static constexpr size_t kCellsPerTask = 256;
+// Tasks in flight per thread before their arenas are handed to the sink
+static constexpr size_t kTasksPerRound = 4;
 
-// Get the 3x3 neighboring cell coordinates around a given cell
-void get_neighboring_cells(const CellCoord& cell, std::vector<CellCoord>& neighbors) {
-    for (int dx = -1; dx <= 1; ++dx) {
-        for (int dy = -1; dy <= 1; ++dy) {
-            neighbors.push_back(CellCoord{cell.x + dx, cell.y + dy});
-        }
+// test_range on the quantized columns of a grid: slot a, shifted into the frame
+// of the cell (dx, dy) away, against the slots [begin, end) of that cell. The
+// quantized hits are re-checked on the floats.
+static void test_range_quantized(
+    const Grid& grid,
+    uint32_t a,
+    int dx,
+    int dy,
+    uint32_t begin,
+    uint32_t end,
+    std::vector<uint32_t>& hits,
+    std::vector<aabb::Pair>& out,
+    aabb::EngineStats* stats,
+    aabb::QuantizationStats& quant)
+{
+    if (begin >= end) return;
+    if (hits.size() < (end - begin) + aabb::simd::kOutPadding) {
+        hits.resize(2 * (end - begin) + aabb::simd::kOutPadding);
+    }
+    const aabb::QuantizedSoA& q = grid.quantized;
+    const int32_t sx = dx * aabb::kQuantStepsPerCell;
+    const int32_t sy = dy * aabb::kQuantStepsPerCell;
+    const size_t n = aabb::simd::overlap_2d_i16(
+        q.min_x.data(), q.min_y.data(), q.max_x.data(), q.max_y.data(), begin, end,
+        q.min_x[a] - sx, q.min_y[a] - sy, q.max_x[a] - sx, q.max_y[a] - sy, hits.data());
+    const aabb::BoxSoA& soa = grid.boxes;
+    const uint32_t id_a = soa.id[a];
+    size_t confirmed = 0;
+    for (size_t h = 0; h < n; ++h) {
+        const uint32_t b = hits[h];
+        if (!soa.overlaps(a, b)) continue;
+        ++confirmed;
+        const uint32_t id_b = soa.id[b];
+        out.emplace_back(std::min(id_a, id_b), std::max(id_a, id_b));
+    }
+    quant.candidates += n;
+    quant.false_positives += n - confirmed;
+    if (stats) {
+        stats->pairs_tested += end - begin;
+        stats->pairs_hit += confirmed;
     }
 }
 
-
-// Collect pointers to boxes in the 3x3 neighborhood around a cell
-static inline void gather_neighbor_boxes(
-    const std::unordered_map<CellCoord, Bucket, CellCoordHash>& grid,
-    const CellCoord& center,
-    Bucket& out_neighbor_boxes) 
+// Pairs owned by cell k of level l under the half-neighborhood rule: pairs
+// inside the cell, all pairs with the neighbors at dx > 0 || (dx == 0 && dy > 0),
+// so every pair of adjacent cells is visited from exactly one side, and the
+// pairs of the cell's boxes with boxes of finer levels. With `quant` set the
+// same-level tests run on the quantized columns.
+static void collect_cell_pairs(
+    const std::vector<GridLevel>& levels,
+    size_t l,
+    size_t k,
+    std::vector<uint32_t>& hits,
+    std::vector<aabb::Pair>& out,
+    aabb::EngineStats* stats,
+    aabb::QuantizationStats* quant)
 {
-    std::vector<CellCoord> neighbor_cells;
-    neighbor_cells.reserve(9);
-    get_neighboring_cells(center, neighbor_cells);
-
-    for (const auto& coord : neighbor_cells) {
-        auto it = grid.find(coord);
-        if (it != grid.end()) {
-            const auto& neighbor_bucket = it->second;
-            out_neighbor_boxes.insert(out_neighbor_boxes.end(),
-                                      neighbor_bucket.begin(), neighbor_bucket.end());
+    const Grid& grid = levels[l].grid;
+    const aabb::BoxSoA& soa = grid.boxes;
+    const Bucket& bucket = grid.buckets[k];
+
+    Bucket neighbors[4];
+    CellCoord offsets[4];
+    const size_t num_neighbors = aabb::forward_buckets(grid, k, neighbors, offsets);
+
+    if (stats) stats->cell_occupancy.add(bucket.count);
+    const uint32_t end = bucket.begin + bucket.count;
+    for (uint32_t a = bucket.begin; a < end; ++a) {
+        if (quant) {
+            test_range_quantized(grid, a, 0, 0, a + 1, end, hits, out, stats, *quant);
+        } else {
+            test_range(soa, a, soa, a + 1, end, hits, out, stats);
+        }
+        for (size_t n = 0; n < num_neighbors; ++n) {
+            const uint32_t nb_end = neighbors[n].begin + neighbors[n].count;
+            if (quant) {
+                test_range_quantized(grid, a, offsets[n].x, offsets[n].y, neighbors[n].begin, nb_end,
+                                     hits, out, stats, *quant);
+            } else {
+                test_range(soa, a, soa, neighbors[n].begin, nb_end, hits, out, stats);
+            }
+        }
+    }
+
+    for (size_t m = 0; m < l; ++m) {
+        const Grid& fine = levels[m].grid;
+        for (uint32_t a = bucket.begin; a < end; ++a) {
+            visit_fine_buckets(fine, levels[m].cell_size, soa, a, [&](const Bucket& nb) {
+                test_range(soa, a, fine.boxes, nb.begin, nb.begin + nb.count, hits, out, stats);
+            });
         }
     }
 }
 
+struct SpatialHashingWorkspace::Tasks {
+    std::unique_ptr<aabb::ThreadPool> pool;
+    std::vector<std::vector<uint32_t>> hits;       // per worker
+    std::vector<std::vector<aabb::Pair>> arenas;  // per task of a round
+};
 
-std::vector<std::pair<uint32_t,uint32_t>> spatial_hashing(
-    const std::vector<aabb::AABB> boxes)
-{
-    // 1) Determine cell size
-    const int L = compute_cell_size(boxes);
+SpatialHashingWorkspace::Tasks &SpatialHashingWorkspace::tasks() {
+    if (!tasks_) tasks_ = decltype(tasks_)(new Tasks, [](Tasks *p) { delete p; });
+    return *tasks_;
+}
 
-    // 2) Build spatial grid
-    auto grid = build_grid(boxes, L);
+void spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    const SpatialHashingOptions &options)
+{
+    SpatialHashingWorkspace local;
+    SpatialHashingWorkspace::Tasks &ws = (options.workspace ? *options.workspace : local).tasks();
+    const unsigned threads = aabb::resolve_threads(options.threads);
+    if (!ws.pool || ws.pool->size() != threads) ws.pool.reset(new aabb::ThreadPool(threads));
+    aabb::ThreadPool &pool = *ws.pool;
+    const std::vector<GridLevel> levels = build_levels(boxes, &pool, options.quantized);
+    aabb::ScopedPhase sweep_phase(aabb::Phase::Sweep);
 
-    // 3) Detect collisions
-    std::vector<std::pair<uint32_t, uint32_t>> pairs;
-    pairs.reserve(64);
+    // Cells of every level are split into tasks; each task owns its cells'
+    // pairs and fills its own arena, and arenas go to the sink in task order
+    struct CellTask {
+        size_t level;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<CellTask> tasks;
+    for (size_t l = 0; l < levels.size(); ++l) {
+        const size_t num_cells = levels[l].grid.cells.size();
+        for (size_t begin = 0; begin < num_cells; begin += kCellsPerTask) {
+            tasks.push_back({l, begin, std::min(num_cells, begin + kCellsPerTask)});
+        }
+    }
 
-    // Check 3x3 neighboring cells (including own cell)
-    for (const auto& kv : grid) {
-        Bucket neighbor_boxes;
-        neighbor_boxes.reserve(32);
-        gather_neighbor_boxes(grid, kv.first, neighbor_boxes);
-
-        // Check for intersections between boxes in current cell and neighboring boxes
-        const auto& bucket = kv.second;
-        for (const auto* box_a_ptr : bucket) {
-            for (const auto* box_b_ptr : neighbor_boxes) {
-                if (box_a_ptr->id >= box_b_ptr->id) continue; // ensure i<j
-                if (!intersects(*box_a_ptr, *box_b_ptr)) continue;
-                pairs.emplace_back(box_a_ptr->id, box_b_ptr->id);
+    const size_t num_tasks = tasks.size();
+    const size_t round = std::max<size_t>(1, pool.size() * kTasksPerRound);
+    std::vector<std::vector<uint32_t>> &hits = ws.hits;
+    std::vector<std::vector<aabb::Pair>> &arenas = ws.arenas;
+    hits.resize(pool.size());
+    if (arenas.size() < std::min(round, num_tasks)) arenas.resize(std::min(round, num_tasks));
+    aabb::EngineStats* const stats = aabb::stats_recorder();
+    std::vector<aabb::EngineStats> worker_stats(stats ? pool.size() : 0);
+    std::vector<aabb::QuantizationStats> worker_quant(options.quantized ? pool.size() : 0);
+    for (size_t first = 0; first < num_tasks; first += round) {
+        const size_t count = std::min(round, num_tasks - first);
+        pool.run(count, [&](size_t t, unsigned worker) {
+            const CellTask& task = tasks[first + t];
+            arenas[t].clear();
+            for (size_t k = task.begin; k < task.end; ++k) {
+                collect_cell_pairs(levels, task.level, k, hits[worker], arenas[t],
+                                   stats ? &worker_stats[worker] : nullptr,
+                                   options.quantized ? &worker_quant[worker] : nullptr);
             }
+        });
+        for (size_t t = 0; t < count; ++t) {
+            if (!arenas[t].empty()) sink.on_pairs(arenas[t].data(), arenas[t].size());
         }
     }
+    for (const aabb::EngineStats& s : worker_stats) stats->merge(s);
+
+    if (options.quant_report) {
+        aabb::QuantizationStats report;
+        for (const GridLevel& level : levels) report.boxes += level.grid.quantized.size();
+        report.float_bytes = report.boxes * 4 * sizeof(float);
+        report.quantized_bytes = report.boxes * 4 * sizeof(int16_t);
+        for (const aabb::QuantizationStats& q : worker_quant) report.merge(q);
+        *options.quant_report = report;
+    }
+}
 
-    std::sort(pairs.begin(), pairs.end());
-    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+void spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    aabb::PairSink &sink,
+    unsigned threads)
+{
+    SpatialHashingOptions options;
+    options.threads = threads;
+    spatial_hashing_mt(boxes, sink, options);
+}
+
+std::vector<std::pair<uint32_t,uint32_t>> spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    const SpatialHashingOptions &options)
+{
+    // Unique by the half-neighborhood rule; task order is kept, no global sort
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    aabb::VectorPairSink sink(pairs);
+    spatial_hashing_mt(boxes, sink, options);
     return pairs;
 }
+
+std::vector<std::pair<uint32_t,uint32_t>> spatial_hashing_mt(
+    aabb::BoxSpan boxes,
+    unsigned threads)
+{
+    SpatialHashingOptions options;
+    options.threads = threads;
+    return spatial_hashing_mt(boxes, options);
+}
@@ -0,0 +1,575 @@
+#include "simd_overlap.h"
+
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define AABB_SIMD_X86 1
+    #include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    #define AABB_SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+namespace aabb {
+namespace simd {
+
+using Overlap1D = size_t (*)(const float *, const float *, size_t, size_t, float, float, uint32_t *);
+using Overlap2D = size_t (*)(const float *, const float *, const float *, const float *,
+                             size_t, size_t, float, float, float, float, uint32_t *);
+using Overlap1DI16 = size_t (*)(const int16_t *, const int16_t *, size_t, size_t, int16_t, int16_t, uint32_t *);
+using Overlap2DI16 = size_t (*)(const int16_t *, const int16_t *, const int16_t *, const int16_t *,
+                                size_t, size_t, int16_t, int16_t, int16_t, int16_t, uint32_t *);
+
+// ---------------------------------------------------------------------------
+// Scalar reference kernels (also used for loop tails)
+// ---------------------------------------------------------------------------
+
+static size_t overlap_1d_scalar(
+    const float *lo, const float *hi, size_t begin, size_t end,
+    float q_lo, float q_hi, uint32_t *out)
+{
+    size_t n = 0;
+    for (size_t k = begin; k < end; ++k) {
+        out[n] = static_cast<uint32_t>(k);
+        n += (lo[k] <= q_hi) & (hi[k] >= q_lo);
+    }
+    return n;
+}
+
+static size_t overlap_2d_scalar(
+    const float *min_x, const float *min_y, const float *max_x, const float *max_y,
+    size_t begin, size_t end,
+    float q_min_x, float q_min_y, float q_max_x, float q_max_y, uint32_t *out)
+{
+    size_t n = 0;
+    for (size_t k = begin; k < end; ++k) {
+        out[n] = static_cast<uint32_t>(k);
+        n += (min_x[k] <= q_max_x) & (max_x[k] >= q_min_x) &
+             (min_y[k] <= q_max_y) & (max_y[k] >= q_min_y);
+    }
+    return n;
+}
+
+static size_t overlap_1d_i16_scalar(
+    const int16_t *lo, const int16_t *hi, size_t begin, size_t end,
+    int16_t q_lo, int16_t q_hi, uint32_t *out)
+{
+    size_t n = 0;
+    for (size_t k = begin; k < end; ++k) {
+        out[n] = static_cast<uint32_t>(k);
+        n += (lo[k] <= q_hi) & (hi[k] >= q_lo);
+    }
+    return n;
+}
+
+static size_t overlap_2d_i16_scalar(
+    const int16_t *min_x, const int16_t *min_y, const int16_t *max_x, const int16_t *max_y,
+    size_t begin, size_t end,
+    int16_t q_min_x, int16_t q_min_y, int16_t q_max_x, int16_t q_max_y, uint32_t *out)
+{
+    size_t n = 0;
+    for (size_t k = begin; k < end; ++k) {
+        out[n] = static_cast<uint32_t>(k);
+        n += (min_x[k] <= q_max_x) & (max_x[k] >= q_min_x) &
+             (min_y[k] <= q_max_y) & (max_y[k] >= q_min_y);
+    }
+    return n;
+}
+
+#ifdef AABB_SIMD_X86
+
+// ---------------------------------------------------------------------------
+// AVX2: 8 candidates per step, hits compacted through a lane-index table
+// ---------------------------------------------------------------------------
+
+// kCompress.idx[m] lists the set lanes of the 8-bit mask m, packed to the front
+struct CompressTable {
+    alignas(32) uint32_t idx[256][8];
+    CompressTable() {
+        for (unsigned m = 0; m < 256; ++m) {
+            unsigned n = 0;
+            for (unsigned lane = 0; lane < 8; ++lane) {
+                if (m & (1u << lane)) idx[m][n++] = lane;
+            }
+            for (; n < 8; ++n) idx[m][n] = 0;
+        }
+    }
+};
+static const CompressTable kCompress;
+
+// Stores k + lane for every set lane of `bits` at out (writes all 8 slots)
+__attribute__((target("avx2")))
+static inline size_t compress_store8(uint32_t *out, unsigned bits, size_t k) {
+    const __m256i lanes = _mm256_load_si256(reinterpret_cast<const __m256i *>(kCompress.idx[bits]));
+    const __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(k)), lanes);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), idx);
+    return static_cast<size_t>(__builtin_popcount(bits));
+}
+
+__attribute__((target("avx2")))
+static size_t overlap_1d_avx2(
+    const float *lo, const float *hi, size_t begin, size_t end,
+    float q_lo, float q_hi, uint32_t *out)
+{
+    const __m256 v_lo = _mm256_set1_ps(q_lo);
+    const __m256 v_hi = _mm256_set1_ps(q_hi);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        const __m256 a = _mm256_cmp_ps(_mm256_loadu_ps(lo + k), v_hi, _CMP_LE_OQ);
+        const __m256 b = _mm256_cmp_ps(_mm256_loadu_ps(hi + k), v_lo, _CMP_GE_OQ);
+        const unsigned bits = static_cast<unsigned>(_mm256_movemask_ps(_mm256_and_ps(a, b)));
+        if (bits) n += compress_store8(out + n, bits, k);
+    }
+    return n + overlap_1d_scalar(lo, hi, k, end, q_lo, q_hi, out + n);
+}
+
+__attribute__((target("avx2")))
+static size_t overlap_2d_avx2(
+    const float *min_x, const float *min_y, const float *max_x, const float *max_y,
+    size_t begin, size_t end,
+    float q_min_x, float q_min_y, float q_max_x, float q_max_y, uint32_t *out)
+{
+    const __m256 v_min_x = _mm256_set1_ps(q_min_x);
+    const __m256 v_min_y = _mm256_set1_ps(q_min_y);
+    const __m256 v_max_x = _mm256_set1_ps(q_max_x);
+    const __m256 v_max_y = _mm256_set1_ps(q_max_y);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        __m256 m = _mm256_cmp_ps(_mm256_loadu_ps(min_x + k), v_max_x, _CMP_LE_OQ);
+        m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(max_x + k), v_min_x, _CMP_GE_OQ));
+        m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(min_y + k), v_max_y, _CMP_LE_OQ));
+        m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(max_y + k), v_min_y, _CMP_GE_OQ));
+        const unsigned bits = static_cast<unsigned>(_mm256_movemask_ps(m));
+        if (bits) n += compress_store8(out + n, bits, k);
+    }
+    return n + overlap_2d_scalar(min_x, min_y, max_x, max_y, k, end,
+                                 q_min_x, q_min_y, q_max_x, q_max_y, out + n);
+}
+
+// int16 columns: 16 candidates per step, compacted as two halves of 8
+
+// One bit per 16-bit lane of a compare result
+__attribute__((target("avx2")))
+static inline unsigned movemask_epi16(__m256i m) {
+    // packs keeps 128-bit lanes apart: lanes 0-7 land in bytes 0-7, 8-15 in 16-23
+    const unsigned bytes = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_packs_epi16(m, _mm256_setzero_si256())));
+    return (bytes & 0xFFu) | ((bytes >> 8) & 0xFF00u);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load_i16(const int16_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+__attribute__((target("avx2")))
+static inline size_t compress_store16(uint32_t *out, unsigned bits, size_t k) {
+    size_t n = 0;
+    if (bits & 0xFFu) n += compress_store8(out, bits & 0xFFu, k);
+    if (bits >> 8) n += compress_store8(out + n, bits >> 8, k + 8);
+    return n;
+}
+
+__attribute__((target("avx2")))
+static size_t overlap_1d_i16_avx2(
+    const int16_t *lo, const int16_t *hi, size_t begin, size_t end,
+    int16_t q_lo, int16_t q_hi, uint32_t *out)
+{
+    const __m256i v_lo = _mm256_set1_epi16(q_lo);
+    const __m256i v_hi = _mm256_set1_epi16(q_hi);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 16 <= end; k += 16) {
+        // a lane misses if lo > q_hi or q_lo > hi
+        const __m256i miss = _mm256_or_si256(_mm256_cmpgt_epi16(load_i16(lo + k), v_hi),
+                                             _mm256_cmpgt_epi16(v_lo, load_i16(hi + k)));
+        const unsigned bits = ~movemask_epi16(miss) & 0xFFFFu;
+        if (bits) n += compress_store16(out + n, bits, k);
+    }
+    return n + overlap_1d_i16_scalar(lo, hi, k, end, q_lo, q_hi, out + n);
+}
+
+__attribute__((target("avx2")))
+static size_t overlap_2d_i16_avx2(
+    const int16_t *min_x, const int16_t *min_y, const int16_t *max_x, const int16_t *max_y,
+    size_t begin, size_t end,
+    int16_t q_min_x, int16_t q_min_y, int16_t q_max_x, int16_t q_max_y, uint32_t *out)
+{
+    const __m256i v_min_x = _mm256_set1_epi16(q_min_x);
+    const __m256i v_min_y = _mm256_set1_epi16(q_min_y);
+    const __m256i v_max_x = _mm256_set1_epi16(q_max_x);
+    const __m256i v_max_y = _mm256_set1_epi16(q_max_y);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 16 <= end; k += 16) {
+        __m256i miss = _mm256_cmpgt_epi16(load_i16(min_x + k), v_max_x);
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi16(v_min_x, load_i16(max_x + k)));
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi16(load_i16(min_y + k), v_max_y));
+        miss = _mm256_or_si256(miss, _mm256_cmpgt_epi16(v_min_y, load_i16(max_y + k)));
+        const unsigned bits = ~movemask_epi16(miss) & 0xFFFFu;
+        if (bits) n += compress_store16(out + n, bits, k);
+    }
+    return n + overlap_2d_i16_scalar(min_x, min_y, max_x, max_y, k, end,
+                                     q_min_x, q_min_y, q_max_x, q_max_y, out + n);
+}
+
+// ---------------------------------------------------------------------------
+// AVX-512: 16 candidates per step, compress-store of the hit lanes,
+// masked loads for the tail
+// ---------------------------------------------------------------------------
+
+__attribute__((target("avx512f")))
+static inline __mmask16 tail_mask(size_t k, size_t end) {
+    const size_t rem = end - k;
+    return rem >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << rem) - 1u);
+}
+
+__attribute__((target("avx512f")))
+static size_t overlap_1d_avx512(
+    const float *lo, const float *hi, size_t begin, size_t end,
+    float q_lo, float q_hi, uint32_t *out)
+{
+    const __m512 v_lo = _mm512_set1_ps(q_lo);
+    const __m512 v_hi = _mm512_set1_ps(q_hi);
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t n = 0;
+    for (size_t k = begin; k < end; k += 16) {
+        const __mmask16 live = tail_mask(k, end);
+        __mmask16 m = _mm512_mask_cmp_ps_mask(live, _mm512_maskz_loadu_ps(live, lo + k), v_hi, _CMP_LE_OQ);
+        m = _mm512_mask_cmp_ps_mask(m, _mm512_maskz_loadu_ps(live, hi + k), v_lo, _CMP_GE_OQ);
+        if (m) {
+            const __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(k)), lanes);
+            _mm512_mask_compressstoreu_epi32(out + n, m, idx);
+            n += static_cast<size_t>(__builtin_popcount(m));
+        }
+    }
+    return n;
+}
+
+__attribute__((target("avx512f")))
+static size_t overlap_2d_avx512(
+    const float *min_x, const float *min_y, const float *max_x, const float *max_y,
+    size_t begin, size_t end,
+    float q_min_x, float q_min_y, float q_max_x, float q_max_y, uint32_t *out)
+{
+    const __m512 v_min_x = _mm512_set1_ps(q_min_x);
+    const __m512 v_min_y = _mm512_set1_ps(q_min_y);
+    const __m512 v_max_x = _mm512_set1_ps(q_max_x);
+    const __m512 v_max_y = _mm512_set1_ps(q_max_y);
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t n = 0;
+    for (size_t k = begin; k < end; k += 16) {
+        const __mmask16 live = tail_mask(k, end);
+        __mmask16 m = _mm512_mask_cmp_ps_mask(live, _mm512_maskz_loadu_ps(live, min_x + k), v_max_x, _CMP_LE_OQ);
+        m = _mm512_mask_cmp_ps_mask(m, _mm512_maskz_loadu_ps(live, max_x + k), v_min_x, _CMP_GE_OQ);
+        m = _mm512_mask_cmp_ps_mask(m, _mm512_maskz_loadu_ps(live, min_y + k), v_max_y, _CMP_LE_OQ);
+        m = _mm512_mask_cmp_ps_mask(m, _mm512_maskz_loadu_ps(live, max_y + k), v_min_y, _CMP_GE_OQ);
+        if (m) {
+            const __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(k)), lanes);
+            _mm512_mask_compressstoreu_epi32(out + n, m, idx);
+            n += static_cast<size_t>(__builtin_popcount(m));
+        }
+    }
+    return n;
+}
+
+// int16 columns: 16 candidates widened to int32 per step (AVX-512F only, no
+// BW), scalar tail
+
+__attribute__((target("avx512f")))
+static inline __m512i load_i16x16(const int16_t *p) {
+    // maskz form: GCC flags the undefined pass-through of _mm512_cvtepi16_epi32
+    return _mm512_maskz_cvtepi16_epi32(static_cast<__mmask16>(0xFFFF), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+}
+
+__attribute__((target("avx512f")))
+static size_t overlap_1d_i16_avx512(
+    const int16_t *lo, const int16_t *hi, size_t begin, size_t end,
+    int16_t q_lo, int16_t q_hi, uint32_t *out)
+{
+    const __m512i v_lo = _mm512_set1_epi32(q_lo);
+    const __m512i v_hi = _mm512_set1_epi32(q_hi);
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 16 <= end; k += 16) {
+        __mmask16 m = _mm512_cmple_epi32_mask(load_i16x16(lo + k), v_hi);
+        m = _mm512_mask_cmpge_epi32_mask(m, load_i16x16(hi + k), v_lo);
+        if (m) {
+            const __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(k)), lanes);
+            _mm512_mask_compressstoreu_epi32(out + n, m, idx);
+            n += static_cast<size_t>(__builtin_popcount(m));
+        }
+    }
+    return n + overlap_1d_i16_scalar(lo, hi, k, end, q_lo, q_hi, out + n);
+}
+
+__attribute__((target("avx512f")))
+static size_t overlap_2d_i16_avx512(
+    const int16_t *min_x, const int16_t *min_y, const int16_t *max_x, const int16_t *max_y,
+    size_t begin, size_t end,
+    int16_t q_min_x, int16_t q_min_y, int16_t q_max_x, int16_t q_max_y, uint32_t *out)
+{
+    const __m512i v_min_x = _mm512_set1_epi32(q_min_x);
+    const __m512i v_min_y = _mm512_set1_epi32(q_min_y);
+    const __m512i v_max_x = _mm512_set1_epi32(q_max_x);
+    const __m512i v_max_y = _mm512_set1_epi32(q_max_y);
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 16 <= end; k += 16) {
+        __mmask16 m = _mm512_cmple_epi32_mask(load_i16x16(min_x + k), v_max_x);
+        m = _mm512_mask_cmpge_epi32_mask(m, load_i16x16(max_x + k), v_min_x);
+        m = _mm512_mask_cmple_epi32_mask(m, load_i16x16(min_y + k), v_max_y);
+        m = _mm512_mask_cmpge_epi32_mask(m, load_i16x16(max_y + k), v_min_y);
+        if (m) {
+            const __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(k)), lanes);
+            _mm512_mask_compressstoreu_epi32(out + n, m, idx);
+            n += static_cast<size_t>(__builtin_popcount(m));
+        }
+    }
+    return n + overlap_2d_i16_scalar(min_x, min_y, max_x, max_y, k, end,
+                                     q_min_x, q_min_y, q_max_x, q_max_y, out + n);
+}
+
+#endif // AABB_SIMD_X86
+
+#ifdef AABB_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// NEON: 4 candidates per step
+// ---------------------------------------------------------------------------
+
+static inline size_t store_hits4(uint32_t *out, uint32x4_t m, size_t k) {
+    uint32_t lanes[4];
+    vst1q_u32(lanes, m);
+    size_t n = 0;
+    for (uint32_t l = 0; l < 4; ++l) {
+        out[n] = static_cast<uint32_t>(k + l);
+        n += lanes[l] & 1u;
+    }
+    return n;
+}
+
+static size_t overlap_1d_neon(
+    const float *lo, const float *hi, size_t begin, size_t end,
+    float q_lo, float q_hi, uint32_t *out)
+{
+    const float32x4_t v_lo = vdupq_n_f32(q_lo);
+    const float32x4_t v_hi = vdupq_n_f32(q_hi);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4) {
+        const uint32x4_t m = vandq_u32(vcleq_f32(vld1q_f32(lo + k), v_hi),
+                                       vcgeq_f32(vld1q_f32(hi + k), v_lo));
+        if (vmaxvq_u32(m)) n += store_hits4(out + n, m, k);
+    }
+    return n + overlap_1d_scalar(lo, hi, k, end, q_lo, q_hi, out + n);
+}
+
+static size_t overlap_2d_neon(
+    const float *min_x, const float *min_y, const float *max_x, const float *max_y,
+    size_t begin, size_t end,
+    float q_min_x, float q_min_y, float q_max_x, float q_max_y, uint32_t *out)
+{
+    const float32x4_t v_min_x = vdupq_n_f32(q_min_x);
+    const float32x4_t v_min_y = vdupq_n_f32(q_min_y);
+    const float32x4_t v_max_x = vdupq_n_f32(q_max_x);
+    const float32x4_t v_max_y = vdupq_n_f32(q_max_y);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4) {
+        uint32x4_t m = vcleq_f32(vld1q_f32(min_x + k), v_max_x);
+        m = vandq_u32(m, vcgeq_f32(vld1q_f32(max_x + k), v_min_x));
+        m = vandq_u32(m, vcleq_f32(vld1q_f32(min_y + k), v_max_y));
+        m = vandq_u32(m, vcgeq_f32(vld1q_f32(max_y + k), v_min_y));
+        if (vmaxvq_u32(m)) n += store_hits4(out + n, m, k);
+    }
+    return n + overlap_2d_scalar(min_x, min_y, max_x, max_y, k, end,
+                                 q_min_x, q_min_y, q_max_x, q_max_y, out + n);
+}
+
+// int16 columns: 8 candidates per step
+
+static inline size_t store_hits8(uint32_t *out, uint16x8_t m, size_t k) {
+    uint16_t lanes[8];
+    vst1q_u16(lanes, m);
+    size_t n = 0;
+    for (uint32_t l = 0; l < 8; ++l) {
+        out[n] = static_cast<uint32_t>(k + l);
+        n += lanes[l] & 1u;
+    }
+    return n;
+}
+
+static size_t overlap_1d_i16_neon(
+    const int16_t *lo, const int16_t *hi, size_t begin, size_t end,
+    int16_t q_lo, int16_t q_hi, uint32_t *out)
+{
+    const int16x8_t v_lo = vdupq_n_s16(q_lo);
+    const int16x8_t v_hi = vdupq_n_s16(q_hi);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        const uint16x8_t m = vandq_u16(vcleq_s16(vld1q_s16(lo + k), v_hi),
+                                       vcgeq_s16(vld1q_s16(hi + k), v_lo));
+        if (vmaxvq_u16(m)) n += store_hits8(out + n, m, k);
+    }
+    return n + overlap_1d_i16_scalar(lo, hi, k, end, q_lo, q_hi, out + n);
+}
+
+static size_t overlap_2d_i16_neon(
+    const int16_t *min_x, const int16_t *min_y, const int16_t *max_x, const int16_t *max_y,
+    size_t begin, size_t end,
+    int16_t q_min_x, int16_t q_min_y, int16_t q_max_x, int16_t q_max_y, uint32_t *out)
+{
+    const int16x8_t v_min_x = vdupq_n_s16(q_min_x);
+    const int16x8_t v_min_y = vdupq_n_s16(q_min_y);
+    const int16x8_t v_max_x = vdupq_n_s16(q_max_x);
+    const int16x8_t v_max_y = vdupq_n_s16(q_max_y);
+    size_t n = 0;
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        uint16x8_t m = vcleq_s16(vld1q_s16(min_x + k), v_max_x);
+        m = vandq_u16(m, vcgeq_s16(vld1q_s16(max_x + k), v_min_x));
+        m = vandq_u16(m, vcleq_s16(vld1q_s16(min_y + k), v_max_y));
+        m = vandq_u16(m, vcgeq_s16(vld1q_s16(max_y + k), v_min_y));
+        if (vmaxvq_u16(m)) n += store_hits8(out + n, m, k);
+    }
+    return n + overlap_2d_i16_scalar(min_x, min_y, max_x, max_y, k, end,
+                                     q_min_x, q_min_y, q_max_x, q_max_y, out + n);
+}
+
+#endif // AABB_SIMD_NEON
+
+// ---------------------------------------------------------------------------
+// Runtime dispatch
+// ---------------------------------------------------------------------------
+
+struct Dispatch {
+    Isa isa;
+    Overlap1D overlap_1d;
+    Overlap2D overlap_2d;
+    Overlap1DI16 overlap_1d_i16;
+    Overlap2DI16 overlap_2d_i16;
+};
+
+static Dispatch make_dispatch(Isa isa) {
+    switch (isa) {
+#ifdef AABB_SIMD_X86
+    case Isa::AVX512:
+        return {isa, overlap_1d_avx512, overlap_2d_avx512, overlap_1d_i16_avx512, overlap_2d_i16_avx512};
+    case Isa::AVX2:
+        return {isa, overlap_1d_avx2, overlap_2d_avx2, overlap_1d_i16_avx2, overlap_2d_i16_avx2};
+#endif
+#ifdef AABB_SIMD_NEON
+    case Isa::NEON:
+        return {isa, overlap_1d_neon, overlap_2d_neon, overlap_1d_i16_neon, overlap_2d_i16_neon};
+#endif
+    default:
+        return {Isa::Scalar, overlap_1d_scalar, overlap_2d_scalar, overlap_1d_i16_scalar, overlap_2d_i16_scalar};
+    }
+}
+
+static Dispatch &dispatch() {
+    static Dispatch d = make_dispatch(detect_isa());
+    return d;
+}
+
+Isa detect_isa() {
+#ifdef AABB_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return Isa::AVX512;
+    if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+#endif
+#ifdef AABB_SIMD_NEON
+    return Isa::NEON;
+#endif
+    return Isa::Scalar;
+}
+
+Isa active_isa() {
+    return dispatch().isa;
+}
+
+bool set_isa(Isa isa) {
+    if (static_cast<int>(isa) > static_cast<int>(detect_isa())) return false;
+#ifndef AABB_SIMD_NEON
+    if (isa == Isa::NEON) return false;
+#endif
+#ifdef AABB_SIMD_NEON
+    if (isa == Isa::AVX2 || isa == Isa::AVX512) return false;
+#endif
+    dispatch() = make_dispatch(isa);
+    return true;
+}
+
+const char *isa_name(Isa isa) {
+    switch (isa) {
+    case Isa::NEON: return "neon";
+    case Isa::AVX2: return "avx2";
+    case Isa::AVX512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+bool parse_isa(const std::string &name, Isa &isa) {
+    for (Isa candidate : {Isa::Scalar, Isa::NEON, Isa::AVX2, Isa::AVX512}) {
+        if (name == isa_name(candidate)) {
+            isa = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t overlap_1d(
+    const float *lo, const float *hi,
+    size_t begin, size_t end,
+    float q_lo, float q_hi,
+    uint32_t *out)
+{
+    return dispatch().overlap_1d(lo, hi, begin, end, q_lo, q_hi, out);
+}
+
+size_t overlap_2d(
+    const float *min_x, const float *min_y, const float *max_x, const float *max_y,
+    size_t begin, size_t end,
+    float q_min_x, float q_min_y, float q_max_x, float q_max_y,
+    uint32_t *out)
+{
+    return dispatch().overlap_2d(min_x, min_y, max_x, max_y, begin, end,
+                                 q_min_x, q_min_y, q_max_x, q_max_y, out);
+}
+
+// A query bound past the int16 range either matches every stored value (clamp
+// it) or none (no hits)
+static inline int16_t clamp_i16(int32_t v) {
+    return static_cast<int16_t>(std::min<int32_t>(INT16_MAX, std::max<int32_t>(INT16_MIN, v)));
+}
+
+size_t overlap_1d_i16(
+    const int16_t *lo, const int16_t *hi,
+    size_t begin, size_t end,
+    int32_t q_lo, int32_t q_hi,
+    uint32_t *out)
+{
+    if (q_hi < INT16_MIN || q_lo > INT16_MAX) return 0;
+    return dispatch().overlap_1d_i16(lo, hi, begin, end, clamp_i16(q_lo), clamp_i16(q_hi), out);
+}
+
+size_t overlap_2d_i16(
+    const int16_t *min_x, const int16_t *min_y, const int16_t *max_x, const int16_t *max_y,
+    size_t begin, size_t end,
+    int32_t q_min_x, int32_t q_min_y, int32_t q_max_x, int32_t q_max_y,
+    uint32_t *out)
+{
+    if (q_max_x < INT16_MIN || q_min_x > INT16_MAX || q_max_y < INT16_MIN || q_min_y > INT16_MAX) return 0;
+    return dispatch().overlap_2d_i16(min_x, min_y, max_x, max_y, begin, end,
+                                     clamp_i16(q_min_x), clamp_i16(q_min_y),
+                                     clamp_i16(q_max_x), clamp_i16(q_max_y), out);
+}
+
+} // namespace simd
+} // namespace aabb
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "slab_partition.h"
+
+namespace aabb {
+
+static SlabPartition partition_axis(BoxSpan boxes, size_t slabs, SweepAxis axis, size_t sample) {
+    SlabPartition part;
+    part.axis = axis;
+    const size_t n = boxes.size();
+    const size_t s = std::min(n, sample);
+    std::vector<float> minima(s);
+    for (size_t k = 0; k < s; ++k) minima[k] = part.lo(boxes[k * n / s]);
+    std::sort(minima.begin(), minima.end());
+
+    part.bounds.resize(slabs + 1);
+    part.bounds.front() = -std::numeric_limits<float>::infinity();
+    part.bounds.back() = std::numeric_limits<float>::infinity();
+    for (size_t i = 1; i < slabs; ++i) part.bounds[i] = minima[i * s / slabs];
+    return part;
+}
+
+// Halo copies the sampled boxes make under a partition
+static size_t sampled_halo(BoxSpan boxes, const SlabPartition &part, size_t sample) {
+    const size_t n = boxes.size();
+    const size_t s = std::min(n, sample);
+    size_t halo = 0;
+    for (size_t k = 0; k < s; ++k) {
+        const AABB &b = boxes[k * n / s];
+        halo += part.last(b) - part.first(b);
+    }
+    return halo;
+}
+
+SlabPartition partition_slabs(BoxSpan boxes, size_t slabs, SweepAxis axis, size_t sample) {
+    slabs = std::max<size_t>(slabs, 1);
+    sample = std::max<size_t>(sample, 1);
+    if (boxes.empty()) {
+        SlabPartition part;
+        part.axis = axis == SweepAxis::Y ? SweepAxis::Y : SweepAxis::X;
+        part.bounds.assign(slabs + 1, std::numeric_limits<float>::infinity());
+        part.bounds.front() = -std::numeric_limits<float>::infinity();
+        return part;
+    }
+    if (axis == SweepAxis::X || axis == SweepAxis::Y || slabs == 1) {
+        return partition_axis(boxes, slabs, axis == SweepAxis::Y ? SweepAxis::Y : SweepAxis::X, sample);
+    }
+    SlabPartition x = partition_axis(boxes, slabs, SweepAxis::X, sample);
+    SlabPartition y = partition_axis(boxes, slabs, SweepAxis::Y, sample);
+    return sampled_halo(boxes, y, sample) < sampled_halo(boxes, x, sample) ? y : x;
+}
+
+} // namespace aabb
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <limits>
+
+#include "spatial_grid.h"
+
+#include "phase_timer.h"
+#include "radix_sort.h"
+#include "simd_overlap.h"
+
+namespace aabb {
+
+Grid build_grid(BoxSpan boxes, int L, ThreadPool* pool)
+{
+    Grid grid;
+    const size_t n = boxes.size();
+    if (n == 0) return grid;
+
+    std::vector<CellCoord> cell_of(n);
+    int min_x = std::numeric_limits<int>::max(), min_y = std::numeric_limits<int>::max();
+    int max_x = std::numeric_limits<int>::min(), max_y = std::numeric_limits<int>::min();
+    for (size_t i = 0; i < n; ++i) {
+        const CellCoord c = cell_of_box(boxes[i], L);
+        cell_of[i] = c;
+        min_x = std::min(min_x, c.x);
+        min_y = std::min(min_y, c.y);
+        max_x = std::max(max_x, c.x);
+        max_y = std::max(max_y, c.y);
+    }
+    grid.index.init(min_x, min_y, max_x, max_y, n);
+
+    std::vector<uint64_t> keys(n);
+    std::vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = grid.index.key(cell_of[i]);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    {
+        ScopedPhase sort_phase(Phase::Sort);
+        radix_sort_pairs(keys, order, pool);
+    }
+
+    // Runs of equal keys are the occupied cells
+    for (size_t i = 0; i < n; ++i) {
+        if (i == 0 || keys[i] != keys[i - 1]) {
+            const uint32_t k = static_cast<uint32_t>(grid.cells.size());
+            grid.index.insert(keys[i], k);
+            grid.cells.push_back(cell_of[order[i]]);
+            grid.buckets.push_back({static_cast<uint32_t>(i), 0});
+        }
+        grid.buckets.back().count++;
+    }
+    grid.boxes = BoxSoA::from_boxes(boxes, order);
+    grid.order = std::move(order);
+    return grid;
+}
+
+size_t forward_buckets(const Grid& grid, size_t k, Bucket (&buckets)[4], CellCoord (&offsets)[4])
+{
+    const CellCoord c = grid.cells[k];
+    size_t n = 0;
+    for (const auto& d : kForwardCells) {
+        const uint32_t nk = grid.index.find(CellCoord{c.x + d[0], c.y + d[1]});
+        if (nk == CellIndex::kEmpty) continue;
+        offsets[n] = CellCoord{d[0], d[1]};
+        buckets[n++] = grid.buckets[nk];
+    }
+    return n;
+}
+
+void test_range(
+    const BoxSoA& soa,
+    uint32_t a,
+    const BoxSoA& other,
+    uint32_t begin,
+    uint32_t end,
+    std::vector<uint32_t>& hits,
+    std::vector<Pair>& out,
+    EngineStats* stats)
+{
+    if (begin >= end) return;
+    if (hits.size() < (end - begin) + simd::kOutPadding) {
+        hits.resize(2 * (end - begin) + simd::kOutPadding);
+    }
+    const size_t n = simd::overlap_2d(
+        other.min_x.data(), other.min_y.data(), other.max_x.data(), other.max_y.data(),
+        begin, end, soa.min_x[a], soa.min_y[a], soa.max_x[a], soa.max_y[a], hits.data());
+    if (stats) {
+        stats->pairs_tested += end - begin;
+        stats->pairs_hit += n;
+    }
+    const uint32_t id_a = soa.id[a];
+    for (size_t h = 0; h < n; ++h) {
+        const uint32_t id_b = other.id[hits[h]];
+        out.emplace_back(std::min(id_a, id_b), std::max(id_a, id_b));
+    }
+}
+
+} // namespace aabb
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "sweep_axis.h"
+
+namespace aabb {
+
+bool parse_sweep_axis(const std::string &name, SweepAxis &axis) {
+    if (name == "x") {
+        axis = SweepAxis::X;
+    } else if (name == "y") {
+        axis = SweepAxis::Y;
+    } else if (name == "auto") {
+        axis = SweepAxis::Auto;
+    } else if (name == "pca") {
+        axis = SweepAxis::PCA;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *sweep_axis_name(SweepAxis axis) {
+    switch (axis) {
+    case SweepAxis::X: return "x";
+    case SweepAxis::Y: return "y";
+    case SweepAxis::Auto: return "auto";
+    case SweepAxis::PCA: return "pca";
+    }
+    return "?";
+}
+
+// Number of overlapping pairs among the intervals [lo[i], hi[i]], counted per
+// interval as (#lo <= hi_i) - (#hi < lo_i) - 1 on the two sorted endpoint lists
+static double count_interval_overlaps(std::vector<float> lo, std::vector<float> hi) {
+    const std::vector<float> lo_unsorted = lo;
+    const std::vector<float> hi_unsorted = hi;
+    std::sort(lo.begin(), lo.end());
+    std::sort(hi.begin(), hi.end());
+
+    double total = 0.0;
+    for (size_t i = 0; i < lo.size(); ++i) {
+        const auto starts = std::upper_bound(lo.begin(), lo.end(), hi_unsorted[i]) - lo.begin();
+        const auto ended = std::lower_bound(hi.begin(), hi.end(), lo_unsorted[i]) - hi.begin();
+        total += static_cast<double>(starts - ended - 1);
+    }
+    return total * 0.5;
+}
+
+AxisEstimate choose_sweep_axis(
+    BoxSpan boxes,
+    SweepAxis requested,
+    size_t sample)
+{
+    AxisEstimate est;
+    est.axis = requested == SweepAxis::Auto ? SweepAxis::X : requested;
+
+    const size_t n = boxes.size();
+    const size_t s = std::min(n, std::max<size_t>(sample, 2));
+    est.sample_size = s;
+    if (s < 2) return est;
+
+    // Evenly strided sample; pair counts scale with n(n-1) / s(s-1)
+    std::vector<const AABB *> picked(s);
+    for (size_t k = 0; k < s; ++k) picked[k] = &boxes[k * n / s];
+    const double scale = (static_cast<double>(n) * (n - 1)) / (static_cast<double>(s) * (s - 1));
+
+    std::vector<float> lo(s), hi(s);
+    for (size_t k = 0; k < s; ++k) { lo[k] = picked[k]->min_x; hi[k] = picked[k]->max_x; }
+    est.candidates_x = count_interval_overlaps(lo, hi) * scale;
+    for (size_t k = 0; k < s; ++k) { lo[k] = picked[k]->min_y; hi[k] = picked[k]->max_y; }
+    est.candidates_y = count_interval_overlaps(lo, hi) * scale;
+
+    if (requested == SweepAxis::Auto) {
+        est.axis = est.candidates_y < est.candidates_x ? SweepAxis::Y : SweepAxis::X;
+    } else if (requested == SweepAxis::PCA) {
+        // Principal axis of the center covariance: the direction of largest spread
+        double mx = 0.0, my = 0.0;
+        for (const AABB *b : picked) {
+            mx += 0.5 * (b->min_x + b->max_x);
+            my += 0.5 * (b->min_y + b->max_y);
+        }
+        mx /= s;
+        my /= s;
+        double cxx = 0.0, cyy = 0.0, cxy = 0.0;
+        for (const AABB *b : picked) {
+            const double dx = 0.5 * (b->min_x + b->max_x) - mx;
+            const double dy = 0.5 * (b->min_y + b->max_y) - my;
+            cxx += dx * dx;
+            cyy += dy * dy;
+            cxy += dx * dy;
+        }
+        const double theta = 0.5 * std::atan2(2.0 * cxy, cxx - cyy);
+        est.dir_x = static_cast<float>(std::cos(theta));
+        est.dir_y = static_cast<float>(std::sin(theta));
+
+        float f_lo, f_hi;
+        for (size_t k = 0; k < s; ++k) project_box(*picked[k], est, lo[k], hi[k], f_lo, f_hi);
+        est.candidates_pca = count_interval_overlaps(lo, hi) * scale;
+    }
+    return est;
+}
+
+} // namespace aabb
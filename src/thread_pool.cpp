@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+namespace aabb {
+
+unsigned resolve_threads(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    return std::max(1u, threads);
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+    const unsigned n = resolve_threads(threads);
+    workers_.reserve(n - 1);
+    for (unsigned w = 1; w < n; ++w) {
+        workers_.emplace_back([this, w] { worker_loop(w); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : workers_) t.join();
+}
+
+// Claims tasks of the current run until none are left
+void ThreadPool::drain(unsigned worker) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (next_task_ < num_tasks_) {
+        const size_t t = next_task_++;
+        const Task &task = *task_;
+        lock.unlock();
+        task(t, worker);
+        lock.lock();
+        if (--pending_ == 0) done_.notify_all();
+    }
+}
+
+void ThreadPool::worker_loop(unsigned worker) {
+    size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        drain(worker);
+    }
+}
+
+void ThreadPool::run(size_t num_tasks, const Task &task) {
+    if (num_tasks == 0) return;
+    if (workers_.empty() || num_tasks == 1) {
+        for (size_t t = 0; t < num_tasks; ++t) task(t, 0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        num_tasks_ = num_tasks;
+        next_task_ = 0;
+        pending_ = num_tasks;
+        ++generation_;
+    }
+    wake_.notify_all();
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return pending_ == 0; });
+    task_ = nullptr;
+    num_tasks_ = 0;
+}
+
+} // namespace aabb